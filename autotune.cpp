@@ -0,0 +1,201 @@
+#include "autotune.hpp"
+#include "clrps_rules.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Minimum measured time per candidate
+#define TUNE_SECONDS	0.2
+
+static std::string deviceString(cl_device_id device, cl_device_info info) {
+	size_t length;
+	clGetDeviceInfo(device, info, 0, NULL, &length);
+	std::vector<char> value(length + 1, '\0');
+	clGetDeviceInfo(device, info, length, &value[0], NULL);
+
+	// Keep the cache line structure intact
+	std::string str(&value[0]);
+	for(size_t i = 0; i < str.size(); i++) {
+		if(str[i] == '\t' || str[i] == '\n') {
+			str[i] = ' ';
+		}
+	}
+	return str;
+}
+
+std::string tuneKey(cl_device_id device, unsigned int width, unsigned int height) {
+	std::stringstream key;
+	key << deviceString(device, CL_DEVICE_NAME) << "\t" << deviceString(device, CL_DRIVER_VERSION) << "\t" << width << "x" << height;
+	return key.str();
+}
+
+/*
+ * Cache lines: device <tab> driver <tab> WxH <tab> kernel tile_w tile_h coarsen local_w local_h
+ */
+bool loadTunedLaunch(const char *cache_file, const std::string &key, LaunchConfig &launch) {
+	std::ifstream cache(cache_file);
+	std::string line;
+
+	while(getline(cache, line)) {
+		if(line.compare(0, key.size(), key) != 0 || line.size() <= key.size() || line[key.size()] != '\t') {
+			continue;
+		}
+		std::istringstream value(line.substr(key.size() + 1));
+		LaunchConfig tuned;
+		if(value >> tuned.kernel >> tuned.tile_width >> tuned.tile_height >> tuned.coarsen >> tuned.local_width >> tuned.local_height) {
+			launch = tuned;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool storeTunedLaunch(const char *cache_file, const std::string &key, const LaunchConfig &launch) {
+	std::vector<std::string> lines;
+	std::string line;
+
+	// Keep the entries of other devices and sizes
+	{
+		std::ifstream cache(cache_file);
+		while(getline(cache, line)) {
+			if(line.compare(0, key.size() + 1, key + "\t") != 0) {
+				lines.push_back(line);
+			}
+		}
+	}
+
+	std::stringstream entry;
+	entry << key << "\t" << launch.kernel << " " << launch.tile_width << " " << launch.tile_height << " "
+			<< launch.coarsen << " " << launch.local_width << " " << launch.local_height;
+	lines.push_back(entry.str());
+
+	std::ofstream cache(cache_file);
+	for(size_t i = 0; i < lines.size(); i++) {
+		cache << lines[i] << "\n";
+	}
+
+	if(!cache) {
+		std::cerr << "Unable to write tune cache: " << cache_file << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static void addLaunch(std::vector<LaunchConfig> &space, const char *kernel, unsigned int tile_width, unsigned int tile_height,
+		unsigned int coarsen, unsigned int local_width, unsigned int local_height) {
+	LaunchConfig launch;
+	launch.kernel = kernel;
+	launch.tile_width = tile_width;
+	launch.tile_height = tile_height;
+	launch.coarsen = coarsen;
+	launch.local_width = local_width;
+	launch.local_height = local_height;
+	space.push_back(launch);
+}
+
+static std::vector<LaunchConfig> searchSpace(bool allow_float) {
+	static const unsigned int local_sizes[][2] = {
+		{0, 0}, {8, 8}, {16, 16}, {16, 4}, {32, 4}, {32, 8}, {64, 1}, {64, 4}, {128, 1}, {256, 1}
+	};
+	static const unsigned int tiles[][2] = {
+		{32, 8}, {32, 16}, {64, 4}, {64, 8}, {128, 2}, {128, 4}, {256, 1}, {256, 4}
+	};
+	static const unsigned int coarsening[] = {1, 2, 4, 8, 16};
+
+	std::vector<LaunchConfig> space;
+	for(size_t i = 0; i < sizeof(local_sizes) / sizeof(local_sizes[0]); i++) {
+		if(allow_float) {
+			addLaunch(space, "float", 32, 8, 4, local_sizes[i][0], local_sizes[i][1]);
+		}
+		addLaunch(space, "int", 32, 8, 4, local_sizes[i][0], local_sizes[i][1]);
+	}
+	for(size_t i = 0; i < sizeof(tiles) / sizeof(tiles[0]); i++) {
+		for(size_t j = 0; j < sizeof(coarsening) / sizeof(coarsening[0]); j++) {
+			if(tiles[i][0] % coarsening[j] == 0) {
+				addLaunch(space, "tiled", tiles[i][0], tiles[i][1], coarsening[j], 0, 0);
+			}
+		}
+	}
+	return space;
+}
+
+/*
+ * Generations per second of one launch, 0 if it does not run on the device
+ */
+static double measureLaunch(const ClEngine &prototype, const LaunchConfig &launch, const std::vector<unsigned char> &cells) {
+	typedef std::chrono::steady_clock clock;
+
+	if(!validLaunch(launch, prototype.device)) {
+		return 0.0;
+	}
+
+	ClEngine engine = prototype;
+	engine.launch = launch;
+	engine.generation = 0;
+	if(!initClEngine(engine)) {
+		return 0.0;
+	}
+	if(!createClEngineMemory(engine)) {
+		exitClEngine(engine);
+		return 0.0;
+	}
+	// The regular initial world, so every kernel sees realistic data
+	writeClEngineUniverse(engine, &cells[0]);
+
+	// Warm up, then double the batch until it runs long enough to time
+	double rate = 0.0;
+	if(enqueueGenerations(engine, 2) == CL_SUCCESS && clFinish(engine.queue) == CL_SUCCESS) {
+		for(unsigned int steps = 4; ; steps *= 2) {
+			clock::time_point start = clock::now();
+			if(enqueueGenerations(engine, steps) != CL_SUCCESS || clFinish(engine.queue) != CL_SUCCESS) {
+				break;
+			}
+			double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+			if(elapsed >= TUNE_SECONDS || steps >= (1u << 16)) {
+				rate = steps / elapsed;
+				break;
+			}
+		}
+	}
+
+	releaseClEngineMemory(engine);
+	exitClEngine(engine);
+
+	return rate;
+}
+
+bool autotuneLaunch(const ClEngine &prototype, bool allow_float, LaunchConfig &best) {
+	std::cout << "= Autotuning " << prototype.width << "x" << prototype.height << std::endl;
+
+	std::vector<unsigned char> cells((size_t) prototype.width * prototype.height);
+	for(size_t y = 0; y < prototype.height; y++) {
+		for(size_t x = 0; x < prototype.width; x++) {
+			cells[y * prototype.width + x] = ruleInitialState(prototype.seed, x, y);
+		}
+	}
+
+	std::vector<LaunchConfig> space = searchSpace(allow_float && !prototype.buffer_layout);
+	double best_rate = 0.0;
+	for(size_t i = 0; i < space.size(); i++) {
+		double rate = measureLaunch(prototype, space[i], cells);
+		if(rate > 0.0) {
+			std::cout << "=-- " << describeLaunch(space[i]) << "\t" << rate << " gen/s" << std::endl;
+		}
+		if(rate > best_rate) {
+			best_rate = rate;
+			best = space[i];
+		}
+	}
+
+	if(best_rate == 0.0) {
+		std::cerr << "Autotune: no launch configuration ran on the device" << std::endl;
+		return false;
+	}
+
+	std::cout << "=-- Best: " << describeLaunch(best) << "\t" << best_rate << " gen/s" << std::endl;
+	return true;
+}
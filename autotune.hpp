@@ -0,0 +1,21 @@
+#ifndef AUTOTUNE_HPP
+#define AUTOTUNE_HPP
+
+#include "cl_engine.hpp"
+
+/*
+ * Tuned launches are cached per device name, driver version and world size
+ */
+std::string tuneKey(cl_device_id device, unsigned int width, unsigned int height);
+
+bool loadTunedLaunch(const char *cache_file, const std::string &key, LaunchConfig &launch);
+bool storeTunedLaunch(const char *cache_file, const std::string &key, const LaunchConfig &launch);
+
+/*
+ * Benchmark the search space on scratch universes shaped like the prototype
+ * (context, device, queue, size, boundary, layout) and return the fastest launch.
+ * The float kernel is only tried when allow_float is set.
+ */
+bool autotuneLaunch(const ClEngine &prototype, bool allow_float, LaunchConfig &best);
+
+#endif //AUTOTUNE_HPP
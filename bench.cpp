@@ -0,0 +1,486 @@
+/*
+ * clrps_bench: headless throughput benchmark of the simulation backends.
+ * Runs every backend over a matrix of world sizes, initial densities and
+ * generations per sync, and prints median / p95 timings as JSON or CSV.
+ */
+#include "cl_engine.hpp"
+#include "cpu_engine.hpp"
+#include "config.hpp"
+#include "clrps_rules.h"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+/*
+ * The benchmark matrix and how each case is measured
+ */
+struct BenchConfig {
+	std::vector<unsigned int>	widths, heights;
+	std::vector<double>			densities;
+	std::vector<unsigned int>	syncs;				// generations enqueued between host syncs
+	std::vector<std::string>	backends;			// "cl" and / or "cpu"
+
+	unsigned int				generations;		// per repetition
+	unsigned int				warmup;				// untimed generations before the repetitions
+	unsigned int				repeats;
+
+	unsigned int				platform, device;
+	std::string					format;				// "json" or "csv"
+	std::string					output;				// empty for stdout
+
+	// Kernel launch, boundary, CPU threads and seed, shared with clrps
+	Config						world;
+};
+
+/*
+ * Timings of one case
+ */
+struct BenchResult {
+	std::string					backend, device, kernel;
+	unsigned int				width, height;
+	double						density;
+	unsigned int				sync;
+	double						median, p95;		// seconds per repetition
+};
+
+static std::vector<std::string> splitList(const std::string &value) {
+	std::vector<std::string> items;
+	std::stringstream stream(value);
+	std::string item;
+	while(getline(stream, item, ',')) {
+		if(!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+static bool parseUnsigned(const std::string &value, unsigned int &number) {
+	char *end;
+	unsigned long wide = strtoul(value.c_str(), &end, 0);
+	number = wide;
+	return !value.empty() && *end == '\0' && wide <= 0xffffffffUL;
+}
+
+static void defaultBenchConfig(BenchConfig &bench) {
+	bench.widths.push_back(256);	bench.heights.push_back(256);
+	bench.widths.push_back(1024);	bench.heights.push_back(1024);
+	bench.widths.push_back(4096);	bench.heights.push_back(4096);
+	bench.densities.push_back(0.25);
+	bench.densities.push_back(0.75);
+	bench.syncs.push_back(1);
+	bench.syncs.push_back(16);
+	bench.backends.push_back("cl");
+	bench.backends.push_back("cpu");
+
+	bench.generations	= 64;
+	bench.warmup		= 8;
+	bench.repeats		= 9;
+	bench.platform		= 0;
+	bench.device		= 0;
+	bench.format		= "json";
+
+	defaultConfig(bench.world);
+	bench.world.seed	= 1;
+}
+
+static bool setBenchOption(BenchConfig &bench, const std::string &key, const std::string &value) {
+	std::vector<std::string> items = splitList(value);
+
+	if(key == "sizes") {
+		bench.widths.clear();
+		bench.heights.clear();
+		for(size_t i = 0; i < items.size(); i++) {
+			Config size = bench.world;
+			if(!setOption(size, "size", items[i]) || !validGridSize(size)) {
+				return false;
+			}
+			bench.widths.push_back(size.width);
+			bench.heights.push_back(size.height);
+		}
+		return !items.empty();
+	} else if(key == "densities") {
+		bench.densities.clear();
+		for(size_t i = 0; i < items.size(); i++) {
+			char *end;
+			double density = strtod(items[i].c_str(), &end);
+			if(*end != '\0' || density < 0.0 || density > 1.0) {
+				std::cerr << "Invalid density: " << items[i] << std::endl;
+				return false;
+			}
+			bench.densities.push_back(density);
+		}
+		return !items.empty();
+	} else if(key == "syncs") {
+		bench.syncs.clear();
+		for(size_t i = 0; i < items.size(); i++) {
+			unsigned int sync;
+			if(!parseUnsigned(items[i], sync) || sync == 0) {
+				std::cerr << "Invalid steps per sync: " << items[i] << std::endl;
+				return false;
+			}
+			bench.syncs.push_back(sync);
+		}
+		return !items.empty();
+	} else if(key == "backends") {
+		for(size_t i = 0; i < items.size(); i++) {
+			if(items[i] != "cl" && items[i] != "cpu") {
+				std::cerr << "Unknown backend: " << items[i] << std::endl;
+				return false;
+			}
+		}
+		bench.backends = items;
+		return !items.empty();
+	} else if(key == "generations") {
+		return parseUnsigned(value, bench.generations) && bench.generations > 0;
+	} else if(key == "warmup") {
+		return parseUnsigned(value, bench.warmup);
+	} else if(key == "repeats") {
+		return parseUnsigned(value, bench.repeats) && bench.repeats > 0;
+	} else if(key == "platform") {
+		return parseUnsigned(value, bench.platform);
+	} else if(key == "device") {
+		return parseUnsigned(value, bench.device);
+	} else if(key == "format") {
+		bench.format = value;
+		return value == "json" || value == "csv";
+	} else if(key == "output") {
+		bench.output = value;
+		return true;
+	}
+
+	// kernel, tile, coarsen, local, boundary, threads, temporal, seed
+	return setOption(bench.world, key, value);
+}
+
+static bool parseBenchArguments(BenchConfig &bench, int argc, char **argv) {
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(arg.compare(0, 2, "--") != 0) {
+			std::cerr << "Unknown argument: " << arg << std::endl;
+			return false;
+		}
+		arg = arg.substr(2);
+
+		// --key=value or --key value
+		size_t split = arg.find('=');
+		std::string key = arg.substr(0, split), value;
+		if(split != std::string::npos) {
+			value = arg.substr(split + 1);
+		} else if(i + 1 < argc) {
+			value = argv[++i];
+		} else {
+			std::cerr << "Missing value for --" << key << std::endl;
+			return false;
+		}
+
+		if(!setBenchOption(bench, key, value)) {
+			return false;
+		}
+	}
+
+	return validConfig(bench.world);
+}
+
+static void printBenchUsage(const char *program) {
+	std::cerr << "Usage: " << program << " [options]" << std::endl
+		<< "  --sizes WxH,...        world sizes (256x256,1024x1024,4096x4096)" << std::endl
+		<< "  --densities D,...      initial fraction of living cells (0.25,0.75)" << std::endl
+		<< "  --syncs N,...          generations enqueued between host syncs (1,16)" << std::endl
+		<< "  --backends cl,cpu      backends to run" << std::endl
+		<< "  --generations N        generations per repetition (64)" << std::endl
+		<< "  --warmup N             untimed generations before the repetitions (8)" << std::endl
+		<< "  --repeats N            timed repetitions per case (9)" << std::endl
+		<< "  --platform N           OpenCL platform index (0)" << std::endl
+		<< "  --device N             OpenCL device index on the platform (0)" << std::endl
+		<< "  --format json|csv      output format (json)" << std::endl
+		<< "  --output FILE          write results to FILE instead of stdout" << std::endl
+		<< "  --kernel, --tile, --coarsen, --local, --boundary, --threads, --temporal, --seed" << std::endl
+		<< "                         as for clrps" << std::endl;
+}
+
+/*
+ * Initial world with the given density of living cells, species evenly spread.
+ * One Philox word per cell: its top part picks the species, the rest decides life.
+ */
+static void fillDensity(std::vector<unsigned char> &cells, unsigned int width, unsigned int height, unsigned long long seed, double density) {
+	const unsigned long long threshold = (unsigned long long) (density * 4294967296.0);
+	cells.resize((size_t) width * height);
+	for(size_t y = 0; y < height; y++) {
+		for(size_t x = 0; x < width; x++) {
+			unsigned long long scaled = (unsigned long long) rngCell(seed, RNG_INIT_GENERATION, x, y) * RULE_SPECIES;
+			unsigned int species = (unsigned int) (scaled >> 32) + 1;
+			cells[y * width + x] = (scaled & 0xffffffffULL) < threshold ? species * RULE_HEALTH + RULE_HEALTH - 1 : 0;
+		}
+	}
+}
+
+/*
+ * Median and 95th percentile (nearest rank) of the repetition times
+ */
+static void summarize(std::vector<double> times, BenchResult &result) {
+	std::sort(times.begin(), times.end());
+	const size_t count = times.size();
+	result.median = count % 2 ? times[count / 2] : (times[count / 2 - 1] + times[count / 2]) / 2.0;
+	result.p95 = times[(size_t) std::ceil(0.95 * count) - 1];
+}
+
+/*
+ * Windowless context on the selected platform and device, e.g. pocl on a CPU
+ */
+static bool initBenchCL(const BenchConfig &bench, ClEngine &engine) {
+	if(!openDevice(bench.platform, bench.device, engine.device, engine.context, &engine.queue, 1)) {
+		return false;
+	}
+
+	std::cerr << "=-- Benchmark device: " << deviceName(engine.device) << std::endl;
+	return true;
+}
+
+/*
+ * Every density and sync setting of one world size on the OpenCL engine
+ */
+static void benchCL(const BenchConfig &bench, ClEngine prototype, unsigned int width, unsigned int height, std::vector<BenchResult> &results) {
+	typedef std::chrono::steady_clock clock;
+
+	size_t image_width, image_height;
+	clGetDeviceInfo(prototype.device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(size_t), &image_width, NULL);
+	clGetDeviceInfo(prototype.device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(size_t), &image_height, NULL);
+
+	ClEngine engine = prototype;
+	engine.width = width;
+	engine.height = height;
+	engine.boundary = bench.world.boundary;
+	engine.buffer_layout = width > image_width || height > image_height;
+	engine.launch = bench.world.launch;
+	engine.seed = bench.world.seed;
+	engine.generation = 0;
+
+	if(engine.buffer_layout && engine.launch.kernel == "float") {
+		engine.launch.kernel = "int";
+	}
+	if(!validLaunch(engine.launch, engine.device) || !initClEngine(engine)) {
+		std::cerr << "Skipping cl " << width << "x" << height << ": " << describeLaunch(engine.launch) << " does not run" << std::endl;
+		return;
+	}
+	if(!createClEngineMemory(engine)) {
+		exitClEngine(engine);
+		return;
+	}
+
+	std::vector<unsigned char> cells;
+	for(size_t d = 0; d < bench.densities.size(); d++) {
+		fillDensity(cells, width, height, bench.world.seed, bench.densities[d]);
+
+		for(size_t s = 0; s < bench.syncs.size(); s++) {
+			const unsigned int sync = bench.syncs[s];
+
+			// Every case starts from the same world
+			engine.generation = 0;
+			if(writeClEngineUniverse(engine, &cells[0]) != CL_SUCCESS) {
+				break;
+			}
+
+			bool failed = enqueueGenerations(engine, bench.warmup) != CL_SUCCESS || clFinish(engine.queue) != CL_SUCCESS;
+			std::vector<double> times;
+			for(unsigned int r = 0; r < bench.repeats && !failed; r++) {
+				clock::time_point start = clock::now();
+				for(unsigned int done = 0; done < bench.generations && !failed; done += sync) {
+					unsigned int batch = std::min(sync, bench.generations - done);
+					failed = enqueueGenerations(engine, batch) != CL_SUCCESS || clFinish(engine.queue) != CL_SUCCESS;
+				}
+				times.push_back(std::chrono::duration<double>(clock::now() - start).count());
+			}
+			if(failed) {
+				std::cerr << "Kernel failed on cl " << width << "x" << height << std::endl;
+				continue;
+			}
+
+			BenchResult result;
+			result.backend = "cl";
+			result.device = deviceName(engine.device);
+			result.kernel = describeLaunch(engine.launch);
+			result.width = width;
+			result.height = height;
+			result.density = bench.densities[d];
+			result.sync = sync;
+			summarize(times, result);
+			results.push_back(result);
+			std::cerr << "=-- cl " << width << "x" << height << " density " << result.density << " sync " << sync
+					<< "\t" << bench.generations / result.median << " gen/s" << std::endl;
+		}
+	}
+
+	releaseClEngineMemory(engine);
+	exitClEngine(engine);
+}
+
+/*
+ * Every density and sync setting of one world size on the native engine.
+ * A sync is one stepCpuEngine call, which joins the worker threads.
+ */
+static void benchCpu(const BenchConfig &bench, unsigned int width, unsigned int height, std::vector<BenchResult> &results) {
+	typedef std::chrono::steady_clock clock;
+
+	CpuEngine engine;
+	initCpuEngine(engine, width, height, bench.world.threads, bench.world.seed, bench.world.boundary);
+	engine.temporal_steps = bench.world.temporal;
+
+	std::stringstream device;
+	device << "cpu, " << threadCount(engine.pool) << " threads";
+
+	std::vector<unsigned char> cells;
+	for(size_t d = 0; d < bench.densities.size(); d++) {
+		fillDensity(cells, width, height, bench.world.seed, bench.densities[d]);
+
+		for(size_t s = 0; s < bench.syncs.size(); s++) {
+			const unsigned int sync = bench.syncs[s];
+
+			engine.universe = cells;
+			engine.generation = 0;
+			stepCpuEngine(engine, bench.warmup);
+
+			std::vector<double> times;
+			for(unsigned int r = 0; r < bench.repeats; r++) {
+				clock::time_point start = clock::now();
+				for(unsigned int done = 0; done < bench.generations; done += sync) {
+					stepCpuEngine(engine, std::min(sync, bench.generations - done));
+				}
+				times.push_back(std::chrono::duration<double>(clock::now() - start).count());
+			}
+
+			BenchResult result;
+			result.backend = "cpu";
+			result.device = device.str();
+			result.kernel = "native";
+			result.width = width;
+			result.height = height;
+			result.density = bench.densities[d];
+			result.sync = sync;
+			summarize(times, result);
+			results.push_back(result);
+			std::cerr << "=-- cpu " << width << "x" << height << " density " << result.density << " sync " << sync
+					<< "\t" << bench.generations / result.median << " gen/s" << std::endl;
+		}
+	}
+
+	exitCpuEngine(engine);
+}
+
+static std::string jsonString(const std::string &str) {
+	std::string escaped = "\"";
+	for(size_t i = 0; i < str.size(); i++) {
+		if(str[i] == '"' || str[i] == '\\') {
+			escaped += '\\';
+		}
+		escaped += str[i];
+	}
+	return escaped + "\"";
+}
+
+static std::string csvString(const std::string &str) {
+	std::string escaped = "\"";
+	for(size_t i = 0; i < str.size(); i++) {
+		if(str[i] == '"') {
+			escaped += '"';
+		}
+		escaped += str[i];
+	}
+	return escaped + "\"";
+}
+
+/*
+ * Rates are derived from the median, the p95 rate from the p95 (slow) time
+ */
+static void writeResults(std::ostream &out, const BenchConfig &bench, const std::vector<BenchResult> &results) {
+	out.precision(6);
+	if(bench.format == "csv") {
+		out << "backend,device,kernel,width,height,density,sync,generations,repeats,"
+				"median_s,p95_s,median_gen_per_s,p95_gen_per_s,median_cell_updates_per_s" << std::endl;
+	} else {
+		out << "{" << std::endl
+			<< "  \"seed\": " << bench.world.seed << "," << std::endl
+			<< "  \"generations\": " << bench.generations << "," << std::endl
+			<< "  \"warmup\": " << bench.warmup << "," << std::endl
+			<< "  \"repeats\": " << bench.repeats << "," << std::endl
+			<< "  \"results\": [" << std::endl;
+	}
+
+	for(size_t i = 0; i < results.size(); i++) {
+		const BenchResult &result = results[i];
+		const double cells = (double) result.width * result.height;
+		if(bench.format == "csv") {
+			out << result.backend << "," << csvString(result.device) << "," << csvString(result.kernel) << ","
+				<< result.width << "," << result.height << "," << result.density << "," << result.sync << ","
+				<< bench.generations << "," << bench.repeats << "," << result.median << "," << result.p95 << ","
+				<< bench.generations / result.median << "," << bench.generations / result.p95 << ","
+				<< bench.generations * cells / result.median << std::endl;
+		} else {
+			out << "    {\"backend\": " << jsonString(result.backend) << ", \"device\": " << jsonString(result.device)
+				<< ", \"kernel\": " << jsonString(result.kernel) << ", \"width\": " << result.width
+				<< ", \"height\": " << result.height << ", \"density\": " << result.density << ", \"sync\": " << result.sync
+				<< ", \"median_s\": " << result.median << ", \"p95_s\": " << result.p95
+				<< ", \"median_gen_per_s\": " << bench.generations / result.median
+				<< ", \"p95_gen_per_s\": " << bench.generations / result.p95
+				<< ", \"median_cell_updates_per_s\": " << bench.generations * cells / result.median << "}"
+				<< (i + 1 < results.size() ? "," : "") << std::endl;
+		}
+	}
+
+	if(bench.format != "csv") {
+		out << "  ]" << std::endl << "}" << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+	BenchConfig bench;
+	defaultBenchConfig(bench);
+	if(!parseBenchArguments(bench, argc, argv)) {
+		printBenchUsage(argv[0]);
+		return 1;
+	}
+
+	const bool run_cl = std::find(bench.backends.begin(), bench.backends.end(), "cl") != bench.backends.end();
+	const bool run_cpu = std::find(bench.backends.begin(), bench.backends.end(), "cpu") != bench.backends.end();
+
+	// Progress goes to stderr so stdout only carries the results
+	ClEngine prototype = ClEngine();
+	if(run_cl && !initBenchCL(bench, prototype)) {
+		return 1;
+	}
+
+	std::vector<BenchResult> results;
+	for(size_t i = 0; i < bench.widths.size(); i++) {
+		if(run_cl) {
+			benchCL(bench, prototype, bench.widths[i], bench.heights[i], results);
+		}
+		if(run_cpu) {
+			benchCpu(bench, bench.widths[i], bench.heights[i], results);
+		}
+	}
+
+	if(run_cl) {
+		clReleaseCommandQueue(prototype.queue);
+		clReleaseContext(prototype.context);
+	}
+
+	if(bench.output.empty()) {
+		writeResults(std::cout, bench, results);
+	} else {
+		std::ofstream file(bench.output.c_str());
+		writeResults(file, bench, results);
+		if(!file) {
+			std::cerr << "Unable to write results: " << bench.output << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
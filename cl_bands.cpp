@@ -0,0 +1,365 @@
+#include "cl_bands.hpp"
+#include "clrps_rules.h"
+
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+
+// Generation in the file header while a pass is rewriting the cells
+#define BANDS_WRITING	(~(cl_ulong) 0)
+
+/*
+ * In-order queues each, so a band's commands only need to wait on the other queues
+ */
+static bool initBandsContext(ClBands &bands, unsigned int platform, unsigned int device) {
+	cl_command_queue queues[3];
+	if(!openDevice(platform, device, bands.device, bands.context, queues, 3)) {
+		return false;
+	}
+	bands.upload_queue = queues[0];
+	bands.compute_queue = queues[1];
+	bands.download_queue = queues[2];
+
+	std::cout << "=-- Band device: " << deviceName(bands.device) << std::endl;
+	return true;
+}
+
+/*
+ * Map the world file, creating it at generation BANDS_WRITING if it does not exist.
+ * Sets created when the starting world still has to be generated.
+ */
+static bool openWorldFile(ClBands &bands, const char *file_path, bool &created) {
+	created = !std::ifstream(file_path);
+	if(created) {
+		const size_t data_size = (size_t) bands.width * bands.height;
+		if(!createMappedFile(bands.file, file_path, sizeof(SnapshotHeader) + data_size)) {
+			std::cerr << "Unable to create world file: " << file_path << std::endl;
+			return false;
+		}
+		bands.header = (SnapshotHeader *) bands.file.data;
+		initSnapshotHeader(*bands.header, SNAPSHOT_RAW8, bands.width, bands.height, BANDS_WRITING, bands.seed, bands.boundary);
+		bands.cells = bands.file.data + sizeof(SnapshotHeader);
+		std::cout << "=-- World file: " << file_path << ", created" << std::endl;
+		return true;
+	}
+
+	if(!mapFile(bands.file, file_path, true)) {
+		std::cerr << "Unable to open world file: " << file_path << std::endl;
+		return false;
+	}
+	bands.header = (SnapshotHeader *) bands.file.data;
+	if(bands.file.size < sizeof(SnapshotHeader)
+			|| !validSnapshotHeader(*bands.header, file_path, SNAPSHOT_RAW8)
+			|| bands.file.size < sizeof(SnapshotHeader) + bands.header->data_size) {
+		std::cerr << "Not a world file: " << file_path << std::endl;
+		unmapFile(bands.file);
+		bands.header = NULL;
+		return false;
+	}
+	if(bands.header->generation == BANDS_WRITING) {
+		std::cerr << "World file was cut off inside a generation: " << file_path << std::endl;
+		unmapFile(bands.file);
+		bands.header = NULL;
+		return false;
+	}
+
+	bands.width = bands.header->width;
+	bands.height = bands.header->height;
+	bands.boundary = bands.header->boundary;
+	bands.seed = bands.header->seed;
+	bands.generation = bands.header->generation;
+	bands.cells = bands.file.data + sizeof(SnapshotHeader);
+	std::cout << "=-- World file: " << file_path << ", " << bands.width << "x" << bands.height
+			<< " at generation " << bands.generation << ", seed " << bands.seed << std::endl;
+	return true;
+}
+
+bool initClBands(ClBands &bands, unsigned int platform, unsigned int device, const char *file_path, size_t budget,
+		unsigned int width, unsigned int height, int boundary, cl_ulong seed, const InitParams &params) {
+	cl_int clError;
+
+	bands.context = NULL;
+	bands.upload_queue = bands.compute_queue = bands.download_queue = NULL;
+	bands.kernel = bands.init_kernel = NULL;
+	bands.header = NULL;
+	for(int i = 0; i < BAND_SLOTS; i++) {
+		ClBandSlot &slot = bands.slots[i];
+		slot.universe = slot.update = NULL;
+		slot.uploaded = slot.computed = slot.downloaded = NULL;
+		slot.row_offset = slot.rows = 0;
+	}
+
+	bands.width = width;
+	bands.height = height;
+	bands.boundary = boundary;
+	bands.seed = seed;
+	bands.generation = 0;
+
+	bool created;
+	if(!openWorldFile(bands, file_path, created) || !initBandsContext(bands, platform, device)) {
+		return false;
+	}
+
+	// Every slot holds a universe and an update band, both with two halo rows.
+	// The kernels index a band with ints.
+	const size_t row_bytes = bands.width;
+	cl_ulong max_alloc;
+	clGetDeviceInfo(bands.device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &max_alloc, NULL);
+	const size_t slot_rows = std::min<size_t>(budget / (2 * BAND_SLOTS * row_bytes), std::min<cl_ulong>(max_alloc, INT_MAX) / row_bytes);
+	if(slot_rows < 3) {
+		std::cerr << "Band budget too small for a world " << bands.width << " cells wide, it needs at least "
+				<< (6 * BAND_SLOTS * row_bytes + (1 << 20) - 1) / (1 << 20) << " MiB" << std::endl;
+		return false;
+	}
+	const size_t band_rows = std::min<size_t>(slot_rows - 2, bands.height);
+
+	// Even bands, so the last one does not run a nearly idle launch
+	bands.bands = (bands.height + band_rows - 1) / band_rows;
+	bands.band_rows = (bands.height + bands.bands - 1) / bands.bands;
+
+	std::stringstream build_options;
+	build_options << "-I . -D WIDTH=" << bands.width << " -D HEIGHT=" << bands.height << " -D BOUNDARY=" << bands.boundary
+			<< " -D BUFFER_LAYOUT -D INTEGER_STATE";
+
+	cl_program program = loadProgram(bands.context, bands.device, "clrps_kernel.cl", build_options.str().c_str());
+	if(!program) {
+		return false;
+	}
+	bands.kernel = clCreateKernel(program, "rps_slab", &clError);
+	if(!clError) {
+		bands.init_kernel = clCreateKernel(program, "rps_init_slab", &clError);
+	}
+	clReleaseProgram(program);
+	if(clError) {
+		std::cerr << "Unable to create band kernels: " << clError << std::endl;
+		return false;
+	}
+
+	const size_t padded = (size_t) (bands.band_rows + 2) * row_bytes;
+	for(int i = 0; i < BAND_SLOTS && !clError; i++) {
+		ClBandSlot &slot = bands.slots[i];
+		slot.universe = clCreateBuffer(bands.context, CL_MEM_READ_ONLY, padded, NULL, &clError);
+		if(!clError) {
+			slot.update = clCreateBuffer(bands.context, CL_MEM_READ_WRITE, padded, NULL, &clError);
+		}
+	}
+	if(clError) {
+		std::cerr << "Unable to allocate bands: " << clError << std::endl;
+		return false;
+	}
+
+	bands.top_edge.resize(row_bytes);
+	bands.bottom_edge.resize(row_bytes);
+
+	clSetKernelArg(bands.kernel, 2, sizeof(cl_ulong), &bands.seed);
+	clSetKernelArg(bands.init_kernel, 1, sizeof(InitParams), &params);
+	clSetKernelArg(bands.init_kernel, 2, sizeof(cl_ulong), &bands.seed);
+
+	std::cout << "=-- Bands: " << bands.bands << " of " << bands.band_rows << " rows, "
+			<< 2 * BAND_SLOTS * padded / (1 << 20) << " MiB of device memory" << std::endl;
+
+	if(created) {
+		std::cout << "=-- Generating the starting world" << std::endl;
+		clError = stepClBands(bands, 0);
+		if(clError) {
+			std::cerr << "Unable to generate the starting world: " << clError << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Wait for the band last in a slot to be written back and drop it from the mapping
+ */
+static void freeSlot(ClBands &bands, ClBandSlot &slot) {
+	if(slot.downloaded) {
+		clWaitForEvents(1, &slot.downloaded);
+		clReleaseEvent(slot.downloaded);
+		releaseMappedRange(bands.file, sizeof(SnapshotHeader) + (size_t) slot.row_offset * bands.width,
+				(size_t) slot.rows * bands.width);
+	}
+	if(slot.uploaded) {
+		clReleaseEvent(slot.uploaded);
+	}
+	if(slot.computed) {
+		clReleaseEvent(slot.computed);
+	}
+	slot.uploaded = slot.computed = slot.downloaded = NULL;
+}
+
+void exitClBands(ClBands &bands) {
+	for(int i = 0; i < BAND_SLOTS; i++) {
+		ClBandSlot &slot = bands.slots[i];
+		if(bands.header) {
+			freeSlot(bands, slot);
+		}
+		if(slot.universe) {
+			clReleaseMemObject(slot.universe);
+		}
+		if(slot.update) {
+			clReleaseMemObject(slot.update);
+		}
+	}
+	if(bands.kernel) {
+		clReleaseKernel(bands.kernel);
+	}
+	if(bands.init_kernel) {
+		clReleaseKernel(bands.init_kernel);
+	}
+	cl_command_queue queues[] = {bands.upload_queue, bands.compute_queue, bands.download_queue};
+	for(int i = 0; i < 3; i++) {
+		if(queues[i]) {
+			clReleaseCommandQueue(queues[i]);
+		}
+	}
+	if(bands.context) {
+		clReleaseContext(bands.context);
+	}
+	if(bands.header) {
+		unmapFile(bands.file);
+		bands.header = NULL;
+	}
+}
+
+/*
+ * Copy the halo row past a world edge: the wrapped or mirrored row, or an empty one
+ */
+static void copyEdgeRow(const ClBands &bands, int row, std::vector<unsigned char> &edge) {
+	const int source = boundaryCoord(row, bands.height, bands.boundary);
+	if(source < 0) {
+		std::fill(edge.begin(), edge.end(), 0);
+	} else {
+		memcpy(&edge[0], bands.cells + (size_t) source * bands.width, bands.width);
+	}
+}
+
+/*
+ * Enqueue the file rows of band and its halos into the slot's universe. Inner halos are
+ * the neighbouring bands' rows, still of this generation as their downloads wait for it.
+ */
+static cl_int uploadBand(ClBands &bands, ClBandSlot &slot) {
+	const size_t width = bands.width;
+	const bool first = slot.row_offset == 0;
+	const bool last = slot.row_offset + slot.rows == bands.height;
+	const unsigned char *rows = bands.cells + slot.row_offset * width;
+
+	if(!first && !last) {
+		return clEnqueueWriteBuffer(bands.upload_queue, slot.universe, CL_FALSE, 0, (slot.rows + 2) * width, rows - width,
+				0, NULL, &slot.uploaded);
+	}
+
+	const unsigned char *top = first ? &bands.top_edge[0] : rows - width;
+	const unsigned char *bottom = last ? &bands.bottom_edge[0] : rows + slot.rows * width;
+	cl_int error = clEnqueueWriteBuffer(bands.upload_queue, slot.universe, CL_FALSE, 0, width, top, 0, NULL, NULL);
+	if(!error) {
+		error = clEnqueueWriteBuffer(bands.upload_queue, slot.universe, CL_FALSE, width, slot.rows * width, rows, 0, NULL, NULL);
+	}
+	if(!error) {
+		// In order, the last write stands for the band
+		error = clEnqueueWriteBuffer(bands.upload_queue, slot.universe, CL_FALSE, (slot.rows + 1) * width, width, bottom,
+				0, NULL, &slot.uploaded);
+	}
+	return error;
+}
+
+static cl_int computeBand(ClBands &bands, ClBandSlot &slot, bool init) {
+	const size_t global_size[] = {bands.width, slot.rows};
+
+	if(init) {
+		clSetKernelArg(bands.init_kernel, 0, sizeof(cl_mem), &slot.update);
+		clSetKernelArg(bands.init_kernel, 3, sizeof(cl_uint), &slot.row_offset);
+		return clEnqueueNDRangeKernel(bands.compute_queue, bands.init_kernel, 2, NULL, global_size, NULL, 0, NULL, &slot.computed);
+	}
+
+	const cl_uint first_row = 1;
+	clSetKernelArg(bands.kernel, 0, sizeof(cl_mem), &slot.universe);
+	clSetKernelArg(bands.kernel, 1, sizeof(cl_mem), &slot.update);
+	clSetKernelArg(bands.kernel, 3, sizeof(cl_ulong), &bands.generation);
+	clSetKernelArg(bands.kernel, 4, sizeof(cl_uint), &slot.row_offset);
+	clSetKernelArg(bands.kernel, 5, sizeof(cl_uint), &first_row);
+	return clEnqueueNDRangeKernel(bands.compute_queue, bands.kernel, 2, NULL, global_size, NULL, 1, &slot.uploaded, &slot.computed);
+}
+
+/*
+ * Enqueue the write back of a computed band, after the next band has read its last row as a halo
+ */
+static cl_int downloadBand(ClBands &bands, ClBandSlot &slot, const ClBandSlot *next) {
+	cl_event wait[] = {slot.computed, next ? next->uploaded : NULL};
+	return clEnqueueReadBuffer(bands.download_queue, slot.update, CL_FALSE, bands.width, (size_t) slot.rows * bands.width,
+			bands.cells + (size_t) slot.row_offset * bands.width, next ? 2 : 1, wait, &slot.downloaded);
+}
+
+/*
+ * One pass through the file: in step i band i uploads, band i - 1 computes and band i - 2
+ * downloads. Without init the pass steps a generation, with it the starting world is built.
+ */
+static cl_int passBands(ClBands &bands, bool init) {
+	cl_int error = CL_SUCCESS;
+	const bool upload = !init;
+
+	bands.header->generation = BANDS_WRITING;
+	if(upload) {
+		copyEdgeRow(bands, -1, bands.top_edge);
+		copyEdgeRow(bands, bands.height, bands.bottom_edge);
+	}
+
+	for(unsigned int i = 0; i < bands.bands + 2 && !error; i++) {
+		if(i < bands.bands) {
+			// Wait for the slot's previous band to be back in the file
+			ClBandSlot &slot = bands.slots[i % BAND_SLOTS];
+			freeSlot(bands, slot);
+			slot.row_offset = i * bands.band_rows;
+			slot.rows = std::min(bands.band_rows, bands.height - slot.row_offset);
+			if(upload) {
+				error = uploadBand(bands, slot);
+			}
+		}
+		if(!error && i >= 1 && i - 1 < bands.bands) {
+			error = computeBand(bands, bands.slots[(i - 1) % BAND_SLOTS], init);
+		}
+		if(!error && i >= 2) {
+			const ClBandSlot *next = upload && i - 1 < bands.bands ? &bands.slots[(i - 1) % BAND_SLOTS] : NULL;
+			error = downloadBand(bands, bands.slots[(i - 2) % BAND_SLOTS], next);
+		}
+
+		clFlush(bands.upload_queue);
+		clFlush(bands.compute_queue);
+		clFlush(bands.download_queue);
+	}
+
+	// The edge rows of the next pass need the whole generation in the file
+	clFinish(bands.upload_queue);
+	clFinish(bands.compute_queue);
+	clFinish(bands.download_queue);
+	for(int i = 0; i < BAND_SLOTS; i++) {
+		freeSlot(bands, bands.slots[i]);
+	}
+	if(error) {
+		return error;
+	}
+
+	if(!init) {
+		bands.generation++;
+	}
+	bands.header->generation = bands.generation;
+	return CL_SUCCESS;
+}
+
+cl_int stepClBands(ClBands &bands, unsigned int generations) {
+	// No generations builds the starting world of a new file
+	if(generations == 0) {
+		return passBands(bands, true);
+	}
+
+	for(unsigned int g = 0; g < generations; g++) {
+		cl_int error = passBands(bands, false);
+		if(error) {
+			return error;
+		}
+	}
+	return CL_SUCCESS;
+}
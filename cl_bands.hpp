@@ -0,0 +1,74 @@
+#ifndef CL_BANDS_HPP
+#define CL_BANDS_HPP
+
+#define __NO_STD_VECTOR // Use cl::vector instead of STL version
+#include <CL/cl.h>
+
+#include <vector>
+
+#include "clrps_init.h"
+#include "snapshot.hpp"
+#include "utils.hpp"
+
+// Bands in flight: one uploading, one computing, one downloading
+#define BAND_SLOTS	3
+
+/*
+ * Device side of one band in flight, padded with a halo row above and below like a ClSlab
+ */
+struct ClBandSlot {
+	cl_mem				universe, update;
+	unsigned int		row_offset, rows;
+
+	// Last commands of the band on each queue, NULL once the slot is free
+	cl_event			uploaded, computed, downloaded;
+};
+
+/*
+ * Out-of-core world: the cells live in a memory mapped world file (a snapshot header
+ * and SNAPSHOT_RAW8 cells) and every generation streams them through the device in
+ * bands of rows. The next band uploads and the previous one downloads while the current
+ * one computes, on three queues. Device memory is BAND_SLOTS band pairs whatever the
+ * world size, the mapping keeps only the bands in flight resident.
+ */
+struct ClBands {
+	cl_context			context;
+	cl_device_id		device;
+	cl_command_queue	upload_queue, compute_queue, download_queue;
+	cl_kernel			kernel, init_kernel;
+
+	MappedFile			file;
+	SnapshotHeader		*header;
+	unsigned char		*cells;
+
+	unsigned int		width, height;
+	int					boundary;
+	unsigned int		band_rows, bands;
+
+	ClBandSlot			slots[BAND_SLOTS];
+
+	// Halo rows past the top and bottom edge, copied before a generation overwrites their source rows
+	std::vector<unsigned char>	top_edge, bottom_edge;
+
+	cl_ulong			seed, generation;
+};
+
+/*
+ * Continue the world in file_path, or create it from the parameter block when it
+ * does not exist yet. Size, boundary and seed of an existing file win over the
+ * arguments. Bands are sized so all slots fit in budget bytes of device memory.
+ */
+bool initClBands(ClBands &bands, unsigned int platform, unsigned int device, const char *file_path, size_t budget,
+		unsigned int width, unsigned int height, int boundary, cl_ulong seed, const InitParams &params);
+
+/*
+ * Wait for the commands in flight and leave the world in the file
+ */
+void exitClBands(ClBands &bands);
+
+/*
+ * Step the world, one pass through the file per generation
+ */
+cl_int stepClBands(ClBands &bands, unsigned int generations);
+
+#endif //CL_BANDS_HPP
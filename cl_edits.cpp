@@ -0,0 +1,248 @@
+#include "cl_edits.hpp"
+#include "clrps_rules.h"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Work-items per operation
+#define EDIT_GROUP_SIZE		64
+
+bool initClEdits(ClEdits &edits, const ClEngine &engine) {
+	edits.commands = NULL;
+	edits.capacity = 0;
+	edits.sprays = 0;
+	edits.applied = 0;
+	edits.upload_pending = false;
+
+	edits.kernel = createEngineKernel(engine, "rps_edit");
+	return edits.kernel != NULL;
+}
+
+void exitClEdits(ClEdits &edits) {
+	if(edits.upload_pending) {
+		clWaitForEvents(1, &edits.upload);
+		clReleaseEvent(edits.upload);
+	}
+	if(edits.commands) {
+		clReleaseMemObject(edits.commands);
+	}
+	clReleaseKernel(edits.kernel);
+
+	std::cout << "=-- Applied " << edits.applied << " edits" << std::endl;
+}
+
+static void addEdit(ClEdits &edits, cl_uint type, unsigned int state, int x0, int y0, int x1, int y1) {
+	EditOp op;
+	op.type = type;
+	op.state = state;
+	op.x0 = x0;
+	op.y0 = y0;
+	op.x1 = x1;
+	op.y1 = y1;
+	op.density = 0;
+	op.serial = 0;
+	edits.ops.push_back(op);
+}
+
+void editPoint(ClEdits &edits, int x, int y, unsigned int state) {
+	addEdit(edits, EDIT_POINT, state, x, y, x, y);
+}
+
+void editLine(ClEdits &edits, int x0, int y0, int x1, int y1, unsigned int state) {
+	addEdit(edits, EDIT_LINE, state, x0, y0, x1, y1);
+}
+
+void editRect(ClEdits &edits, int x0, int y0, int x1, int y1, unsigned int state) {
+	addEdit(edits, EDIT_RECT, state, x0, y0, x1, y1);
+}
+
+void editCircle(ClEdits &edits, int x, int y, int radius, unsigned int state) {
+	addEdit(edits, EDIT_CIRCLE, state, x, y, std::max(radius, 0), 0);
+}
+
+void editSpray(ClEdits &edits, int x, int y, int radius, double density, unsigned int state) {
+	addEdit(edits, EDIT_SPRAY, state, x, y, std::max(radius, 0), 0);
+	edits.ops.back().density = (cl_uint) (std::min(std::max(density, 0.0), 1.0) * 4294967295.0);
+	edits.ops.back().serial = edits.sprays++;
+}
+
+/*
+ * Empty, or species 1..RULE_SPECIES at any health
+ */
+static bool validEditState(unsigned int state) {
+	return state == 0 || (state >= RULE_HEALTH && state < RULE_STATES);
+}
+
+static int clampCoord(int coord, unsigned int size) {
+	return std::min(std::max(coord, 0), (int) size - 1);
+}
+
+bool loadEditScript(ClEdits &edits, const char *file_path, unsigned int width, unsigned int height) {
+	std::ifstream file(file_path);
+	if(!file) {
+		std::cerr << "Unable to open edit script: " << file_path << std::endl;
+		return false;
+	}
+
+	std::string line;
+	unsigned int line_number = 0;
+	const size_t first = edits.ops.size();
+	while(std::getline(file, line)) {
+		line_number++;
+		line = line.substr(0, line.find('#'));
+
+		std::stringstream stream(line);
+		std::string type;
+		if(!(stream >> type)) {
+			continue;
+		}
+
+		int x0, y0, x1 = 0, y1 = 0, radius = 0;
+		unsigned int state;
+		double density;
+		bool valid;
+		if(type == "point") {
+			valid = (bool) (stream >> x0 >> y0 >> state);
+		} else if(type == "line" || type == "rect") {
+			valid = (bool) (stream >> x0 >> y0 >> x1 >> y1 >> state);
+		} else if(type == "circle") {
+			valid = (bool) (stream >> x0 >> y0 >> radius >> state);
+		} else if(type == "spray") {
+			valid = (bool) (stream >> x0 >> y0 >> radius >> density >> state);
+		} else {
+			valid = false;
+		}
+
+		if(!valid) {
+			std::cerr << file_path << ":" << line_number << ": invalid edit: " << line << std::endl;
+			return false;
+		}
+		if(!validEditState(state)) {
+			std::cerr << file_path << ":" << line_number << ": invalid state " << state << ", expected 0 or species * "
+					<< RULE_HEALTH << " + health with species 1.." << RULE_SPECIES << std::endl;
+			return false;
+		}
+
+		// Keeps the kernel's int arithmetic in range: a radius of width + height
+		// covers the world from any cell
+		x0 = clampCoord(x0, width);
+		y0 = clampCoord(y0, height);
+		x1 = clampCoord(x1, width);
+		y1 = clampCoord(y1, height);
+		radius = std::min(std::max(radius, 0), (int) (width + height));
+
+		if(type == "point") {
+			editPoint(edits, x0, y0, state);
+		} else if(type == "line") {
+			editLine(edits, x0, y0, x1, y1, state);
+		} else if(type == "rect") {
+			editRect(edits, x0, y0, x1, y1, state);
+		} else if(type == "circle") {
+			editCircle(edits, x0, y0, radius, state);
+		} else {
+			editSpray(edits, x0, y0, radius, density, state);
+		}
+	}
+
+	std::cout << "=-- Edit script " << file_path << ": " << edits.ops.size() - first << " operations" << std::endl;
+	return true;
+}
+
+/*
+ * Cells an operation may touch, inclusive
+ */
+static void editBounds(const EditOp &op, int bounds[4]) {
+	if(op.type == EDIT_CIRCLE || op.type == EDIT_SPRAY) {
+		bounds[0] = op.x0 - op.x1;
+		bounds[1] = op.y0 - op.x1;
+		bounds[2] = op.x0 + op.x1;
+		bounds[3] = op.y0 + op.x1;
+	} else {
+		bounds[0] = std::min(op.x0, op.x1);
+		bounds[1] = std::min(op.y0, op.y1);
+		bounds[2] = std::max(op.x0, op.x1);
+		bounds[3] = std::max(op.y0, op.y1);
+	}
+}
+
+static cl_int enqueueEditRange(ClEdits &edits, ClEngine &engine, cl_uint first_op, size_t count) {
+	const size_t local_size = EDIT_GROUP_SIZE;
+	const size_t global_size = count * EDIT_GROUP_SIZE;
+	clSetKernelArg(edits.kernel, 2, sizeof(cl_uint), &first_op);
+	return clEnqueueNDRangeKernel(engine.queue, edits.kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
+}
+
+cl_int enqueueEdits(ClEdits &edits, ClEngine &engine) {
+	cl_int error;
+
+	if(edits.ops.empty()) {
+		return CL_SUCCESS;
+	}
+
+	// The previous batch is usually long written
+	if(edits.upload_pending) {
+		clWaitForEvents(1, &edits.upload);
+		clReleaseEvent(edits.upload);
+		edits.upload_pending = false;
+	}
+	edits.uploading.swap(edits.ops);
+	edits.ops.clear();
+	const std::vector<EditOp> &ops = edits.uploading;
+
+	if(ops.size() > edits.capacity) {
+		if(edits.commands) {
+			clReleaseMemObject(edits.commands);
+		}
+		edits.capacity = std::max<size_t>(256, edits.capacity);
+		while(edits.capacity < ops.size()) {
+			edits.capacity *= 2;
+		}
+		edits.commands = clCreateBuffer(engine.context, CL_MEM_READ_ONLY, edits.capacity * sizeof(EditOp), NULL, &error);
+		if(error) {
+			edits.commands = NULL;
+			edits.capacity = 0;
+			return error;
+		}
+		clSetKernelArg(edits.kernel, 1, sizeof(cl_mem), &edits.commands);
+	}
+
+	error = clEnqueueWriteBuffer(engine.queue, edits.commands, CL_FALSE, 0, ops.size() * sizeof(EditOp), &ops[0], 0, NULL, &edits.upload);
+	if(error) {
+		return error;
+	}
+	edits.upload_pending = true;
+
+	// The universe is written in place, the next generation reads it
+	clSetKernelArg(edits.kernel, 0, sizeof(cl_mem), &engine.universe);
+	clSetKernelArg(edits.kernel, 3, sizeof(cl_ulong), &engine.seed);
+
+	// One launch per run of operations that do not overlap with a different state
+	size_t first = 0;
+	for(size_t i = 1; i <= ops.size(); i++) {
+		bool split = i == ops.size();
+		int bounds[4];
+		if(!split) {
+			editBounds(ops[i], bounds);
+		}
+		for(size_t j = first; j < i && !split; j++) {
+			int other[4];
+			editBounds(ops[j], other);
+			split = ops[j].state != ops[i].state &&
+					bounds[0] <= other[2] && other[0] <= bounds[2] && bounds[1] <= other[3] && other[1] <= bounds[3];
+		}
+		if(split) {
+			error = enqueueEditRange(edits, engine, first, i - first);
+			if(error) {
+				return error;
+			}
+			first = i;
+		}
+	}
+
+	edits.applied += ops.size();
+	markClEngineChanged(engine);
+	return CL_SUCCESS;
+}
@@ -0,0 +1,55 @@
+#ifndef CL_EDITS_HPP
+#define CL_EDITS_HPP
+
+#include <vector>
+
+#include "cl_engine.hpp"
+#include "clrps_edit.h"
+
+/*
+ * Paint operations collected on the host and applied to the universe in one
+ * batch per frame by the rps_edit kernel, on the simulation queue before the
+ * next generation, without a sync of their own.
+ */
+struct ClEdits {
+	cl_kernel				kernel;
+	cl_mem					commands;
+	size_t					capacity;
+
+	std::vector<EditOp>		ops;
+	// Batch being uploaded, kept until its write completed
+	std::vector<EditOp>		uploading;
+	cl_event				upload;
+	bool					upload_pending;
+
+	cl_uint					sprays;
+	unsigned long long		applied;
+};
+
+bool initClEdits(ClEdits &edits, const ClEngine &engine);
+void exitClEdits(ClEdits &edits);
+
+/*
+ * Queue operations, coordinates in cells, nothing touches the device yet
+ */
+void editPoint(ClEdits &edits, int x, int y, unsigned int state);
+void editLine(ClEdits &edits, int x0, int y0, int x1, int y1, unsigned int state);
+void editRect(ClEdits &edits, int x0, int y0, int x1, int y1, unsigned int state);
+void editCircle(ClEdits &edits, int x, int y, int radius, unsigned int state);
+void editSpray(ClEdits &edits, int x, int y, int radius, double density, unsigned int state);
+
+/*
+ * Queue the operations of a script, one per line:
+ * point X Y STATE, line X0 Y0 X1 Y1 STATE, rect X0 Y0 X1 Y1 STATE,
+ * circle X Y R STATE, spray X Y R DENSITY STATE. # starts a comment.
+ * STATE is 0 or a valid cell state, coordinates are clamped to the width x height world.
+ */
+bool loadEditScript(ClEdits &edits, const char *file_path, unsigned int width, unsigned int height);
+
+/*
+ * Enqueue the upload and the edit kernels for all queued operations.
+ * The universe must be acquired if it is GL shared.
+ */
+cl_int enqueueEdits(ClEdits &edits, ClEngine &engine);
+
+#endif //CL_EDITS_HPP
@@ -0,0 +1,298 @@
+#include "cl_engine.hpp"
+#include "utils.hpp"
+#include "profiler.hpp"
+
+#include <iostream>
+#include <sstream>
+
+bool integerState(const LaunchConfig &launch, bool buffer_layout) {
+	return buffer_layout || launch.kernel != "float";
+}
+
+bool validLaunch(const LaunchConfig &launch, cl_device_id device) {
+	size_t max_group_size;
+	cl_ulong local_memory;
+	clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &max_group_size, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_memory, NULL);
+
+	if(launch.kernel == "tiled" || launch.kernel == "active") {
+		return launch.tile_width % launch.coarsen == 0 &&
+				launch.tile_width / launch.coarsen * launch.tile_height <= max_group_size &&
+				(launch.tile_width + 2) * (launch.tile_height + 2) <= local_memory;
+	}
+	return launch.local_width * launch.local_height <= max_group_size;
+}
+
+std::string describeLaunch(const LaunchConfig &launch) {
+	std::stringstream description;
+	description << launch.kernel;
+	if(launch.kernel == "tiled" || launch.kernel == "active") {
+		description << " tile " << launch.tile_width << "x" << launch.tile_height << " coarsen " << launch.coarsen;
+	} else if(launch.local_width && launch.local_height) {
+		description << " local " << launch.local_width << "x" << launch.local_height;
+	}
+	return description.str();
+}
+
+/*
+ * Tile flags and the compacted tile list of the active kernel, every tile starts live
+ */
+static bool initActiveTiles(ClEngine &engine) {
+	cl_int clError;
+
+	engine.compact_kernel = createEngineKernel(engine, "rps_compact");
+	if(!engine.compact_kernel) {
+		return false;
+	}
+
+	engine.live[0] = clCreateBuffer(engine.context, CL_MEM_READ_WRITE, engine.tiles, NULL, &clError);
+	engine.live[1] = clCreateBuffer(engine.context, CL_MEM_READ_WRITE, engine.tiles, NULL, &clError);
+	engine.tile_list = clCreateBuffer(engine.context, CL_MEM_READ_WRITE, engine.tiles * sizeof(cl_uint), NULL, &clError);
+	engine.tile_count = clCreateBuffer(engine.context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &clError);
+	if(!engine.live[0] || !engine.live[1] || !engine.tile_list || !engine.tile_count) {
+		std::cerr << "Unable to allocate tile lists: " << clError << std::endl;
+		return false;
+	}
+	engine.live_index = 0;
+
+	clSetKernelArg(engine.compact_kernel, 1, sizeof(cl_mem), &engine.tile_list);
+	clSetKernelArg(engine.compact_kernel, 2, sizeof(cl_mem), &engine.tile_count);
+	clSetKernelArg(engine.kernel, 5, sizeof(cl_mem), &engine.tile_list);
+	clSetKernelArg(engine.kernel, 6, sizeof(cl_mem), &engine.tile_count);
+
+	markClEngineChanged(engine);
+	return true;
+}
+
+/*
+ * List the tiles to run this generation, swap the live flags
+ */
+static cl_int enqueueCompaction(ClEngine &engine) {
+	const cl_uint zero = 0;
+	cl_mem live = engine.live[engine.live_index];
+	cl_mem live_next = engine.live[1 - engine.live_index];
+
+	cl_int error = clEnqueueFillBuffer(engine.queue, engine.tile_count, &zero, sizeof(zero), 0, sizeof(zero), 0, NULL, NULL);
+	if(error) {
+		return error;
+	}
+
+	clSetKernelArg(engine.compact_kernel, 0, sizeof(cl_mem), &live);
+	clSetKernelArg(engine.compact_kernel, 3, sizeof(cl_mem), &live_next);
+	error = clEnqueueNDRangeKernel(engine.queue, engine.compact_kernel, 1, NULL, &engine.tiles, NULL, 0, NULL, NULL);
+
+	clSetKernelArg(engine.kernel, 7, sizeof(cl_mem), &live_next);
+	engine.live_index = 1 - engine.live_index;
+	return error;
+}
+
+bool initClEngine(ClEngine &engine) {
+	cl_int clError;
+	const LaunchConfig &launch = engine.launch;
+
+	std::stringstream build_options;
+	std::string kernel_name = integerState(launch, engine.buffer_layout) ? "rps_int" : "rps";
+	build_options << "-I . -D WIDTH=" << engine.width << " -D HEIGHT=" << engine.height << " -D BOUNDARY=" << engine.boundary;
+	if(engine.buffer_layout) {
+		build_options << " -D BUFFER_LAYOUT";
+	}
+	if(integerState(launch, engine.buffer_layout)) {
+		build_options << " -D INTEGER_STATE";
+	}
+
+	engine.global_size[0] = engine.width;
+	engine.global_size[1] = engine.height;
+	engine.fixed_local_size = false;
+	engine.compact_kernel = NULL;
+	const size_t tiles_x = (engine.width + launch.tile_width - 1) / launch.tile_width;
+	const size_t tiles_y = (engine.height + launch.tile_height - 1) / launch.tile_height;
+	if(launch.kernel == "tiled") {
+		kernel_name = "rps_tiled";
+		build_options << " -D TILE_W=" << launch.tile_width << " -D TILE_H=" << launch.tile_height << " -D COARSEN=" << launch.coarsen;
+
+		// One work-group per tile, COARSEN cells per work-item
+		engine.local_size[0] = launch.tile_width / launch.coarsen;
+		engine.local_size[1] = launch.tile_height;
+		engine.global_size[0] = tiles_x * engine.local_size[0];
+		engine.global_size[1] = tiles_y * engine.local_size[1];
+		engine.fixed_local_size = true;
+	} else if(launch.kernel == "active") {
+		kernel_name = "rps_active";
+		build_options << " -D TILE_W=" << launch.tile_width << " -D TILE_H=" << launch.tile_height << " -D COARSEN=" << launch.coarsen;
+
+		// Room for a work-group per tile in a row, the ones past the active count return
+		engine.tiles = tiles_x * tiles_y;
+		engine.local_size[0] = launch.tile_width / launch.coarsen;
+		engine.local_size[1] = launch.tile_height;
+		engine.global_size[0] = engine.tiles * engine.local_size[0];
+		engine.global_size[1] = engine.local_size[1];
+		engine.fixed_local_size = true;
+	} else if(launch.local_width && launch.local_height) {
+		// Round up to whole work-groups, the kernel skips cells outside the world
+		engine.local_size[0] = launch.local_width;
+		engine.local_size[1] = launch.local_height;
+		engine.global_size[0] = (engine.width + launch.local_width - 1) / launch.local_width * launch.local_width;
+		engine.global_size[1] = (engine.height + launch.local_height - 1) / launch.local_height * launch.local_height;
+		engine.fixed_local_size = true;
+	}
+
+	if(!validLaunch(launch, engine.device)) {
+		std::cerr << "Launch " << describeLaunch(launch) << " exceeds the device limits" << std::endl;
+		return false;
+	}
+
+	engine.build_options = build_options.str();
+	engine.program = loadProgram(engine.context, engine.device, "clrps_kernel.cl", engine.build_options.c_str());
+	if(!engine.program) {
+		return false;
+	}
+	engine.kernel = createEngineKernel(engine, kernel_name.c_str());
+	engine.init_kernel = engine.kernel ? createEngineKernel(engine, "rps_init") : NULL;
+	if(!engine.init_kernel) {
+		if(engine.kernel) {
+			clReleaseKernel(engine.kernel);
+		}
+		clReleaseProgram(engine.program);
+		return false;
+	}
+
+	// Sampler for kernel, implements the boundary of the float variant. Read at texel
+	// centres, mirrored repeat takes the cell past the edge to the edge cell itself,
+	// as boundaryCoord() does for the other engines.
+	const cl_addressing_mode addressing[] = {CL_ADDRESS_REPEAT, CL_ADDRESS_MIRRORED_REPEAT, CL_ADDRESS_CLAMP};
+	engine.sampler = clCreateSampler(engine.context, CL_TRUE, addressing[engine.boundary], CL_FILTER_NEAREST, &clError);
+
+	// Universe arguments change every generation, the rest stay
+	clSetKernelArg(engine.kernel, 2, sizeof(cl_sampler), &engine.sampler);
+	clSetKernelArg(engine.kernel, 3, sizeof(cl_ulong), &engine.seed);
+
+	if(launch.kernel == "active" && !initActiveTiles(engine)) {
+		exitClEngine(engine);
+		return false;
+	}
+
+	return true;
+}
+
+void exitClEngine(ClEngine &engine) {
+	if(engine.compact_kernel) {
+		clReleaseKernel(engine.compact_kernel);
+		clReleaseMemObject(engine.live[0]);
+		clReleaseMemObject(engine.live[1]);
+		clReleaseMemObject(engine.tile_list);
+		clReleaseMemObject(engine.tile_count);
+		engine.compact_kernel = NULL;
+	}
+	clReleaseSampler(engine.sampler);
+	clReleaseKernel(engine.init_kernel);
+	clReleaseKernel(engine.kernel);
+	clReleaseProgram(engine.program);
+}
+
+cl_kernel createEngineKernel(const ClEngine &engine, const char *kernel_name) {
+	cl_int clError;
+	cl_kernel kernel = clCreateKernel(engine.program, kernel_name, &clError);
+	if(clError) {
+		std::cerr << "Unable to create kernel " << kernel_name << ": " << clError << std::endl;
+		return NULL;
+	}
+	return kernel;
+}
+
+void markClEngineChanged(ClEngine &engine) {
+	if(engine.compact_kernel) {
+		const cl_uchar live = 1;
+		clEnqueueFillBuffer(engine.queue, engine.live[engine.live_index], &live, sizeof(live), 0, engine.tiles, 0, NULL, NULL);
+	}
+}
+
+bool createClEngineMemory(ClEngine &engine) {
+	cl_int clError;
+
+	// Devices sharing host memory can then map the universe without a copy
+	cl_bool unified_memory = CL_FALSE;
+	clGetDeviceInfo(engine.device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &unified_memory, NULL);
+	const cl_mem_flags flags = CL_MEM_READ_WRITE | (unified_memory ? CL_MEM_ALLOC_HOST_PTR : 0);
+
+	if(engine.buffer_layout) {
+		const size_t cells = (size_t) engine.width * engine.height;
+		engine.universe = clCreateBuffer(engine.context, flags, cells, NULL, &clError);
+		if(!clError) {
+			engine.update = clCreateBuffer(engine.context, flags, cells, NULL, &clError);
+		}
+	} else {
+		cl_image_format format;
+		format.image_channel_order = CL_R;
+		format.image_channel_data_type = integerState(engine.launch, false) ? CL_UNSIGNED_INT8 : CL_UNORM_INT8;
+
+		cl_image_desc desc = cl_image_desc();
+		desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+		desc.image_width = engine.width;
+		desc.image_height = engine.height;
+
+		engine.universe = clCreateImage(engine.context, flags, &format, &desc, NULL, &clError);
+		if(!clError) {
+			engine.update = clCreateImage(engine.context, flags, &format, &desc, NULL, &clError);
+		}
+	}
+
+	if(clError) {
+		std::cerr << "Unable to allocate universe: " << clError << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void releaseClEngineMemory(ClEngine &engine) {
+	clReleaseMemObject(engine.universe);
+	clReleaseMemObject(engine.update);
+}
+
+cl_int writeClEngineUniverse(ClEngine &engine, const unsigned char *cells) {
+	markClEngineChanged(engine);
+	if(engine.buffer_layout) {
+		return clEnqueueWriteBuffer(engine.queue, engine.universe, CL_TRUE, 0, (size_t) engine.width * engine.height, cells, 0, NULL, NULL);
+	}
+	const size_t origin[] = {0, 0, 0};
+	const size_t region[] = {engine.width, engine.height, 1};
+	return clEnqueueWriteImage(engine.queue, engine.universe, CL_TRUE, origin, region, 0, 0, cells, 0, NULL, NULL);
+}
+
+cl_int enqueueInitPattern(ClEngine &engine, const InitParams &params) {
+	markClEngineChanged(engine);
+
+	const size_t global_size[] = {engine.width, engine.height};
+	clSetKernelArg(engine.init_kernel, 0, sizeof(cl_mem), &engine.universe);
+	clSetKernelArg(engine.init_kernel, 1, sizeof(InitParams), &params);
+	clSetKernelArg(engine.init_kernel, 2, sizeof(cl_ulong), &engine.seed);
+	return clEnqueueNDRangeKernel(engine.queue, engine.init_kernel, 2, NULL, global_size, NULL, 0, NULL, NULL);
+}
+
+cl_int enqueueGenerations(ClEngine &engine, unsigned int steps) {
+	for(unsigned int i = 0; i < steps; i++) {
+		clSetKernelArg(engine.kernel, 0, sizeof(cl_mem), &engine.universe);
+		clSetKernelArg(engine.kernel, 1, sizeof(cl_mem), &engine.update);
+		clSetKernelArg(engine.kernel, 4, sizeof(cl_ulong), &engine.generation);
+
+		if(engine.compact_kernel) {
+			cl_int error = enqueueCompaction(engine);
+			if(error) {
+				return error;
+			}
+		}
+
+		cl_int error = clEnqueueNDRangeKernel(engine.queue, engine.kernel, 2, NULL, engine.global_size,
+				engine.fixed_local_size ? engine.local_size : NULL, 0, NULL, profileEvent(engine.profiler, PHASE_KERNEL));
+		if(error) {
+			return error;
+		}
+
+		cl_mem temp_mem = engine.universe;
+		engine.universe = engine.update;
+		engine.update = temp_mem;
+
+		engine.generation++;
+	}
+
+	return CL_SUCCESS;
+}
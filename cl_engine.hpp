@@ -0,0 +1,105 @@
+#ifndef CL_ENGINE_HPP
+#define CL_ENGINE_HPP
+
+#define __NO_STD_VECTOR // Use cl::vector instead of STL version
+#include <CL/cl.h>
+
+#include <string>
+
+#include "config.hpp"
+#include "clrps_init.h"
+
+struct Profiler;
+
+/*
+ * OpenCL rps engine: the kernel, the universe pair and the launch geometry.
+ * Context, device and queue are borrowed, the memory objects may be GL shared.
+ */
+struct ClEngine {
+	cl_context			context;
+	cl_device_id		device;
+	cl_command_queue	queue;
+
+	unsigned int		width, height;
+	int					boundary;
+	bool				buffer_layout;
+	LaunchConfig		launch;
+	std::string			build_options;
+
+	// Built once for the universe layout, the other modules create their kernels from it
+	cl_program			program;
+	cl_kernel			kernel;
+	cl_sampler			sampler;
+
+	// Builds starting worlds, see clrps_init.h
+	cl_kernel			init_kernel;
+	cl_mem				universe, update;
+
+	size_t				global_size[2];
+	size_t				local_size[2];
+	bool				fixed_local_size;
+
+	// Active kernel only: live flags of this and the next generation, the compacted tile list
+	cl_kernel			compact_kernel;
+	cl_mem				live[2], tile_list, tile_count;
+	size_t				tiles;
+	unsigned int		live_index;
+
+	cl_ulong			seed;
+	cl_ulong			generation;
+
+	// Times every generation when set, the queue needs CL_QUEUE_PROFILING_ENABLE
+	Profiler			*profiler;
+};
+
+/*
+ * Integer kernels work on CL_UNSIGNED_INT8 data, the float kernel on normalized bytes
+ */
+bool integerState(const LaunchConfig &launch, bool buffer_layout);
+
+/*
+ * Check the launch against the device limits
+ */
+bool validLaunch(const LaunchConfig &launch, cl_device_id device);
+
+std::string describeLaunch(const LaunchConfig &launch);
+
+/*
+ * Build the kernel for engine.launch and set the arguments that never change.
+ * universe and update must be set before stepping.
+ */
+bool initClEngine(ClEngine &engine);
+void exitClEngine(ClEngine &engine);
+
+/*
+ * Create a kernel of the engine's program, so the universe layout matches
+ */
+cl_kernel createEngineKernel(const ClEngine &engine, const char *kernel_name);
+
+/*
+ * Allocate a CL only universe pair matching the engine's layout
+ */
+bool createClEngineMemory(ClEngine &engine);
+void releaseClEngineMemory(ClEngine &engine);
+
+/*
+ * Make the active kernel run every tile after the universe was written from the host
+ */
+void markClEngineChanged(ClEngine &engine);
+
+/*
+ * Blocking upload of a whole width * height world into the universe
+ */
+cl_int writeClEngineUniverse(ClEngine &engine, const unsigned char *cells);
+
+/*
+ * Enqueue the generation of a starting world into the universe, only the parameters are sent
+ */
+cl_int enqueueInitPattern(ClEngine &engine, const InitParams &params);
+
+/*
+ * Enqueue generations back to back, swapping universe and update after each
+ */
+cl_int enqueueGenerations(ClEngine &engine, unsigned int steps);
+
+#endif //CL_ENGINE_HPP
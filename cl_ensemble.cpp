@@ -0,0 +1,202 @@
+#include "cl_ensemble.hpp"
+#include "cl_stats.hpp"
+#include "clrps_rules.h"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+bool initClEnsemble(ClEnsemble &ensemble, unsigned int platform, unsigned int device,
+		unsigned int width, unsigned int height, unsigned int worlds, int boundary, cl_ulong seed) {
+	cl_int clError;
+
+	ensemble.width = width;
+	ensemble.height = height;
+	ensemble.worlds = worlds;
+	ensemble.boundary = boundary;
+	ensemble.seed = seed;
+	ensemble.generation = 0;
+	ensemble.counts_pending = false;
+
+	if(!openDevice(platform, device, ensemble.device, ensemble.context, &ensemble.queue, 1)) {
+		return false;
+	}
+	std::cout << "=-- Ensemble device: " << deviceName(ensemble.device) << std::endl;
+
+	// All worlds live in one allocation each for universe and update
+	const size_t cells = (size_t) width * height * worlds;
+	cl_ulong max_alloc;
+	clGetDeviceInfo(ensemble.device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &max_alloc, NULL);
+	if(cells > max_alloc) {
+		std::cerr << "Ensemble of " << worlds << " worlds needs " << cells << " bytes, the device allocates at most " << max_alloc << std::endl;
+		return false;
+	}
+
+	std::stringstream build_options;
+	build_options << "-I . -D WIDTH=" << width << " -D HEIGHT=" << height << " -D BOUNDARY=" << boundary;
+
+	cl_program program = loadProgram(ensemble.context, ensemble.device, "clrps_kernel.cl", build_options.str().c_str());
+	if(!program) {
+		return false;
+	}
+	ensemble.kernel = clCreateKernel(program, "rps_ensemble", &clError);
+	if(!clError) {
+		ensemble.stats_kernel = clCreateKernel(program, "rps_ensemble_stats", &clError);
+	}
+	clReleaseProgram(program);
+	if(clError) {
+		std::cerr << "Unable to create ensemble kernels: " << clError << std::endl;
+		return false;
+	}
+
+	std::vector<cl_ulong> seeds(worlds);
+	for(unsigned int i = 0; i < worlds; i++) {
+		seeds[i] = seed + i;
+	}
+
+	ensemble.universe = clCreateBuffer(ensemble.context, CL_MEM_READ_WRITE, cells, NULL, &clError);
+	if(!clError) {
+		ensemble.update = clCreateBuffer(ensemble.context, CL_MEM_READ_WRITE, cells, NULL, &clError);
+	}
+	if(!clError) {
+		ensemble.seeds = clCreateBuffer(ensemble.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, worlds * sizeof(cl_ulong), &seeds[0], &clError);
+	}
+	if(!clError) {
+		ensemble.counts = clCreateBuffer(ensemble.context, CL_MEM_READ_WRITE, (size_t) worlds * STATS_BINS * sizeof(cl_uint), NULL, &clError);
+	}
+	if(clError) {
+		std::cerr << "Unable to allocate ensemble: " << clError << std::endl;
+		return false;
+	}
+	ensemble.readback.resize((size_t) worlds * STATS_BINS);
+
+	// 2D tiles of every world, the third dimension picks the world
+	size_t kernel_group_size;
+	clGetKernelWorkGroupInfo(ensemble.kernel, ensemble.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernel_group_size, NULL);
+	ensemble.local_size[0] = std::min<size_t>(16, kernel_group_size);
+	ensemble.local_size[1] = std::max<size_t>(1, std::min<size_t>(16, kernel_group_size / ensemble.local_size[0]));
+	ensemble.local_size[2] = 1;
+	ensemble.global_size[0] = (width + ensemble.local_size[0] - 1) / ensemble.local_size[0] * ensemble.local_size[0];
+	ensemble.global_size[1] = (height + ensemble.local_size[1] - 1) / ensemble.local_size[1] * ensemble.local_size[1];
+	ensemble.global_size[2] = worlds;
+
+	clGetKernelWorkGroupInfo(ensemble.stats_kernel, ensemble.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernel_group_size, NULL);
+	ensemble.stats_local_size = std::min<size_t>(256, kernel_group_size);
+
+	clSetKernelArg(ensemble.kernel, 2, sizeof(cl_mem), &ensemble.seeds);
+	clSetKernelArg(ensemble.stats_kernel, 1, sizeof(cl_mem), &ensemble.counts);
+
+	std::cout << "=-- Ensemble: " << worlds << " worlds of " << width << "x" << height
+			<< ", seeds " << seed << ".." << seed + worlds - 1 << std::endl;
+	return true;
+}
+
+/*
+ * Write out the sample in flight
+ */
+static void logEnsembleSample(ClEnsemble &ensemble) {
+	clWaitForEvents(1, &ensemble.counts_read);
+	clReleaseEvent(ensemble.counts_read);
+	ensemble.counts_pending = false;
+
+	for(unsigned int world = 0; world < ensemble.worlds; world++) {
+		ensemble.log << ensemble.counts_generation << "," << world;
+		for(int i = 0; i < STATS_BINS; i++) {
+			ensemble.log << "," << ensemble.readback[(size_t) world * STATS_BINS + i];
+		}
+		ensemble.log << "\n";
+	}
+}
+
+void exitClEnsemble(ClEnsemble &ensemble) {
+	if(ensemble.counts_pending) {
+		logEnsembleSample(ensemble);
+	}
+	if(ensemble.log.is_open()) {
+		ensemble.log.close();
+	}
+
+	clReleaseMemObject(ensemble.universe);
+	clReleaseMemObject(ensemble.update);
+	clReleaseMemObject(ensemble.seeds);
+	clReleaseMemObject(ensemble.counts);
+	clReleaseKernel(ensemble.kernel);
+	clReleaseKernel(ensemble.stats_kernel);
+	clReleaseCommandQueue(ensemble.queue);
+	clReleaseContext(ensemble.context);
+}
+
+bool randomizeClEnsemble(ClEnsemble &ensemble) {
+	const size_t world_cells = (size_t) ensemble.width * ensemble.height;
+	std::vector<unsigned char> cells(world_cells);
+
+	// One world at a time, the whole ensemble may not fit on the host twice
+	for(unsigned int world = 0; world < ensemble.worlds; world++) {
+		for(size_t y = 0; y < ensemble.height; y++) {
+			for(size_t x = 0; x < ensemble.width; x++) {
+				cells[y * ensemble.width + x] = ruleInitialState(ensemble.seed + world, x, y);
+			}
+		}
+		if(clEnqueueWriteBuffer(ensemble.queue, ensemble.universe, CL_TRUE, world * world_cells, world_cells, &cells[0], 0, NULL, NULL)) {
+			return false;
+		}
+	}
+	ensemble.generation = 0;
+	return true;
+}
+
+bool openClEnsembleStats(ClEnsemble &ensemble, const char *log_file) {
+	ensemble.log.open(log_file);
+	if(!ensemble.log) {
+		std::cerr << "Unable to open stats log: " << log_file << std::endl;
+		return false;
+	}
+	ensemble.log << "generation,world," << statsColumns() << "\n";
+
+	std::cout << "=-- Population stats: " << log_file << ", one work-group of " << ensemble.stats_local_size << " per world" << std::endl;
+	return true;
+}
+
+cl_int sampleClEnsembleStats(ClEnsemble &ensemble) {
+	cl_int error;
+
+	// A single readback buffer, the previous sample has to be out of it first
+	if(ensemble.counts_pending) {
+		logEnsembleSample(ensemble);
+	}
+
+	const size_t global_size = ensemble.worlds * ensemble.stats_local_size;
+	clSetKernelArg(ensemble.stats_kernel, 0, sizeof(cl_mem), &ensemble.universe);
+	error = clEnqueueNDRangeKernel(ensemble.queue, ensemble.stats_kernel, 1, NULL, &global_size, &ensemble.stats_local_size, 0, NULL, NULL);
+	if(!error) {
+		error = clEnqueueReadBuffer(ensemble.queue, ensemble.counts, CL_FALSE, 0, ensemble.readback.size() * sizeof(cl_uint),
+				&ensemble.readback[0], 0, NULL, &ensemble.counts_read);
+	}
+	if(error) {
+		return error;
+	}
+
+	ensemble.counts_generation = ensemble.generation;
+	ensemble.counts_pending = true;
+	return clFlush(ensemble.queue);
+}
+
+cl_int stepClEnsemble(ClEnsemble &ensemble, unsigned int generations) {
+	for(unsigned int g = 0; g < generations; g++) {
+		clSetKernelArg(ensemble.kernel, 0, sizeof(cl_mem), &ensemble.universe);
+		clSetKernelArg(ensemble.kernel, 1, sizeof(cl_mem), &ensemble.update);
+		clSetKernelArg(ensemble.kernel, 3, sizeof(cl_ulong), &ensemble.generation);
+
+		cl_int error = clEnqueueNDRangeKernel(ensemble.queue, ensemble.kernel, 3, NULL, ensemble.global_size, ensemble.local_size, 0, NULL, NULL);
+		if(error) {
+			return error;
+		}
+
+		cl_mem temp_mem = ensemble.universe;
+		ensemble.universe = ensemble.update;
+		ensemble.update = temp_mem;
+		ensemble.generation++;
+	}
+	return clFlush(ensemble.queue);
+}
@@ -0,0 +1,65 @@
+#ifndef CL_ENSEMBLE_HPP
+#define CL_ENSEMBLE_HPP
+
+#define __NO_STD_VECTOR // Use cl::vector instead of STL version
+#include <CL/cl.h>
+
+#include <fstream>
+#include <vector>
+
+/*
+ * Many independent small worlds packed into one strided buffer and stepped
+ * by a single 3D launch, world k seeded with seed + k. A world of the ensemble
+ * evolves exactly like a single world run with that seed.
+ */
+struct ClEnsemble {
+	cl_context					context;
+	cl_device_id				device;
+	cl_command_queue			queue;
+
+	unsigned int				width, height, worlds;
+	int							boundary;
+
+	cl_kernel					kernel, stats_kernel;
+	cl_mem						universe, update, seeds;
+
+	size_t						global_size[3];
+	size_t						local_size[3];
+
+	// Per world population counts, read back one sample behind
+	cl_mem						counts;
+	std::vector<cl_uint>		readback;
+	cl_event					counts_read;
+	cl_ulong					counts_generation;
+	bool						counts_pending;
+	size_t						stats_local_size;
+	std::ofstream				log;
+
+	cl_ulong					seed, generation;
+};
+
+/*
+ * Windowless context on device of platform, kernels built for width x height worlds
+ */
+bool initClEnsemble(ClEnsemble &ensemble, unsigned int platform, unsigned int device,
+		unsigned int width, unsigned int height, unsigned int worlds, int boundary, cl_ulong seed);
+void exitClEnsemble(ClEnsemble &ensemble);
+
+/*
+ * Fill every world with its own random start
+ */
+bool randomizeClEnsemble(ClEnsemble &ensemble);
+
+/*
+ * Per world statistics CSV, one row per world and sample
+ */
+bool openClEnsembleStats(ClEnsemble &ensemble, const char *log_file);
+
+/*
+ * Enqueue a statistics pass over every world and log the previous one
+ */
+cl_int sampleClEnsembleStats(ClEnsemble &ensemble);
+
+cl_int stepClEnsemble(ClEnsemble &ensemble, unsigned int generations);
+
+#endif //CL_ENSEMBLE_HPP
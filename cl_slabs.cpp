@@ -0,0 +1,275 @@
+#include "cl_slabs.hpp"
+#include "clrps_rules.h"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+/*
+ * Devices to split over: all of the platform, or the NUMA nodes of its first CPU device
+ */
+static bool slabDevices(ClSlabs &slabs, unsigned int platform, const std::string &mode, std::vector<cl_device_id> &devices) {
+	const cl_device_type type = mode == "numa" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_ALL;
+	if(!platformDevices(platform, type, devices)) {
+		return false;
+	}
+
+	if(mode == "numa") {
+		const cl_device_partition_property properties[] = {
+				CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA,
+				0
+		};
+		cl_uint sub_count = 0;
+		if(clCreateSubDevices(devices[0], properties, 0, NULL, &sub_count) || sub_count == 0) {
+			std::cerr << "=-- NUMA partitioning not supported, using the whole CPU device" << std::endl;
+			devices.resize(1);
+			return true;
+		}
+		slabs.sub_devices.resize(sub_count);
+		clCreateSubDevices(devices[0], properties, sub_count, &slabs.sub_devices[0], NULL);
+		devices = slabs.sub_devices;
+	}
+
+	return true;
+}
+
+bool initClSlabs(ClSlabs &slabs, unsigned int platform, const std::string &mode,
+		unsigned int width, unsigned int height, int boundary, cl_ulong seed) {
+	cl_int clError;
+
+	slabs.width = width;
+	slabs.height = height;
+	slabs.boundary = boundary;
+	slabs.seed = seed;
+	slabs.generation = 0;
+
+	std::vector<cl_device_id> devices;
+	if(!slabDevices(slabs, platform, mode, devices)) {
+		return false;
+	}
+
+	// Share out rows by compute units, every slab gets at least one
+	std::vector<cl_uint> units(devices.size());
+	cl_ulong total_units = 0;
+	for(size_t i = 0; i < devices.size(); i++) {
+		clGetDeviceInfo(devices[i], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &units[i], NULL);
+		total_units += units[i];
+	}
+	if(devices.size() > height) {
+		devices.resize(height);
+	}
+
+	std::stringstream build_options;
+	build_options << "-I . -D WIDTH=" << width << " -D HEIGHT=" << height << " -D BOUNDARY=" << boundary
+			<< " -D BUFFER_LAYOUT -D INTEGER_STATE";
+
+	unsigned int row_offset = 0;
+	cl_ulong units_before = 0;
+	slabs.slabs.resize(devices.size());
+	for(size_t i = 0; i < devices.size(); i++) {
+		ClSlab &slab = slabs.slabs[i];
+		units_before += units[i];
+
+		const unsigned int slabs_after = devices.size() - 1 - i;
+		unsigned int row_end = i + 1 == devices.size() ? height : (unsigned int) (height * units_before / total_units);
+		row_end = std::max(row_end, row_offset + 1);
+		row_end = std::min(row_end, height - slabs_after);
+
+		slab.device = devices[i];
+		slab.row_offset = row_offset;
+		slab.rows = row_end - row_offset;
+		row_offset = row_end;
+
+		if(!openContext(slab.device, slab.context, &slab.queue, 1)) {
+			return false;
+		}
+
+		slab.kernel = loadKernel(slab.context, slab.device, "clrps_kernel.cl", build_options.str().c_str(), "rps_slab");
+		if(!slab.kernel) {
+			return false;
+		}
+
+		const size_t padded = (size_t) (slab.rows + 2) * width;
+		slab.universe = clCreateBuffer(slab.context, CL_MEM_READ_WRITE, padded, NULL, &clError);
+		if(!clError) {
+			slab.update = clCreateBuffer(slab.context, CL_MEM_READ_WRITE, padded, NULL, &clError);
+		}
+		if(clError) {
+			std::cerr << "Unable to allocate slab: " << clError << std::endl;
+			return false;
+		}
+
+		slab.top.resize(width);
+		slab.bottom.resize(width);
+		slab.top_halo.resize(width);
+		slab.bottom_halo.resize(width);
+
+		clSetKernelArg(slab.kernel, 2, sizeof(cl_ulong), &slabs.seed);
+		clSetKernelArg(slab.kernel, 4, sizeof(cl_uint), &slab.row_offset);
+
+		std::cout << "=-- Slab " << i << ": rows " << slab.row_offset << ".." << slab.row_offset + slab.rows - 1
+				<< " on " << deviceName(slab.device) << " (" << units[i] << " compute units)" << std::endl;
+	}
+
+	return true;
+}
+
+void exitClSlabs(ClSlabs &slabs) {
+	for(size_t i = 0; i < slabs.slabs.size(); i++) {
+		ClSlab &slab = slabs.slabs[i];
+		clReleaseMemObject(slab.universe);
+		clReleaseMemObject(slab.update);
+		clReleaseKernel(slab.kernel);
+		clReleaseCommandQueue(slab.queue);
+		clReleaseContext(slab.context);
+	}
+	for(size_t i = 0; i < slabs.sub_devices.size(); i++) {
+		clReleaseDevice(slabs.sub_devices[i]);
+	}
+	slabs.slabs.clear();
+	slabs.sub_devices.clear();
+}
+
+/*
+ * Source of the halo row next to a slab edge: the own row of whichever slab holds
+ * the wrapped or mirrored global row, or NULL past a fixed edge
+ */
+static const unsigned char *haloSource(const ClSlabs &slabs, int row, bool uploaded, const unsigned char *cells) {
+	int source = boundaryCoord(row, slabs.height, slabs.boundary);
+	if(source < 0) {
+		return NULL;
+	}
+	if(uploaded) {
+		return cells + (size_t) source * slabs.width;
+	}
+	for(size_t i = 0; i < slabs.slabs.size(); i++) {
+		const ClSlab &slab = slabs.slabs[i];
+		if((unsigned int) source == slab.row_offset) {
+			return &slab.top[0];
+		}
+		if((unsigned int) source == slab.row_offset + slab.rows - 1) {
+			return &slab.bottom[0];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Fill the halo rows of every slab's universe from the neighbours' edge rows
+ */
+static cl_int writeHalos(ClSlabs &slabs, bool uploaded, const unsigned char *cells) {
+	for(size_t i = 0; i < slabs.slabs.size(); i++) {
+		ClSlab &slab = slabs.slabs[i];
+		const unsigned char *top = haloSource(slabs, (int) slab.row_offset - 1, uploaded, cells);
+		const unsigned char *bottom = haloSource(slabs, (int) (slab.row_offset + slab.rows), uploaded, cells);
+
+		// Copy first, the edge rows are read again next generation
+		for(unsigned int x = 0; x < slabs.width; x++) {
+			slab.top_halo[x] = top ? top[x] : 0;
+			slab.bottom_halo[x] = bottom ? bottom[x] : 0;
+		}
+
+		cl_int error = clEnqueueWriteBuffer(slab.queue, slab.universe, CL_FALSE, 0, slabs.width, &slab.top_halo[0], 0, NULL, NULL);
+		if(!error) {
+			error = clEnqueueWriteBuffer(slab.queue, slab.universe, CL_FALSE, (size_t) (slab.rows + 1) * slabs.width, slabs.width,
+					&slab.bottom_halo[0], 0, NULL, NULL);
+		}
+		if(error) {
+			return error;
+		}
+	}
+	return CL_SUCCESS;
+}
+
+bool writeClSlabs(ClSlabs &slabs, const unsigned char *cells) {
+	for(size_t i = 0; i < slabs.slabs.size(); i++) {
+		ClSlab &slab = slabs.slabs[i];
+		if(clEnqueueWriteBuffer(slab.queue, slab.universe, CL_FALSE, slabs.width, (size_t) slab.rows * slabs.width,
+				cells + (size_t) slab.row_offset * slabs.width, 0, NULL, NULL)) {
+			return false;
+		}
+	}
+	if(writeHalos(slabs, true, cells)) {
+		return false;
+	}
+	for(size_t i = 0; i < slabs.slabs.size(); i++) {
+		clFinish(slabs.slabs[i].queue);
+	}
+	return true;
+}
+
+bool readClSlabs(ClSlabs &slabs, unsigned char *cells) {
+	for(size_t i = 0; i < slabs.slabs.size(); i++) {
+		ClSlab &slab = slabs.slabs[i];
+		if(clEnqueueReadBuffer(slab.queue, slab.universe, CL_TRUE, slabs.width, (size_t) slab.rows * slabs.width,
+				cells + (size_t) slab.row_offset * slabs.width, 0, NULL, NULL)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static cl_int enqueueRows(ClSlabs &slabs, ClSlab &slab, cl_uint first_row, size_t rows) {
+	const size_t global_size[] = {slabs.width, rows};
+	clSetKernelArg(slab.kernel, 5, sizeof(cl_uint), &first_row);
+	return clEnqueueNDRangeKernel(slab.queue, slab.kernel, 2, NULL, global_size, NULL, 0, NULL, NULL);
+}
+
+cl_int stepClSlabs(ClSlabs &slabs, unsigned int generations) {
+	cl_int error;
+
+	for(unsigned int g = 0; g < generations; g++) {
+		// Edge rows first and on their way back to the host, the interior computes meanwhile
+		for(size_t i = 0; i < slabs.slabs.size(); i++) {
+			ClSlab &slab = slabs.slabs[i];
+			const size_t last = slab.rows;
+
+			clSetKernelArg(slab.kernel, 0, sizeof(cl_mem), &slab.universe);
+			clSetKernelArg(slab.kernel, 1, sizeof(cl_mem), &slab.update);
+			clSetKernelArg(slab.kernel, 3, sizeof(cl_ulong), &slabs.generation);
+
+			error = enqueueRows(slabs, slab, 1, 1);
+			if(!error && last > 1) {
+				error = enqueueRows(slabs, slab, last, 1);
+			}
+			if(!error) {
+				error = clEnqueueReadBuffer(slab.queue, slab.update, CL_FALSE, slabs.width, slabs.width, &slab.top[0], 0, NULL, &slab.top_read);
+			}
+			if(!error) {
+				error = clEnqueueReadBuffer(slab.queue, slab.update, CL_FALSE, last * slabs.width, slabs.width, &slab.bottom[0], 0, NULL, &slab.bottom_read);
+			}
+			if(!error && last > 2) {
+				error = enqueueRows(slabs, slab, 2, last - 2);
+			}
+			if(error) {
+				return error;
+			}
+			clFlush(slab.queue);
+		}
+
+		for(size_t i = 0; i < slabs.slabs.size(); i++) {
+			ClSlab &slab = slabs.slabs[i];
+			clWaitForEvents(1, &slab.top_read);
+			clWaitForEvents(1, &slab.bottom_read);
+			clReleaseEvent(slab.top_read);
+			clReleaseEvent(slab.bottom_read);
+
+			cl_mem temp_mem = slab.universe;
+			slab.universe = slab.update;
+			slab.update = temp_mem;
+		}
+		slabs.generation++;
+
+		// Queued behind the interior rows, ahead of the next generation
+		error = writeHalos(slabs, false, NULL);
+		if(error) {
+			return error;
+		}
+	}
+
+	for(size_t i = 0; i < slabs.slabs.size(); i++) {
+		clFinish(slabs.slabs[i].queue);
+	}
+	return CL_SUCCESS;
+}
@@ -0,0 +1,60 @@
+#ifndef CL_SLABS_HPP
+#define CL_SLABS_HPP
+
+#define __NO_STD_VECTOR // Use cl::vector instead of STL version
+#include <CL/cl.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * One horizontal band of the world on one device, padded with a halo row above and below
+ */
+struct ClSlab {
+	cl_device_id				device;
+	cl_context					context;
+	cl_command_queue			queue;
+	cl_kernel					kernel;
+
+	unsigned int				row_offset, rows;
+	cl_mem						universe, update;
+
+	// First and last own row after a generation, and the halos they become for the neighbours
+	std::vector<unsigned char>	top, bottom;
+	std::vector<unsigned char>	top_halo, bottom_halo;
+	cl_event					top_read, bottom_read;
+};
+
+/*
+ * A world split into slabs across the devices of a platform,
+ * or across the NUMA nodes of a CPU device as sub-devices
+ */
+struct ClSlabs {
+	std::vector<ClSlab>			slabs;
+	std::vector<cl_device_id>	sub_devices;
+
+	unsigned int				width, height;
+	int							boundary;
+	cl_ulong					seed, generation;
+};
+
+/*
+ * Mode "devices" uses every device of the platform, "numa" partitions its
+ * first CPU device by NUMA node. Rows are dealt out by compute units.
+ */
+bool initClSlabs(ClSlabs &slabs, unsigned int platform, const std::string &mode,
+		unsigned int width, unsigned int height, int boundary, cl_ulong seed);
+void exitClSlabs(ClSlabs &slabs);
+
+/*
+ * Upload / download a whole width * height world
+ */
+bool writeClSlabs(ClSlabs &slabs, const unsigned char *cells);
+bool readClSlabs(ClSlabs &slabs, unsigned char *cells);
+
+/*
+ * Step every slab, exchanging the halo rows between generations
+ */
+cl_int stepClSlabs(ClSlabs &slabs, unsigned int generations);
+
+#endif //CL_SLABS_HPP
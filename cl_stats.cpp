@@ -0,0 +1,175 @@
+#include "cl_stats.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+// Work-groups per compute unit of the counting pass
+#define STATS_GROUPS_PER_UNIT	4
+
+std::string statsColumns() {
+	static const char *names[] = {"rock", "paper", "scissors"};
+
+	std::stringstream columns;
+	columns << "empty";
+	for(int species = 1; species <= RULE_SPECIES; species++) {
+		if(RULE_SPECIES == 3) {
+			columns << "," << names[species - 1];
+		} else {
+			columns << ",species" << species;
+		}
+	}
+	for(int i = 0; i < RULE_HEALTH; i++) {
+		columns << ",health" << i;
+	}
+	return columns.str();
+}
+
+bool initClStats(ClStats &stats, const ClEngine &engine, const char *log_file) {
+	cl_int clError;
+
+	stats.first = 0;
+	stats.count = 0;
+
+	stats.count_kernel = createEngineKernel(engine, "rps_stats");
+	stats.sum_kernel = stats.count_kernel ? createEngineKernel(engine, "rps_stats_sum") : NULL;
+	if(!stats.sum_kernel) {
+		return false;
+	}
+
+	// Enough work-groups to fill the device, every one writes a partial histogram
+	size_t kernel_group_size;
+	cl_uint compute_units;
+	clGetKernelWorkGroupInfo(stats.count_kernel, engine.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernel_group_size, NULL);
+	clGetDeviceInfo(engine.device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &compute_units, NULL);
+
+	const size_t cells = (size_t) engine.width * engine.height;
+	stats.local_size = std::min<size_t>(256, kernel_group_size);
+	stats.groups = std::max<size_t>(1, std::min<size_t>(compute_units * STATS_GROUPS_PER_UNIT, cells / stats.local_size));
+	stats.global_size = stats.groups * stats.local_size;
+
+	stats.partials = clCreateBuffer(engine.context, CL_MEM_READ_WRITE, stats.groups * STATS_BINS * sizeof(cl_uint), NULL, &clError);
+	if(!clError) {
+		stats.samples = clCreateBuffer(engine.context, CL_MEM_READ_WRITE, STATS_RING * STATS_BINS * sizeof(cl_uint), NULL, &clError);
+	}
+	if(clError) {
+		std::cerr << "Unable to allocate stats buffers: " << clError << std::endl;
+		return false;
+	}
+
+	clSetKernelArg(stats.count_kernel, 1, sizeof(cl_mem), &stats.partials);
+	clSetKernelArg(stats.sum_kernel, 0, sizeof(cl_mem), &stats.partials);
+	clSetKernelArg(stats.sum_kernel, 1, sizeof(cl_uint), &stats.groups);
+	clSetKernelArg(stats.sum_kernel, 2, sizeof(cl_mem), &stats.samples);
+
+	if(!log_file) {
+		return true;
+	}
+	stats.log.open(log_file);
+	if(!stats.log) {
+		std::cerr << "Unable to open stats log: " << log_file << std::endl;
+		return false;
+	}
+	stats.log << "generation," << statsColumns() << "\n";
+
+	std::cout << "=-- Population stats: " << log_file << ", " << stats.groups << " work-groups of " << stats.local_size << std::endl;
+	return true;
+}
+
+bool takeClStats(ClStats &stats, bool wait, cl_ulong &generation, cl_uint *counts) {
+	const unsigned int slot = stats.first;
+	if(!stats.count) {
+		return false;
+	}
+
+	if(wait) {
+		clWaitForEvents(1, &stats.events[slot]);
+	} else {
+		cl_int status;
+		clGetEventInfo(stats.events[slot], CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL);
+		if(status > CL_COMPLETE) {
+			return false;
+		}
+	}
+	clReleaseEvent(stats.events[slot]);
+
+	generation = stats.generations[slot];
+	std::copy(stats.readback[slot], stats.readback[slot] + STATS_BINS, counts);
+
+	stats.first = (stats.first + 1) % STATS_RING;
+	stats.count--;
+	return true;
+}
+
+/*
+ * Write out the oldest sample in flight, blocking until it arrives if wait is set.
+ * Returns false if there is none or it has not arrived yet.
+ */
+static bool logOldestSample(ClStats &stats, bool wait) {
+	cl_ulong generation;
+	cl_uint counts[STATS_BINS];
+	if(!takeClStats(stats, wait, generation, counts)) {
+		return false;
+	}
+
+	if(stats.log.is_open()) {
+		stats.log << generation;
+		for(int i = 0; i < STATS_BINS; i++) {
+			stats.log << "," << counts[i];
+		}
+		stats.log << "\n";
+	}
+	return true;
+}
+
+cl_int sampleClStats(ClStats &stats, const ClEngine &engine) {
+	cl_int error;
+
+	// The ring is full when the device runs far ahead of the log
+	if(stats.count == STATS_RING) {
+		logOldestSample(stats, true);
+	}
+	const cl_uint slot = (stats.first + stats.count) % STATS_RING;
+
+	clSetKernelArg(stats.count_kernel, 0, sizeof(cl_mem), &engine.universe);
+	error = clEnqueueNDRangeKernel(engine.queue, stats.count_kernel, 1, NULL, &stats.global_size, &stats.local_size, 0, NULL, NULL);
+	if(error) {
+		return error;
+	}
+
+	const size_t bins = STATS_BINS;
+	clSetKernelArg(stats.sum_kernel, 3, sizeof(cl_uint), &slot);
+	error = clEnqueueNDRangeKernel(engine.queue, stats.sum_kernel, 1, NULL, &bins, NULL, 0, NULL, NULL);
+	if(error) {
+		return error;
+	}
+
+	// Only the summed counters cross the bus, without blocking the queue
+	error = clEnqueueReadBuffer(engine.queue, stats.samples, CL_FALSE, slot * STATS_BINS * sizeof(cl_uint), STATS_BINS * sizeof(cl_uint),
+			stats.readback[slot], 0, NULL, &stats.events[slot]);
+	if(error) {
+		return error;
+	}
+
+	stats.generations[slot] = engine.generation;
+	stats.count++;
+
+	return clFlush(engine.queue);
+}
+
+void pollClStats(ClStats &stats, bool wait) {
+	while(logOldestSample(stats, wait));
+}
+
+void exitClStats(ClStats &stats) {
+	pollClStats(stats, true);
+	if(stats.log.is_open()) {
+		stats.log.close();
+	}
+
+	clReleaseMemObject(stats.partials);
+	clReleaseMemObject(stats.samples);
+	clReleaseKernel(stats.count_kernel);
+	clReleaseKernel(stats.sum_kernel);
+}
@@ -0,0 +1,61 @@
+#ifndef CL_STATS_HPP
+#define CL_STATS_HPP
+
+#include <fstream>
+
+#include "cl_engine.hpp"
+#include "clrps_rules.h"
+
+// Samples in flight between the device and the log
+#define STATS_RING	8
+
+/*
+ * On-device population statistics of a ClEngine universe.
+ * Every sample is reduced on the device and read back asynchronously,
+ * STATS_BINS counters per sample, written to a CSV time series.
+ */
+struct ClStats {
+	cl_kernel			count_kernel, sum_kernel;
+	cl_mem				partials, samples;
+
+	size_t				global_size, local_size;
+	cl_uint				groups;
+
+	// Read back ring: slot i holds the counters of generations[i] once events[i] completes
+	cl_uint				readback[STATS_RING][STATS_BINS];
+	cl_event			events[STATS_RING];
+	cl_ulong			generations[STATS_RING];
+	unsigned int		first, count;
+
+	std::ofstream		log;
+};
+
+/*
+ * Build the reduction kernels for the engine's universe and open the CSV log, none if NULL
+ */
+bool initClStats(ClStats &stats, const ClEngine &engine, const char *log_file);
+void exitClStats(ClStats &stats);
+
+/*
+ * Enqueue a sample of the current universe behind the queued generations.
+ * A GL shared universe must stay acquired until the enqueued commands are flushed.
+ */
+cl_int sampleClStats(ClStats &stats, const ClEngine &engine);
+
+/*
+ * Log the samples that have arrived, waiting for all of them if wait is set
+ */
+void pollClStats(ClStats &stats, bool wait);
+
+/*
+ * Take the oldest sample in flight instead of logging it, blocking for it if wait is set.
+ * False if there is none or it has not arrived yet.
+ */
+bool takeClStats(ClStats &stats, bool wait, cl_ulong &generation, cl_uint *counts);
+
+/*
+ * CSV column names of the STATS_BINS counters
+ */
+std::string statsColumns();
+
+#endif //CL_STATS_HPP
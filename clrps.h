@@ -0,0 +1,120 @@
+/*
+ * libclrps: rock, paper, scissors worlds driven in-process, without a window.
+ *
+ * The rule set is the one the library was built with, see clrps_get_rules().
+ * OpenCL worlds build clrps_kernel.cl and its headers from the working directory,
+ * like the viewer. A world is used from one thread at a time.
+ */
+#ifndef CLRPS_H
+#define CLRPS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Simulation backends */
+#define CLRPS_BACKEND_OPENCL		0
+#define CLRPS_BACKEND_CPU			1
+
+/* World edges, the BOUNDARY_* values of clrps_rules.h */
+#define CLRPS_BOUNDARY_PERIODIC		0
+#define CLRPS_BOUNDARY_REFLECTIVE	1
+#define CLRPS_BOUNDARY_FIXED		2
+
+/* Results */
+#define CLRPS_OK					0
+#define CLRPS_NOT_READY				1	/* no statistics sample has arrived yet */
+#define CLRPS_ERROR					-1	/* runtime error, details on stderr */
+#define CLRPS_ERROR_MAPPED			-2	/* the state is mapped, unmap it first */
+
+typedef struct clrps_world clrps_world;
+
+/*
+ * World settings, start from clrps_default_desc()
+ */
+typedef struct {
+	unsigned int		width, height;
+	int					boundary;		/* CLRPS_BOUNDARY_* */
+	unsigned long long	seed;
+
+	int					backend;		/* CLRPS_BACKEND_* */
+	unsigned int		platform;		/* OpenCL platform and device index */
+	unsigned int		device;
+	const char			*kernel;		/* OpenCL kernel variant: float, int, tiled or active */
+	unsigned int		threads;		/* CPU worker threads, 0 for one per core */
+	unsigned int		temporal;		/* CPU generations per pass over cache sized tiles */
+
+	/* Starting world as the viewer's --init, --densities, --init-count and --init-scale */
+	const char			*init;
+	const char			*densities;		/* NULL for equal odds */
+	unsigned int		init_count;
+	unsigned int		init_scale;
+} clrps_world_desc;
+
+/*
+ * Compile-time rule set: a cell state is species * health_levels + health, 0 is empty.
+ * Statistics samples hold stats_bins counters: empty cells, every species, then
+ * living cells by health.
+ */
+typedef struct {
+	int					species;
+	int					health_levels;
+	int					predators;
+	int					states;
+	int					stats_bins;
+} clrps_rules;
+
+void clrps_get_rules(clrps_rules *rules);
+
+void clrps_default_desc(clrps_world_desc *desc, unsigned int width, unsigned int height);
+
+/*
+ * Create a world at generation 0 with its starting pattern, NULL on failure
+ * (including an unknown backend)
+ */
+clrps_world *clrps_create(const clrps_world_desc *desc);
+void clrps_destroy(clrps_world *world);
+
+/*
+ * Advance the world by generations. OpenCL worlds enqueue them and return while
+ * the last batches still run, CPU worlds return when they are done.
+ */
+int clrps_step(clrps_world *world, unsigned long long generations);
+
+/*
+ * Wait until every enqueued generation is done
+ */
+int clrps_finish(clrps_world *world);
+
+/*
+ * Generations stepped or enqueued so far
+ */
+unsigned long long clrps_generation(const clrps_world *world);
+
+/*
+ * Sample the population of the current generation without waiting for it.
+ * Up to 8 samples are kept until polled, older ones are dropped.
+ */
+int clrps_request_stats(clrps_world *world);
+
+/*
+ * Oldest requested sample: CLRPS_OK with its generation and stats_bins counts,
+ * CLRPS_NOT_READY while it is still on its way or none was requested
+ */
+int clrps_poll_stats(clrps_world *world, unsigned long long *generation, unsigned int *counts);
+
+/*
+ * Read-only view of the current generation, one byte per cell, rows row_pitch bytes apart.
+ * Waits for the enqueued generations. On devices sharing host memory and with the CPU
+ * backend nothing is copied. Valid until clrps_unmap_state(), stepping fails meanwhile.
+ */
+const unsigned char *clrps_map_state(clrps_world *world, size_t *row_pitch);
+int clrps_unmap_state(clrps_world *world);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLRPS_H */
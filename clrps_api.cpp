@@ -0,0 +1,349 @@
+#include "clrps.h"
+
+#include "cl_engine.hpp"
+#include "cl_stats.hpp"
+#include "cpu_engine.hpp"
+#include "init_patterns.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+// Generations enqueued between two markers, two batches are in flight at most
+#define STEP_BATCH		256
+
+/*
+ * Population sample of the CPU backend, counted on request
+ */
+struct HostSample {
+	unsigned long long		generation;
+	std::vector<cl_uint>	counts;
+};
+
+struct clrps_world {
+	int						backend;
+
+	CpuEngine				cpu;
+	std::deque<HostSample>	host_samples;
+
+	ClEngine				cl;
+	ClStats					stats;
+	bool					stats_ready;
+	cl_event				batches[2];
+	unsigned int			batch;
+
+	const unsigned char		*mapped;
+};
+
+/*
+ * Worlds larger than the device's images fall back to the buffer layout, as in the viewer
+ */
+static bool fitsImage(cl_device_id device, unsigned int width, unsigned int height) {
+	size_t image_width, image_height;
+	clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(size_t), &image_width, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(size_t), &image_height, NULL);
+	return width <= image_width && height <= image_height;
+}
+
+static void releaseClWorld(clrps_world *world);
+
+static bool createClWorld(clrps_world *world, const clrps_world_desc *desc, const Config &config, const InitParams &params) {
+	ClEngine &engine = world->cl;
+	if(!openDevice(desc->platform, desc->device, engine.device, engine.context, &engine.queue, 1)) {
+		return false;
+	}
+
+	engine.width = desc->width;
+	engine.height = desc->height;
+	engine.boundary = desc->boundary;
+	engine.buffer_layout = !fitsImage(engine.device, desc->width, desc->height);
+	engine.launch = config.launch;
+	engine.seed = desc->seed;
+	engine.generation = 0;
+	engine.profiler = NULL;
+
+	if(!validLaunch(engine.launch, engine.device) || !initClEngine(engine)) {
+		clReleaseCommandQueue(engine.queue);
+		clReleaseContext(engine.context);
+		return false;
+	}
+	if(!createClEngineMemory(engine)) {
+		exitClEngine(engine);
+		clReleaseCommandQueue(engine.queue);
+		clReleaseContext(engine.context);
+		return false;
+	}
+
+	world->stats_ready = false;
+	world->batches[0] = world->batches[1] = NULL;
+	world->batch = 0;
+	if(enqueueInitPattern(engine, params) || clFinish(engine.queue)) {
+		std::cerr << "Init runtime error!" << std::endl;
+		releaseClWorld(world);
+		return false;
+	}
+	return true;
+}
+
+static void releaseClWorld(clrps_world *world) {
+	ClEngine &engine = world->cl;
+	clFinish(engine.queue);
+	for(int i = 0; i < 2; i++) {
+		if(world->batches[i]) {
+			clReleaseEvent(world->batches[i]);
+		}
+	}
+	if(world->stats_ready) {
+		exitClStats(world->stats);
+	}
+	releaseClEngineMemory(engine);
+	exitClEngine(engine);
+	clReleaseCommandQueue(engine.queue);
+	clReleaseContext(engine.context);
+}
+
+extern "C" {
+
+void clrps_get_rules(clrps_rules *rules) {
+	rules->species = RULE_SPECIES;
+	rules->health_levels = RULE_HEALTH;
+	rules->predators = RULE_PREDATORS;
+	rules->states = RULE_STATES;
+	rules->stats_bins = STATS_BINS;
+}
+
+void clrps_default_desc(clrps_world_desc *desc, unsigned int width, unsigned int height) {
+	desc->width = width;
+	desc->height = height;
+	desc->boundary = CLRPS_BOUNDARY_PERIODIC;
+	desc->seed = 0;
+	desc->backend = CLRPS_BACKEND_OPENCL;
+	desc->platform = 0;
+	desc->device = 0;
+	desc->kernel = NULL;
+	desc->threads = 0;
+	desc->temporal = 1;
+	desc->init = "uniform";
+	desc->densities = NULL;
+	desc->init_count = 0;
+	desc->init_scale = 32;
+}
+
+clrps_world *clrps_create(const clrps_world_desc *desc) {
+	if(desc->backend != CLRPS_BACKEND_OPENCL && desc->backend != CLRPS_BACKEND_CPU) {
+		std::cerr << "Unknown backend: " << desc->backend << std::endl;
+		return NULL;
+	}
+
+	// The viewer's settings check the values and build the starting pattern
+	Config config;
+	defaultConfig(config);
+	config.width = desc->width;
+	config.height = desc->height;
+	config.seed = desc->seed;
+	if(!setOption(config, "boundary", desc->boundary == CLRPS_BOUNDARY_REFLECTIVE ? "reflective" :
+			desc->boundary == CLRPS_BOUNDARY_FIXED ? "fixed" : "periodic") ||
+			(desc->kernel && !setOption(config, "kernel", desc->kernel)) ||
+			(desc->init && !setOption(config, "init", desc->init)) ||
+			(desc->densities && !setOption(config, "densities", desc->densities)) ||
+			!setOption(config, "init-count", std::to_string(desc->init_count)) ||
+			!setOption(config, "init-scale", std::to_string(desc->init_scale)) ||
+			!validConfig(config)) {
+		return NULL;
+	}
+	InitParams params;
+	if(!initPatternParams(params, config)) {
+		return NULL;
+	}
+
+	clrps_world *world = new clrps_world();
+	world->backend = desc->backend;
+	world->mapped = NULL;
+
+	if(desc->backend == CLRPS_BACKEND_CPU) {
+		initCpuEngine(world->cpu, desc->width, desc->height, desc->threads, desc->seed, config.boundary);
+		world->cpu.temporal_steps = desc->temporal > 0 ? desc->temporal : 1;
+		if(params.pattern == INIT_UNIFORM && !desc->densities) {
+			randomizeCpuEngine(world->cpu);
+		} else {
+			fillInitPattern(params, desc->seed, &world->cpu.universe[0]);
+		}
+		return world;
+	}
+
+	if(!createClWorld(world, desc, config, params)) {
+		delete world;
+		return NULL;
+	}
+	return world;
+}
+
+void clrps_destroy(clrps_world *world) {
+	if(!world) {
+		return;
+	}
+	if(world->mapped) {
+		clrps_unmap_state(world);
+	}
+	if(world->backend == CLRPS_BACKEND_CPU) {
+		exitCpuEngine(world->cpu);
+	} else {
+		releaseClWorld(world);
+	}
+	delete world;
+}
+
+int clrps_step(clrps_world *world, unsigned long long generations) {
+	if(world->mapped) {
+		return CLRPS_ERROR_MAPPED;
+	}
+
+	if(world->backend == CLRPS_BACKEND_CPU) {
+		while(generations) {
+			const unsigned int batch = std::min<unsigned long long>(generations, STEP_BATCH);
+			stepCpuEngine(world->cpu, batch);
+			generations -= batch;
+		}
+		return CLRPS_OK;
+	}
+
+	// A marker after every batch, waiting for the one before keeps the queue short
+	ClEngine &engine = world->cl;
+	while(generations) {
+		const unsigned int batch = std::min<unsigned long long>(generations, STEP_BATCH);
+		cl_event &marker = world->batches[world->batch];
+		if(marker) {
+			clWaitForEvents(1, &marker);
+			clReleaseEvent(marker);
+			marker = NULL;
+		}
+
+		if(enqueueGenerations(engine, batch) || clEnqueueMarkerWithWaitList(engine.queue, 0, NULL, &marker) || clFlush(engine.queue)) {
+			std::cerr << "Kernel runtime error!" << std::endl;
+			return CLRPS_ERROR;
+		}
+		world->batch = 1 - world->batch;
+		generations -= batch;
+	}
+	return CLRPS_OK;
+}
+
+int clrps_finish(clrps_world *world) {
+	if(world->backend == CLRPS_BACKEND_CPU) {
+		return CLRPS_OK;
+	}
+	return clFinish(world->cl.queue) ? CLRPS_ERROR : CLRPS_OK;
+}
+
+unsigned long long clrps_generation(const clrps_world *world) {
+	return world->backend == CLRPS_BACKEND_CPU ? world->cpu.generation : world->cl.generation;
+}
+
+int clrps_request_stats(clrps_world *world) {
+	if(world->backend == CLRPS_BACKEND_CPU) {
+		const CpuEngine &engine = world->cpu;
+		HostSample sample;
+		sample.generation = engine.generation;
+		sample.counts.assign(STATS_BINS, 0);
+		for(size_t i = 0; i < engine.universe.size(); i++) {
+			const int state = engine.universe[i];
+			sample.counts[state / RULE_HEALTH]++;
+			if(state >= RULE_HEALTH) {
+				sample.counts[STATS_SPECIES + state % RULE_HEALTH]++;
+			}
+		}
+		if(world->host_samples.size() == STATS_RING) {
+			world->host_samples.pop_front();
+		}
+		world->host_samples.push_back(sample);
+		return CLRPS_OK;
+	}
+
+	// Reduction kernels are built with the first request
+	if(!world->stats_ready) {
+		if(!initClStats(world->stats, world->cl, NULL)) {
+			return CLRPS_ERROR;
+		}
+		world->stats_ready = true;
+	}
+	if(sampleClStats(world->stats, world->cl)) {
+		std::cerr << "Stats runtime error!" << std::endl;
+		return CLRPS_ERROR;
+	}
+	return CLRPS_OK;
+}
+
+int clrps_poll_stats(clrps_world *world, unsigned long long *generation, unsigned int *counts) {
+	if(world->backend == CLRPS_BACKEND_CPU) {
+		if(world->host_samples.empty()) {
+			return CLRPS_NOT_READY;
+		}
+		const HostSample &sample = world->host_samples.front();
+		*generation = sample.generation;
+		std::copy(sample.counts.begin(), sample.counts.end(), counts);
+		world->host_samples.pop_front();
+		return CLRPS_OK;
+	}
+
+	cl_ulong sample_generation;
+	if(!world->stats_ready || !takeClStats(world->stats, false, sample_generation, counts)) {
+		return CLRPS_NOT_READY;
+	}
+	*generation = sample_generation;
+	return CLRPS_OK;
+}
+
+const unsigned char *clrps_map_state(clrps_world *world, size_t *row_pitch) {
+	if(world->mapped) {
+		return NULL;
+	}
+
+	if(world->backend == CLRPS_BACKEND_CPU) {
+		*row_pitch = world->cpu.width;
+		world->mapped = &world->cpu.universe[0];
+		return world->mapped;
+	}
+
+	// Blocking map, it waits for the queued generations
+	ClEngine &engine = world->cl;
+	cl_int error;
+	void *mapped;
+	if(engine.buffer_layout) {
+		*row_pitch = engine.width;
+		mapped = clEnqueueMapBuffer(engine.queue, engine.universe, CL_TRUE, CL_MAP_READ, 0,
+				(size_t) engine.width * engine.height, 0, NULL, NULL, &error);
+	} else {
+		const size_t origin[] = {0, 0, 0};
+		const size_t region[] = {engine.width, engine.height, 1};
+		mapped = clEnqueueMapImage(engine.queue, engine.universe, CL_TRUE, CL_MAP_READ, origin, region,
+				row_pitch, NULL, 0, NULL, NULL, &error);
+	}
+	if(error) {
+		std::cerr << "Unable to map universe: " << error << std::endl;
+		return NULL;
+	}
+	world->mapped = (const unsigned char *) mapped;
+	return world->mapped;
+}
+
+int clrps_unmap_state(clrps_world *world) {
+	if(!world->mapped) {
+		return CLRPS_OK;
+	}
+
+	const unsigned char *mapped = world->mapped;
+	world->mapped = NULL;
+	if(world->backend == CLRPS_BACKEND_CPU) {
+		return CLRPS_OK;
+	}
+
+	ClEngine &engine = world->cl;
+	if(clEnqueueUnmapMemObject(engine.queue, engine.universe, (void *) mapped, 0, NULL, NULL) || clFlush(engine.queue)) {
+		return CLRPS_ERROR;
+	}
+	return CLRPS_OK;
+}
+
+}
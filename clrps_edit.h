@@ -0,0 +1,39 @@
+/*
+ * Paint / edit operations shared by the edit kernel and the host queue.
+ * Cells past the edge of the world are skipped, edits never wrap.
+ */
+#ifndef CLRPS_EDIT_H
+#define CLRPS_EDIT_H
+
+#ifdef __OPENCL_VERSION__
+	#define EDIT_UINT		uint
+	#define EDIT_INT		int
+#else
+	#include <stdint.h>
+	#define EDIT_UINT		uint32_t
+	#define EDIT_INT		int32_t
+#endif
+
+// Operation types
+#define EDIT_POINT		0
+#define EDIT_LINE		1
+#define EDIT_RECT		2
+#define EDIT_CIRCLE		3
+#define EDIT_SPRAY		4
+
+// Random stream of spray number serial, counting down from below the initial world's
+#define EDIT_SPRAY_GENERATION(serial)	(RNG_INIT_GENERATION - 1 - (serial))
+
+/*
+ * One operation, 32 bytes in the command buffer
+ */
+typedef struct {
+	EDIT_UINT		type;		// EDIT_*
+	EDIT_UINT		state;		// cell state written
+	EDIT_INT		x0, y0;		// point, line start, rectangle corner, circle and spray centre
+	EDIT_INT		x1, y1;		// line end, opposite rectangle corner, x1 is the circle and spray radius
+	EDIT_UINT		density;	// spray: chance of every cell as a 32 bit fraction
+	EDIT_UINT		serial;		// spray: random stream
+} EditOp;
+
+#endif //CLRPS_EDIT_H
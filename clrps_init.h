@@ -0,0 +1,104 @@
+/*
+ * Starting world generators shared by the rps_init kernel and the host.
+ * Every cell is a function of the parameter block, the seed and its position,
+ * so a world is built on the device by one launch without any cell upload.
+ */
+#ifndef CLRPS_INIT_H
+#define CLRPS_INIT_H
+
+#include "clrps_rules.h"
+
+#ifdef __OPENCL_VERSION__
+	#define INIT_ATAN2(y, x)	atan2(y, x)
+	#define INIT_SQRT(v)		sqrt(v)
+	#define INIT_FLOOR(v)		floor(v)
+#else
+	#include <math.h>
+	#define INIT_ATAN2(y, x)	atan2f(y, x)
+	#define INIT_SQRT(v)		sqrtf(v)
+	#define INIT_FLOOR(v)		floorf(v)
+#endif
+
+// Patterns
+#define INIT_CLEAR		0	// every cell empty
+#define INIT_UNIFORM	1	// independent cells with per species densities
+#define INIT_VORONOI	2	// cells take the species of the nearest of count random sites
+#define INIT_STRIPES	3	// species bands scale cells wide, shifted by count cells per row
+#define INIT_SPIRAL		4	// count windings of all species around the centre, scale cells apart
+
+// Sites are checked by every cell, this bounds the cost of a launch
+#define INIT_MAX_SITES	256
+
+// Random stream of the Voronoi sites, apart from the generations and the spray streams
+#define INIT_SITE_GENERATION	(RNG_INIT_GENERATION >> 1)
+
+/*
+ * Parameter block, passed by value to the kernel
+ */
+typedef struct {
+	// Uniform: random word from which on a cell is species s + 1, ascending, 2^32 for never
+	RNG_ULONG		first[RULE_SPECIES];
+	RNG_UINT		pattern;		// INIT_*
+	RNG_UINT		width, height;
+	RNG_UINT		count;			// Voronoi sites, stripe shift, spiral windings
+	RNG_UINT		scale;			// stripe width, spiral winding distance
+	RNG_UINT		padding;
+} InitParams;
+
+RULES_INLINE int initSpecies(const InitParams *params, RNG_ULONG seed, int x, int y) {
+	if(params->pattern == INIT_UNIFORM) {
+		const RNG_ULONG word = rngCell(seed, RNG_INIT_GENERATION, x, y);
+		int species = 0;
+		for(int s = 0; s < RULE_SPECIES; s++) {
+			if(word >= params->first[s]) {
+				species = s + 1;
+			}
+		}
+		return species;
+	}
+
+	if(params->pattern == INIT_VORONOI) {
+		// Three words per site: position and species.
+		// Squared distances in 64 bits, they pass 32 bits from 46341 cells apart.
+		RNG_ULONG nearest = ~(RNG_ULONG) 0;
+		int species = 0;
+		for(RNG_UINT i = 0; i < params->count; i++) {
+			const int dx = x - (int) rngChoice(rngCell(seed, INIT_SITE_GENERATION, 3 * i, 0), params->width);
+			const int dy = y - (int) rngChoice(rngCell(seed, INIT_SITE_GENERATION, 3 * i + 1, 0), params->height);
+			const RNG_ULONG ax = (RNG_ULONG) (dx < 0 ? -dx : dx);
+			const RNG_ULONG ay = (RNG_ULONG) (dy < 0 ? -dy : dy);
+			const RNG_ULONG distance = ax * ax + ay * ay;
+			if(distance < nearest) {
+				nearest = distance;
+				species = 1 + rngChoice(rngCell(seed, INIT_SITE_GENERATION, 3 * i + 2, 0), RULE_SPECIES);
+			}
+		}
+		return species;
+	}
+
+	if(params->pattern == INIT_STRIPES) {
+		return 1 + ((RNG_UINT) x + (RNG_UINT) y * params->count) / params->scale % RULE_SPECIES;
+	}
+
+	if(params->pattern == INIT_SPIRAL) {
+		// Whole windings of RULE_SPECIES arms, so the species stay continuous where the angle wraps.
+		// Single precision on both sides, cells right on an arm edge may differ between host and device.
+		const float dx = x - 0.5f * params->width;
+		const float dy = y - 0.5f * params->height;
+		const float turn = INIT_ATAN2(dy, dx) / 6.2831853f + 0.5f;
+		const int arm = (int) INIT_FLOOR(turn * RULE_SPECIES * params->count + INIT_SQRT(dx * dx + dy * dy) / params->scale);
+		return 1 + arm % RULE_SPECIES;
+	}
+
+	return 0;
+}
+
+/*
+ * Starting state of a cell, living cells at full health
+ */
+RULES_INLINE int initCell(const InitParams *params, RNG_ULONG seed, int x, int y) {
+	const int species = initSpecies(params, seed, x, y);
+	return species == 0 ? 0 : species * RULE_HEALTH + RULE_HEALTH - 1;
+}
+
+#endif //CLRPS_INIT_H
@@ -1,125 +1,715 @@
 /*
- * BF random number generator
- * source: http://stackoverflow.com/questions/4200224/random-noise-functions-for-glsl
- * also works with glsl
+ * Counter based random numbers, shared with the native engine
  */
-float randBF(float2 seed) {
-	float rnd_floor;
-    return fract(sin(dot(seed, (float2){12.9898, 78.233})) * 43758.5453, &rnd_floor);
-}
+#include "clrps_rng.h"
+
+/*
+ * Neighbourhoods, boundaries and the rule set, shared with the native engine
+ */
+#include "clrps_rules.h"
+
+/*
+ * Edit operations, shared with the host queue
+ */
+#include "clrps_edit.h"
+
+/*
+ * Starting world generators, shared with the host
+ */
+#include "clrps_init.h"
+
+#ifndef BOUNDARY
+	#define BOUNDARY	BOUNDARY_PERIODIC
+#endif
 
 /*
  * Rock, paper, scissors simulator kernel.
  * logic source:
  * www.gamedev.net/blog/844/entry-2249737-another-cellular-automaton-video/
  *
+ * Works on normalized R8 images, the sampler does the boundary handling.
  */
 __kernel void rps(
 		__read_only 	image2d_t universe,
 		__write_only 	image2d_t output,
-		__global		float *random,
-						sampler_t sampler) {
+						sampler_t sampler,
+						ulong seed,
+						ulong generation) {
 						
-	float x_unit = 1.0 / WIDTH;
-	float y_unit = 1.0 / HEIGHT;
-	
+	// Texel centres: corner coordinates land a texel short after rounding for
+	// sizes that are not powers of two
 	float2	fcoord = (float2){
-		get_global_id(0) / (float) WIDTH,
-		get_global_id(1) / (float) HEIGHT
+		(get_global_id(0) + 0.5f) / (float) WIDTH,
+		(get_global_id(1) + 0.5f) / (float) HEIGHT
 		};
 	int2	icoord = (int2){get_global_id(0), get_global_id(1)};
 	
+	// Work-items past the edge of a rounded up NDRange
+	if(icoord.x >= WIDTH || icoord.y >= HEIGHT) {
+		return;
+	}
+	
 	float 	current_fstate;
 	int		current_istate;
 	
 	float2 	neighbour_coord;	
 	int 	neighbour_state;
-	float 	rnd = randBF((float2){
-		random[get_global_id(1) * WIDTH + get_global_id(0)],
-		random[get_global_id(1) * WIDTH + get_global_id(0) + 1]
-		}) * 8;
+	uint 	rnd = ruleDirection(seed, generation, icoord.x, icoord.y);
 	
 	// Choose neighbour
-	if(rnd > 7.0) {
-		neighbour_coord = (float2){fcoord.x - x_unit, fcoord.y + y_unit};
+	neighbour_coord = (float2){
+		(icoord.x + RULE_DX(rnd, icoord.y) + 0.5f) / (float) WIDTH,
+		(icoord.y + RULE_DY(rnd, icoord.y) + 0.5f) / (float) HEIGHT
+		};
+	
+	neighbour_state = (int){read_imagef(universe, sampler, neighbour_coord).x * 255};
+	
+	current_fstate = read_imagef(universe, sampler, fcoord).x;
+	current_istate = (int){current_fstate * 255};
+	
+	current_istate = rpsRule(current_istate, neighbour_state);
+	
+	// Transfor state back to float
+	current_fstate = (float){current_istate / 255.0};
+	
+	// Write out new state
+	write_imagef(output, icoord, current_fstate);
+}
+
+/*
+ * Integer universe storage: CL_UNSIGNED_INT8 images,
+ * or row major byte buffers for worlds larger than the max image size
+ */
+#ifdef BUFFER_LAYOUT
+	#define UNIVERSE_T			__global const uchar *
+	#define OUTPUT_T			__global uchar *
+	#define READ_CELL(cx, cy)		universe[(cy) * WIDTH + (cx)]
+	#define WRITE_CELL(cx, cy, s)	output[(cy) * WIDTH + (cx)] = (s)
+#else
+	#define UNIVERSE_T			__read_only image2d_t
+	#define OUTPUT_T			__write_only image2d_t
+	#define READ_CELL(cx, cy)		read_imageui(universe, cell_sampler, (int2){cx, cy}).x
+	#define WRITE_CELL(cx, cy, s)	write_imageui(output, (int2){cx, cy}, (uint4){s, 0, 0, 0})
+#endif
+
+__constant sampler_t cell_sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
+
+/*
+ * Integer variant of the rps kernel: no float state conversions,
+ * neighbour from the offset table, boundary selected at build time.
+ * The sampler argument is unused, it keeps the argument list of rps.
+ */
+__kernel void rps_int(
+						UNIVERSE_T universe,
+						OUTPUT_T output,
+						sampler_t sampler,
+						ulong seed,
+						ulong generation) {
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+
+	// Work-items past the edge of a rounded up NDRange
+	if(x >= WIDTH || y >= HEIGHT) {
+		return;
+	}
+
+	uint direction = ruleDirection(seed, generation, x, y);
+	int nx = boundaryCoord(x + RULE_DX(direction, y), WIDTH, BOUNDARY);
+	int ny = boundaryCoord(y + RULE_DY(direction, y), HEIGHT, BOUNDARY);
+
+	int neighbour = (nx < 0 || ny < 0) ? 0 : READ_CELL(nx, ny);
+	int current = READ_CELL(x, y);
+
+	WRITE_CELL(x, y, rpsRule(current, neighbour));
+}
+
+/*
+ * Tiled variant: every work-group stages its TILE_W x TILE_H tile plus a one
+ * cell halo in local memory, every work-item updates COARSEN cells in a row.
+ * Local size is (TILE_W / COARSEN, TILE_H).
+ */
+#ifndef TILE_W
+	#define TILE_W		32
+#endif
+#ifndef TILE_H
+	#define TILE_H		8
+#endif
+#ifndef COARSEN
+	#define COARSEN		4
+#endif
+
+#define HALO_W		(TILE_W + 2)
+#define HALO_H		(TILE_H + 2)
+
+#define LOCAL_ITEMS	((TILE_W / COARSEN) * TILE_H)
+
+/*
+ * Load tile and halo once per work-group
+ */
+void loadTile(UNIVERSE_T universe, __local uchar tile[HALO_H][HALO_W], int tile_x, int tile_y, int local_index) {
+	for(int i = local_index; i < HALO_W * HALO_H; i += LOCAL_ITEMS) {
+		int gx = boundaryCoord(tile_x + i % HALO_W - 1, WIDTH, BOUNDARY);
+		int gy = boundaryCoord(tile_y + i / HALO_W - 1, HEIGHT, BOUNDARY);
+		// Clamp cells past the right / bottom edge of partial tiles, they are never written
+		gx = gx >= WIDTH ? WIDTH - 1 : gx;
+		gy = gy >= HEIGHT ? HEIGHT - 1 : gy;
+		tile[i / HALO_W][i % HALO_W] = (gx < 0 || gy < 0) ? 0 : READ_CELL(gx, gy);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+__kernel void rps_tiled(
+						UNIVERSE_T universe,
+						OUTPUT_T output,
+						sampler_t sampler,
+						ulong seed,
+						ulong generation) {
+
+	__local uchar tile[HALO_H][HALO_W];
+
+	const int tile_x = get_group_id(0) * TILE_W;
+	const int tile_y = get_group_id(1) * TILE_H;
+	const int local_index = get_local_id(1) * (TILE_W / COARSEN) + get_local_id(0);
+
+	loadTile(universe, tile, tile_x, tile_y, local_index);
+
+	const int ly = get_local_id(1) + 1;
+	const int y = tile_y + get_local_id(1);
+	const int first_x = get_local_id(0) * COARSEN;
+
+	uint words[4];
+	for(int i = 0; i < COARSEN; i++) {
+		int lx = first_x + i + 1;
+		int x = tile_x + first_x + i;
+		if(x >= WIDTH || y >= HEIGHT) {
+			break;
+		}
+
+		// One random block serves four cells
+		if(i == 0 || (x & 3) == 0) {
+			rngBlock(seed, generation, x >> 2, y, words);
+		}
+		uint direction = wordDirection(words[x & 3]);
+
+		int neighbour = tile[ly + RULE_DY(direction, y)][lx + RULE_DX(direction, y)];
+		WRITE_CELL(x, y, rpsRule(tile[ly][lx], neighbour));
 	}
-	else if(rnd > 6.0) {
-		neighbour_coord = (float2){fcoord.x, fcoord.y + y_unit};
+}
+
+/*
+ * Active tile variant: the tiled kernel over a compacted list of tiles.
+ * A tile is live when one of its cells changed, or could change under another
+ * random direction. Only tiles that are live or next to a live tile run, the
+ * others keep their state in both universes. One work-group per listed tile,
+ * groups past the listed count return at once.
+ */
+#define TILES_X		((WIDTH + TILE_W - 1) / TILE_W)
+#define TILES_Y		((HEIGHT + TILE_H - 1) / TILE_H)
+
+__kernel void rps_active(
+						UNIVERSE_T universe,
+						OUTPUT_T output,
+						sampler_t sampler,
+						ulong seed,
+						ulong generation,
+						__global const uint *tiles,
+						__global const uint *tile_count,
+						__global uchar *live_next) {
+
+	__local uchar tile[HALO_H][HALO_W];
+
+	if(get_group_id(0) >= *tile_count) {
+		return;
 	}
-	else if(rnd > 5.0) {
-		neighbour_coord = (float2){fcoord.x + x_unit, fcoord.y + y_unit};
+
+	const uint tile_index = tiles[get_group_id(0)];
+	const int tile_x = tile_index % TILES_X * TILE_W;
+	const int tile_y = tile_index / TILES_X * TILE_H;
+	const int local_index = get_local_id(1) * (TILE_W / COARSEN) + get_local_id(0);
+
+	loadTile(universe, tile, tile_x, tile_y, local_index);
+
+	const int ly = get_local_id(1) + 1;
+	const int y = tile_y + get_local_id(1);
+	const int first_x = get_local_id(0) * COARSEN;
+
+	bool live = false;
+	uint words[4];
+	for(int i = 0; i < COARSEN; i++) {
+		int lx = first_x + i + 1;
+		int x = tile_x + first_x + i;
+		if(x >= WIDTH || y >= HEIGHT) {
+			break;
+		}
+
+		if(i == 0 || (x & 3) == 0) {
+			rngBlock(seed, generation, x >> 2, y, words);
+		}
+		uint direction = wordDirection(words[x & 3]);
+
+		int current = tile[ly][lx];
+		int next = rpsRule(current, tile[ly + RULE_DY(direction, y)][lx + RULE_DX(direction, y)]);
+		WRITE_CELL(x, y, next);
+
+		// Settled cells stay the same whichever neighbour they pick
+		live = live || next != current;
+		for(int d = 0; d < RULE_DIRECTIONS && !live; d++) {
+			live = rpsRule(current, tile[ly + RULE_DY(d, y)][lx + RULE_DX(d, y)]) != current;
+		}
 	}
-	else if(rnd > 4.0) {
-		neighbour_coord = (float2){fcoord.x - x_unit, fcoord.y};
+
+	if(live) {
+		live_next[tile_index] = 1;
 	}
-	else if(rnd > 3.0) {
-		neighbour_coord = (float2){fcoord.x + x_unit, fcoord.y};
+}
+
+/*
+ * List the tiles that are live or have a live neighbour, one work-item per tile.
+ * Also clears the live flags the next rps_active fills in.
+ */
+__kernel void rps_compact(
+						__global const uchar *live,
+						__global uint *tiles,
+						__global uint *tile_count,
+						__global uchar *live_next) {
+
+	const int tile_index = get_global_id(0);
+	if(tile_index >= TILES_X * TILES_Y) {
+		return;
 	}
-	else if(rnd > 2.0) {
-		neighbour_coord = (float2){fcoord.x - x_unit, fcoord.y - y_unit};
+	live_next[tile_index] = 0;
+
+	const int tx = tile_index % TILES_X;
+	const int ty = tile_index / TILES_X;
+	bool active = live[tile_index];
+	for(int d = 0; d < 8 && !active; d++) {
+		// Tiles past a reflective or fixed edge do not exist, their cells mirror or are empty
+		int nx = tx + neighbour_dx[d];
+		int ny = ty + neighbour_dy[d];
+		if(BOUNDARY == BOUNDARY_PERIODIC) {
+			nx = (nx + TILES_X) % TILES_X;
+			ny = (ny + TILES_Y) % TILES_Y;
+		} else if(nx < 0 || nx >= TILES_X || ny < 0 || ny >= TILES_Y) {
+			continue;
+		}
+		active = live[ny * TILES_X + nx];
 	}
-	else if(rnd > 1.0) {
-		neighbour_coord = (float2){fcoord.x, fcoord.y - y_unit};
+
+	if(active) {
+		tiles[atomic_inc(tile_count)] = tile_index;
 	}
-	else {
-		neighbour_coord = (float2){fcoord.x + x_unit, fcoord.y - y_unit};
+}
+
+/*
+ * Cell states in whichever storage the rps kernel uses, for the helper kernels below
+ */
+#ifdef INTEGER_STATE
+	#define LOAD_STATE(cx, cy)		READ_CELL(cx, cy)
+	#define STORE_STATE(cx, cy, s)	WRITE_CELL(cx, cy, s)
+#else
+	#define LOAD_STATE(cx, cy)		(uint) (read_imagef(universe, cell_sampler, (int2){cx, cy}).x * 255.0f + 0.5f)
+	#define STORE_STATE(cx, cy, s)	write_imagef(output, (int2){cx, cy}, (float4){(s) / 255.0f, 0.0f, 0.0f, 0.0f})
+#endif
+
+/*
+ * Population statistics, see STATS_BINS in clrps_rules.h.
+ * Every work-item counts a grid stride of cells privately, the work-group
+ * merges them with local atomics and writes one partial histogram.
+ */
+__kernel void rps_stats(
+						UNIVERSE_T universe,
+						__global uint *partials) {
+
+	__local uint counts[STATS_BINS];
+
+	for(int i = get_local_id(0); i < STATS_BINS; i += get_local_size(0)) {
+		counts[i] = 0;
 	}
-	
-	neighbour_state = (int){read_imagef(universe, sampler, neighbour_coord).x * 255};
-	
-	current_fstate = read_imagef(universe, sampler, fcoord).x;
-	current_istate = (int){current_fstate * 255};
-	
-	// If current cell is empty, try fill it with neighbour's state
-	if(current_istate == 0) {
-		if(	neighbour_state != 0	&&
-			neighbour_state != 10	&&
-			neighbour_state != 20	&&
-			neighbour_state != 30	) {
-			current_istate = neighbour_state - 1;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	uint bins[STATS_BINS];
+	for(int i = 0; i < STATS_BINS; i++) {
+		bins[i] = 0;
+	}
+
+	for(uint i = get_global_id(0); i < WIDTH * HEIGHT; i += get_global_size(0)) {
+		int x = i % WIDTH;
+		int y = i / WIDTH;
+		uint state = LOAD_STATE(x, y);
+		bins[state / RULE_HEALTH]++;
+		if(state) {
+			bins[STATS_SPECIES + state % RULE_HEALTH]++;
 		}
 	}
-	
-	// If it is rock / red
-	else if(current_istate < 20) {
-		// If neighbour is paper / green
-		if(neighbour_state < 30 && neighbour_state >= 20) {
-			current_istate = current_istate - 1;
-			// If current cell is eliminated, change it to paper / green
-			if(current_istate < 10) {
-				current_istate = 29;
-			}
+
+	for(int i = 0; i < STATS_BINS; i++) {
+		if(bins[i]) {
+			atomic_add(&counts[i], bins[i]);
 		}
 	}
-	
-	// If it is paper / green
-	else if(current_istate < 30) {
-		// If neighbour is scissors / blue
-		if(neighbour_state < 40 && neighbour_state >= 30) {
-			current_istate = current_istate - 1;
-			// If current cell is eliminated, change it to scissors / blue
-			if(current_istate < 20) {
-				current_istate = 39;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(int i = get_local_id(0); i < STATS_BINS; i += get_local_size(0)) {
+		partials[get_group_id(0) * STATS_BINS + i] = counts[i];
+	}
+}
+
+/*
+ * Global pass: one work-item per bin sums the partial histograms into a sample slot
+ */
+__kernel void rps_stats_sum(
+						__global const uint *partials,
+						uint groups,
+						__global uint *samples,
+						uint slot) {
+
+	int bin = get_global_id(0);
+	if(bin >= STATS_BINS) {
+		return;
+	}
+
+	uint sum = 0;
+	for(uint i = 0; i < groups; i++) {
+		sum += partials[i * STATS_BINS + bin];
+	}
+	samples[slot * STATS_BINS + bin] = sum;
+}
+
+/*
+ * Snapshot packing: rule sets of up to 64 states fit in 6 bits, four cells in row major order
+ * make three bytes. One work-item per group of four cells.
+ */
+#define PACKED_CELLS	(WIDTH * HEIGHT)
+
+__kernel void rps_pack(
+						UNIVERSE_T universe,
+						__global uchar *packed) {
+
+	uint group = get_global_id(0);
+	if(group * 4 >= PACKED_CELLS) {
+		return;
+	}
+
+	uint bits = 0;
+	for(uint i = 0; i < 4; i++) {
+		uint cell = group * 4 + i;
+		if(cell < PACKED_CELLS) {
+			int x = cell % WIDTH;
+			int y = cell / WIDTH;
+			bits |= (LOAD_STATE(x, y) & 0x3f) << (6 * i);
+		}
+	}
+
+	packed[group * 3 + 0] = bits;
+	packed[group * 3 + 1] = bits >> 8;
+	packed[group * 3 + 2] = bits >> 16;
+}
+
+__kernel void rps_unpack(
+						__global const uchar *packed,
+						OUTPUT_T output) {
+
+	uint group = get_global_id(0);
+	if(group * 4 >= PACKED_CELLS) {
+		return;
+	}
+
+	uint bits = packed[group * 3] | packed[group * 3 + 1] << 8 | packed[group * 3 + 2] << 16;
+	for(uint i = 0; i < 4; i++) {
+		uint cell = group * 4 + i;
+		if(cell < PACKED_CELLS) {
+			int x = cell % WIDTH;
+			int y = cell / WIDTH;
+			STORE_STATE(x, y, (bits >> (6 * i)) & 0x3f);
+		}
+	}
+}
+
+/*
+ * Slab of a world split across devices: a band of rows starting at row_offset,
+ * stored in a padded buffer whose first and last rows are halos copied from the
+ * neighbouring slabs (or the mirrored / empty rows past the edge).
+ * Work-items update padded rows from first_row on, random numbers are keyed
+ * on global rows so any split matches the single device run.
+ */
+__kernel void rps_slab(
+						__global const uchar *universe,
+						__global uchar *output,
+						ulong seed,
+						ulong generation,
+						uint row_offset,
+						uint first_row) {
+
+	int x = get_global_id(0);
+	int ly = first_row + get_global_id(1);
+	if(x >= WIDTH) {
+		return;
+	}
+
+	int y = row_offset + ly - 1;
+	uint direction = ruleDirection(seed, generation, x, y);
+	int nx = boundaryCoord(x + RULE_DX(direction, y), WIDTH, BOUNDARY);
+	int ny = ly + RULE_DY(direction, y);
+
+	int neighbour = nx < 0 ? 0 : universe[ny * WIDTH + nx];
+	output[ly * WIDTH + x] = rpsRule(universe[ly * WIDTH + x], neighbour);
+}
+
+/*
+ * Starting world of the own rows of a slab buffer, the out-of-core bands are built one at a time
+ */
+__kernel void rps_init_slab(
+						__global uchar *output,
+						InitParams params,
+						ulong seed,
+						uint row_offset) {
+
+	int x = get_global_id(0);
+	int ly = 1 + get_global_id(1);
+	if(x >= WIDTH) {
+		return;
+	}
+	output[ly * WIDTH + x] = initCell(&params, seed, x, row_offset + ly - 1);
+}
+
+/*
+ * Ensemble of independent worlds in one strided buffer, world z at z * WIDTH * HEIGHT,
+ * stepped together by one 3D NDRange. Every world has its own seed.
+ */
+#define WORLD_CELLS		(WIDTH * HEIGHT)
+
+__kernel void rps_ensemble(
+						__global const uchar *universe,
+						__global uchar *output,
+						__global const ulong *seeds,
+						ulong generation) {
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	size_t world = get_global_id(2) * (size_t) WORLD_CELLS;
+
+	// Work-items past the edge of a rounded up NDRange
+	if(x >= WIDTH || y >= HEIGHT) {
+		return;
+	}
+
+	uint direction = ruleDirection(seeds[get_global_id(2)], generation, x, y);
+	int nx = boundaryCoord(x + RULE_DX(direction, y), WIDTH, BOUNDARY);
+	int ny = boundaryCoord(y + RULE_DY(direction, y), HEIGHT, BOUNDARY);
+
+	int neighbour = (nx < 0 || ny < 0) ? 0 : universe[world + ny * WIDTH + nx];
+	int current = universe[world + y * WIDTH + x];
+
+	output[world + y * WIDTH + x] = rpsRule(current, neighbour);
+}
+
+/*
+ * Population statistics of every world of an ensemble, one work-group per world,
+ * counted like rps_stats into counts[world * STATS_BINS]
+ */
+__kernel void rps_ensemble_stats(
+						__global const uchar *universe,
+						__global uint *counts) {
+
+	__local uint group_counts[STATS_BINS];
+	__global const uchar *world = universe + get_group_id(0) * (size_t) WORLD_CELLS;
+
+	for(int i = get_local_id(0); i < STATS_BINS; i += get_local_size(0)) {
+		group_counts[i] = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	uint bins[STATS_BINS];
+	for(int i = 0; i < STATS_BINS; i++) {
+		bins[i] = 0;
+	}
+
+	for(uint i = get_local_id(0); i < WORLD_CELLS; i += get_local_size(0)) {
+		uint state = world[i];
+		bins[state / RULE_HEALTH]++;
+		if(state) {
+			bins[STATS_SPECIES + state % RULE_HEALTH]++;
+		}
+	}
+
+	for(int i = 0; i < STATS_BINS; i++) {
+		if(bins[i]) {
+			atomic_add(&group_counts[i], bins[i]);
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(int i = get_local_id(0); i < STATS_BINS; i += get_local_size(0)) {
+		counts[get_group_id(0) * STATS_BINS + i] = group_counts[i];
+	}
+}
+
+/*
+ * Batched edits: one work-group per operation scatters its state over the cells
+ * it covers. Operations of one launch never overlap with a different state,
+ * the host splits the batch where they would.
+ */
+inline void editCell(OUTPUT_T output, int x, int y, uint state) {
+	if(x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT) {
+		STORE_STATE(x, y, state);
+	}
+}
+
+// a / b rounded to nearest, b > 0
+inline int roundDiv(int a, int b) {
+	return a >= 0 ? (2 * a + b) / (2 * b) : -((-2 * a + b) / (2 * b));
+}
+
+__kernel void rps_edit(
+						OUTPUT_T output,
+						__global const EditOp *ops,
+						uint first_op,
+						ulong seed) {
+
+	const EditOp op = ops[first_op + get_group_id(0)];
+	const int items = get_local_size(0);
+
+	if(op.type == EDIT_LINE) {
+		// One cell per step along the major axis
+		const int dx = op.x1 - op.x0;
+		const int dy = op.y1 - op.y0;
+		const int steps = max(abs(dx), abs(dy));
+		for(int i = get_local_id(0); i <= steps; i += items) {
+			editCell(output, op.x0 + (steps ? roundDiv(i * dx, steps) : 0), op.y0 + (steps ? roundDiv(i * dy, steps) : 0), op.state);
+		}
+		return;
+	}
+
+	// Bounding box clipped to the world
+	int min_x, min_y, max_x, max_y;
+	if(op.type == EDIT_CIRCLE || op.type == EDIT_SPRAY) {
+		min_x = op.x0 - op.x1;	max_x = op.x0 + op.x1;
+		min_y = op.y0 - op.x1;	max_y = op.y0 + op.x1;
+	} else if(op.type == EDIT_RECT) {
+		min_x = min(op.x0, op.x1);	max_x = max(op.x0, op.x1);
+		min_y = min(op.y0, op.y1);	max_y = max(op.y0, op.y1);
+	} else {
+		min_x = max_x = op.x0;
+		min_y = max_y = op.y0;
+	}
+	min_x = max(min_x, 0);	max_x = min(max_x, WIDTH - 1);
+	min_y = max(min_y, 0);	max_y = min(max_y, HEIGHT - 1);
+	if(min_x > max_x || min_y > max_y) {
+		return;
+	}
+
+	const int box_width = max_x - min_x + 1;
+	const int cells = box_width * (max_y - min_y + 1);
+	for(int i = get_local_id(0); i < cells; i += items) {
+		int x = min_x + i % box_width;
+		int y = min_y + i / box_width;
+
+		if(op.type == EDIT_CIRCLE || op.type == EDIT_SPRAY) {
+			int rx = x - op.x0;
+			int ry = y - op.y0;
+			if(rx * rx + ry * ry > op.x1 * op.x1) {
+				continue;
+			}
+			if(op.type == EDIT_SPRAY && rngCell(seed, EDIT_SPRAY_GENERATION(op.serial), x, y) >= op.density) {
+				continue;
 			}
 		}
+		STORE_STATE(x, y, op.state);
 	}
-	
-	// If it is scissor / blue
-	else if(current_istate < 40) {
-		// If neighbour is rock / red
-		if(neighbour_state < 20 && neighbour_state >= 10) {
-			current_istate = current_istate - 1;
-			// If current cell is eliminated, change it to rock / red
-			if(current_istate < 30) {
-				current_istate = 19;
+}
+
+/*
+ * Build the starting world from a generator's parameter block, one work-item per cell
+ */
+__kernel void rps_init(
+						OUTPUT_T output,
+						InitParams params,
+						ulong seed) {
+
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	if(x >= WIDTH || y >= HEIGHT) {
+		return;
+	}
+	STORE_STATE(x, y, initCell(&params, seed, x, y));
+}
+
+/*
+ * Zoom-out pyramid for the display. A texel of level k covers 2^k x 2^k cells and holds
+ * the dominant species of the block and its density of living cells as a normalized RG pair.
+ * The first stored level counts the cells of its blocks, every further level merges 2x2
+ * texels of the one below, the species weighted by their densities.
+ */
+inline int dominantSpecies(const float *weights) {
+	int dominant = 0;
+	float best = 0.0f;
+	for(int s = 1; s <= RULE_SPECIES; s++) {
+		if(weights[s] > best) {
+			dominant = s;
+			best = weights[s];
+		}
+	}
+	return dominant;
+}
+
+__kernel void rps_lod_cells(
+						UNIVERSE_T universe,
+						__write_only image2d_t level,
+						uint block) {
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if(x >= get_image_width(level) || y >= get_image_height(level)) {
+		return;
+	}
+
+	float weights[RULE_SPECIES + 1];
+	for(int s = 0; s <= RULE_SPECIES; s++) {
+		weights[s] = 0.0f;
+	}
+
+	// Blocks on the right and top edges may be cut off by the world
+	const int max_x = min((int) ((x + 1) * block), WIDTH);
+	const int max_y = min((int) ((y + 1) * block), HEIGHT);
+	for(int cy = y * block; cy < max_y; cy++) {
+		for(int cx = x * block; cx < max_x; cx++) {
+			weights[LOAD_STATE(cx, cy) / RULE_HEALTH] += 1.0f;
+		}
+	}
+
+	const float cells = (max_x - x * (int) block) * (max_y - y * (int) block);
+	write_imagef(level, (int2){x, y}, (float4){dominantSpecies(weights) / 255.0f, 1.0f - weights[0] / cells, 0.0f, 0.0f});
+}
+
+__kernel void rps_lod(
+						__read_only image2d_t finer,
+						__write_only image2d_t level) {
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if(x >= get_image_width(level) || y >= get_image_height(level)) {
+		return;
+	}
+
+	float weights[RULE_SPECIES + 1];
+	for(int s = 0; s <= RULE_SPECIES; s++) {
+		weights[s] = 0.0f;
+	}
+
+	float density = 0.0f;
+	int texels = 0;
+	for(int dy = 0; dy < 2; dy++) {
+		for(int dx = 0; dx < 2; dx++) {
+			int2 coord = (int2){2 * x + dx, 2 * y + dy};
+			if(coord.x < get_image_width(finer) && coord.y < get_image_height(finer)) {
+				float4 texel = read_imagef(finer, cell_sampler, coord);
+				weights[(int) (texel.x * 255.0f + 0.5f)] += texel.y;
+				density += texel.y;
+				texels++;
 			}
 		}
 	}
-	
-	// Transfor state back to float
-	current_fstate = (float){current_istate / 255.0};
-	
-	// Write out new state, and random seed
-	write_imagef(output, icoord, current_fstate);
-	random[get_global_id(1) * WIDTH + get_global_id(0)] = rnd;
-}
\ No newline at end of file
+
+	write_imagef(level, (int2){x, y}, (float4){dominantSpecies(weights) / 255.0f, density / texels, 0.0f, 0.0f});
+}
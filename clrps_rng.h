@@ -0,0 +1,74 @@
+/*
+ * Counter based random numbers shared by the kernels and the native engine.
+ * Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"),
+ * keyed on the 64 bit seed, counting on (x / 4, y, generation). One block
+ * gives the words of four neighbouring cells in a row, so every cell of
+ * every generation gets its own number without any stored state.
+ */
+#ifndef CLRPS_RNG_H
+#define CLRPS_RNG_H
+
+#ifdef __OPENCL_VERSION__
+	#define RNG_UINT			uint
+	#define RNG_ULONG			ulong
+	#define RNG_INLINE			inline
+	#define RNG_MULHI(a, b)		mul_hi((uint) (a), (uint) (b))
+#else
+	#include <stdint.h>
+	#define RNG_UINT			uint32_t
+	#define RNG_ULONG			uint64_t
+	#define RNG_INLINE			static inline
+	#define RNG_MULHI(a, b)		((uint32_t) (((uint64_t) (a) * (uint32_t) (b)) >> 32))
+#endif
+
+// Counter used for the initial world, never reached by a running simulation
+#define RNG_INIT_GENERATION		(~(RNG_ULONG) 0)
+
+#define PHILOX_M0	0xD2511F53U
+#define PHILOX_M1	0xCD9E8D57U
+#define PHILOX_W0	0x9E3779B9U
+#define PHILOX_W1	0xBB67AE85U
+
+/*
+ * Philox4x32-10 block for cells (4 * block_x .. 4 * block_x + 3, y) of a generation
+ */
+RNG_INLINE void rngBlock(RNG_ULONG seed, RNG_ULONG generation, RNG_UINT block_x, RNG_UINT y, RNG_UINT *words) {
+	RNG_UINT c0 = block_x, c1 = y, c2 = (RNG_UINT) generation, c3 = (RNG_UINT) (generation >> 32);
+	RNG_UINT k0 = (RNG_UINT) seed, k1 = (RNG_UINT) (seed >> 32);
+
+	for(int round = 0; round < 10; round++) {
+		RNG_UINT hi0 = RNG_MULHI(PHILOX_M0, c0), lo0 = PHILOX_M0 * c0;
+		RNG_UINT hi1 = RNG_MULHI(PHILOX_M1, c2), lo1 = PHILOX_M1 * c2;
+
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	words[0] = c0;
+	words[1] = c1;
+	words[2] = c2;
+	words[3] = c3;
+}
+
+/*
+ * Random word of a single cell in a generation
+ */
+RNG_INLINE RNG_UINT rngCell(RNG_ULONG seed, RNG_ULONG generation, RNG_UINT x, RNG_UINT y) {
+	RNG_UINT words[4];
+	rngBlock(seed, generation, x >> 2, y, words);
+	return words[x & 3];
+}
+
+/*
+ * Uniform choice 0..count - 1 from a random word, the top bits for powers of two
+ */
+RNG_INLINE RNG_UINT rngChoice(RNG_UINT word, RNG_UINT count) {
+	return RNG_MULHI(word, count);
+}
+
+#endif //CLRPS_RNG_H
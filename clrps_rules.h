@@ -0,0 +1,167 @@
+/*
+ * Cyclic dominance rules shared by the kernels and the native engine.
+ * logic source:
+ * www.gamedev.net/blog/844/entry-2249737-another-cellular-automaton-video/
+ *
+ * The rule set is fixed at build time: the RULE_* macros below default to
+ * rock, paper, scissors and are overridden with -D, see CMakeLists.txt.
+ * loadProgram() passes the host's values on to every kernel build and
+ * ruleShaderDefines() to the display shader, so nothing interprets rules at runtime.
+ */
+#ifndef CLRPS_RULES_H
+#define CLRPS_RULES_H
+
+#include "clrps_rng.h"
+
+#ifdef __OPENCL_VERSION__
+	#define RULES_INLINE		inline
+	#define RULES_CONSTANT		__constant
+#else
+	#define RULES_INLINE		static inline
+	#define RULES_CONSTANT		static const
+#endif
+
+// Boundary conditions
+#define BOUNDARY_PERIODIC		0
+#define BOUNDARY_REFLECTIVE		1
+#define BOUNDARY_FIXED			2
+
+// Neighbourhoods a cell picks its random neighbour from
+#define NEIGHBOURHOOD_MOORE			0	// all 8 surrounding cells
+#define NEIGHBOURHOOD_VON_NEUMANN	1	// the 4 edge neighbours
+#define NEIGHBOURHOOD_HEX			2	// 6 neighbours, odd rows shifted half a cell right
+
+// How an empty cell is taken by its neighbour
+#define FILL_DECAY				0	// one health level lower, cells at health 0 do not spread
+#define FILL_CLONE				1	// an exact copy
+
+// Species in the dominance ring, rock, paper, scissors by default
+#ifndef RULE_SPECIES
+	#define RULE_SPECIES		3
+#endif
+// Health levels of a cell
+#ifndef RULE_HEALTH
+	#define RULE_HEALTH			10
+#endif
+// Every species is beaten by the next RULE_PREDATORS species around the ring,
+// e.g. 2 of 5 for rock, paper, scissors, lizard, Spock
+#ifndef RULE_PREDATORS
+	#define RULE_PREDATORS		1
+#endif
+#ifndef RULE_NEIGHBOURHOOD
+	#define RULE_NEIGHBOURHOOD	NEIGHBOURHOOD_MOORE
+#endif
+#ifndef RULE_FILL
+	#define RULE_FILL			FILL_DECAY
+#endif
+
+/*
+ * Cell states: 0 is empty, species s (1..RULE_SPECIES) at health h is s * RULE_HEALTH + h.
+ * With the defaults 10..19 are rock, 20..29 paper and 30..39 scissors.
+ */
+#define RULE_STATES				((RULE_SPECIES + 1) * RULE_HEALTH)
+
+#if RULE_STATES > 256
+	#error "Cell states have to fit in a byte"
+#endif
+#if RULE_SPECIES < 2 || RULE_PREDATORS < 1 || RULE_PREDATORS >= RULE_SPECIES
+	#error "RULE_PREDATORS has to be 1 .. RULE_SPECIES - 1"
+#endif
+
+// Population statistics bins: empty cells and every species, then living cells by health
+#define STATS_SPECIES			(RULE_SPECIES + 1)
+#define STATS_BINS				(STATS_SPECIES + RULE_HEALTH)
+
+/*
+ * Moore offsets, also the neighbouring tiles of the active kernel
+ */
+RULES_CONSTANT int neighbour_dx[8] = { 1,  0, -1,  1, -1,  1,  0, -1};
+RULES_CONSTANT int neighbour_dy[8] = {-1, -1, -1,  0,  0,  1,  1,  1};
+
+/*
+ * Offsets of the rule's neighbourhood indexed by [row parity][direction],
+ * only the hex grid differs between even and odd rows
+ */
+#if RULE_NEIGHBOURHOOD == NEIGHBOURHOOD_MOORE
+	#define RULE_DIRECTIONS		8
+	RULES_CONSTANT int rule_dx[2][8] = {{ 1,  0, -1,  1, -1,  1,  0, -1}, { 1,  0, -1,  1, -1,  1,  0, -1}};
+	RULES_CONSTANT int rule_dy[2][8] = {{-1, -1, -1,  0,  0,  1,  1,  1}, {-1, -1, -1,  0,  0,  1,  1,  1}};
+#elif RULE_NEIGHBOURHOOD == NEIGHBOURHOOD_VON_NEUMANN
+	#define RULE_DIRECTIONS		4
+	RULES_CONSTANT int rule_dx[2][4] = {{ 0, -1,  1,  0}, { 0, -1,  1,  0}};
+	RULES_CONSTANT int rule_dy[2][4] = {{-1,  0,  0,  1}, {-1,  0,  0,  1}};
+#elif RULE_NEIGHBOURHOOD == NEIGHBOURHOOD_HEX
+	#define RULE_DIRECTIONS		6
+	RULES_CONSTANT int rule_dx[2][6] = {{ 1, -1, -1,  0, -1,  0}, { 1, -1,  0,  1,  0,  1}};
+	RULES_CONSTANT int rule_dy[2][6] = {{ 0,  0, -1, -1,  1,  1}, { 0,  0, -1, -1,  1,  1}};
+#else
+	#error "Unknown RULE_NEIGHBOURHOOD"
+#endif
+
+#define RULE_DX(direction, y)	rule_dx[(y) & 1][direction]
+#define RULE_DY(direction, y)	rule_dy[(y) & 1][direction]
+
+/*
+ * Neighbour direction of a cell from its random word
+ */
+RULES_INLINE int wordDirection(RNG_UINT word) {
+	return rngChoice(word, RULE_DIRECTIONS);
+}
+
+RULES_INLINE int ruleDirection(RNG_ULONG seed, RNG_ULONG generation, RNG_UINT x, RNG_UINT y) {
+	return wordDirection(rngCell(seed, generation, x, y));
+}
+
+/*
+ * Initial state of a cell: empty or one of the species at full health with equal odds
+ */
+RULES_INLINE int ruleInitialState(RNG_ULONG seed, RNG_UINT x, RNG_UINT y) {
+	int species = rngChoice(rngCell(seed, RNG_INIT_GENERATION, x, y), RULE_SPECIES + 1);
+	return species == 0 ? 0 : species * RULE_HEALTH + RULE_HEALTH - 1;
+}
+
+/*
+ * Map a coordinate at most one cell outside of [0, size) back into the world.
+ * Periodic wraps around, reflective mirrors at the edge (-1 reads 0, size reads size - 1,
+ * CL_ADDRESS_MIRRORED_REPEAT at texel centres), fixed returns -1: the cell outside is
+ * permanently empty.
+ */
+RULES_INLINE int boundaryCoord(int coord, int size, int boundary) {
+	if(coord >= 0 && coord < size) {
+		return coord;
+	}
+	if(boundary == BOUNDARY_PERIODIC) {
+		return coord < 0 ? coord + size : coord - size;
+	}
+	if(boundary == BOUNDARY_REFLECTIVE) {
+		return coord < 0 ? -coord - 1 : 2 * size - coord - 1;
+	}
+	return -1;
+}
+
+/*
+ * New state of a cell given its chosen neighbour.
+ * An empty cell is filled by its neighbour, a living one loses a health level
+ * to a predator and becomes one at full health once it had none left.
+ */
+RULES_INLINE int rpsRule(int current, int neighbour) {
+	const int species = current / RULE_HEALTH;
+	const int other = neighbour / RULE_HEALTH;
+
+	if(species == 0) {
+#if RULE_FILL == FILL_DECAY
+		return neighbour % RULE_HEALTH != 0 ? neighbour - 1 : 0;
+#else
+		return neighbour;
+#endif
+	}
+
+	// Distance from the current species to the neighbour's around the ring
+	const int ahead = (other - species + RULE_SPECIES) % RULE_SPECIES;
+	if(other == 0 || ahead == 0 || ahead > RULE_PREDATORS) {
+		return current;
+	}
+	return current % RULE_HEALTH != 0 ? current - 1 : other * RULE_HEALTH + RULE_HEALTH - 1;
+}
+
+#endif //CLRPS_RULES_H
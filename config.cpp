@@ -0,0 +1,409 @@
+#include "config.hpp"
+#include "clrps_rules.h"
+#include "snapshot.hpp"
+
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+void defaultConfig(Config &config) {
+	config.width		= 1024;
+	config.height		= 1024;
+	config.cell			= 8;
+	config.fps			= 120;
+
+	config.steps		= 1;
+	config.max_steps	= 4096;
+	config.turbo		= false;
+
+	config.launch.kernel		= "float";
+	config.launch.tile_width	= 32;
+	config.launch.tile_height	= 8;
+	config.launch.coarsen		= 4;
+	config.launch.local_width	= 0;
+	config.launch.local_height	= 0;
+	config.boundary				= BOUNDARY_PERIODIC;
+
+	config.launch_set	= false;
+	config.autotune		= false;
+	config.tune_cache	= "clrps_tune.cache";
+
+	config.stats_file	= "";
+	config.stats_every	= 1;
+
+	config.export_file		= "";
+	config.export_every		= 1;
+	config.export_format	= "y4m";
+	config.export_fps		= 30;
+
+	config.profile_file		= "";
+	config.profile_format	= "csv";
+	config.overlay			= false;
+
+	config.init				= "uniform";
+	config.init_densities	= "";
+	config.init_count		= 0;
+	config.init_scale		= 32;
+
+	config.snapshot_file	= "clrps.snap";
+	config.restore_file		= "";
+	config.edit_script		= "";
+
+	config.headless		= false;
+	config.backend		= "cl";
+	config.slabs		= "";
+	config.ensemble		= 0;
+	config.out_of_core	= "";
+	config.band_budget	= 256;
+	config.platform		= 0;
+	config.device		= 0;
+	config.generations	= 1000;
+	config.threads		= 0;
+	config.temporal		= 1;
+	config.seed			= time(NULL);
+}
+
+static bool parseNumber(const string &value, unsigned long long &number) {
+	char *end;
+	number = strtoull(value.c_str(), &end, 0);
+	return !value.empty() && *end == '\0';
+}
+
+static bool parseNumber(const string &value, unsigned int &number) {
+	unsigned long long wide;
+	if(!parseNumber(value, wide) || wide > 0xffffffffULL) {
+		return false;
+	}
+	number = wide;
+	return true;
+}
+
+static bool parseBool(const string &value, bool &flag) {
+	if(value == "1" || value == "true" || value == "yes" || value == "on") {
+		flag = true;
+	} else if(value == "0" || value == "false" || value == "no" || value == "off") {
+		flag = false;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static bool parseBoundary(const string &value, int &boundary) {
+	if(value == "periodic") {
+		boundary = BOUNDARY_PERIODIC;
+	} else if(value == "reflective") {
+		boundary = BOUNDARY_REFLECTIVE;
+	} else if(value == "fixed") {
+		boundary = BOUNDARY_FIXED;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Parse "WxH" or a single edge length for square worlds
+ */
+static bool parseSize(const string &value, unsigned int &width, unsigned int &height) {
+	size_t split = value.find('x');
+	if(split == string::npos) {
+		return parseNumber(value, width) && parseNumber(value, height);
+	}
+	return parseNumber(value.substr(0, split), width) && parseNumber(value.substr(split + 1), height);
+}
+
+bool setOption(Config &config, const string &key, const string &value) {
+	bool valid;
+
+	if(key == "size") {
+		valid = parseSize(value, config.width, config.height);
+	} else if(key == "width") {
+		valid = parseNumber(value, config.width);
+	} else if(key == "height") {
+		valid = parseNumber(value, config.height);
+	} else if(key == "cell") {
+		valid = parseNumber(value, config.cell) && config.cell > 0;
+	} else if(key == "fps") {
+		valid = parseNumber(value, config.fps) && config.fps > 0;
+	} else if(key == "steps") {
+		valid = parseNumber(value, config.steps) && config.steps > 0;
+	} else if(key == "max-steps") {
+		valid = parseNumber(value, config.max_steps) && config.max_steps > 0;
+	} else if(key == "turbo") {
+		valid = parseBool(value, config.turbo);
+	} else if(key == "kernel") {
+		valid = value == "float" || value == "int" || value == "tiled" || value == "active";
+		config.launch.kernel = value;
+		config.launch_set = true;
+	} else if(key == "boundary") {
+		valid = parseBoundary(value, config.boundary);
+	} else if(key == "tile") {
+		valid = parseSize(value, config.launch.tile_width, config.launch.tile_height) && config.launch.tile_width > 0 && config.launch.tile_height > 0;
+		config.launch_set = true;
+	} else if(key == "coarsen") {
+		valid = parseNumber(value, config.launch.coarsen) && config.launch.coarsen > 0;
+		config.launch_set = true;
+	} else if(key == "local") {
+		valid = parseSize(value, config.launch.local_width, config.launch.local_height);
+		config.launch_set = true;
+	} else if(key == "autotune") {
+		valid = parseBool(value, config.autotune);
+	} else if(key == "tune-cache") {
+		config.tune_cache = value;
+		valid = true;
+	} else if(key == "stats") {
+		config.stats_file = value;
+		valid = true;
+	} else if(key == "stats-every") {
+		valid = parseNumber(value, config.stats_every) && config.stats_every > 0;
+	} else if(key == "export") {
+		config.export_file = value;
+		valid = true;
+	} else if(key == "export-every") {
+		valid = parseNumber(value, config.export_every) && config.export_every > 0;
+	} else if(key == "export-format") {
+		config.export_format = value;
+		valid = value == "y4m" || value == "ppm";
+	} else if(key == "export-fps") {
+		valid = parseNumber(value, config.export_fps) && config.export_fps > 0;
+	} else if(key == "profile") {
+		config.profile_file = value;
+		valid = true;
+	} else if(key == "profile-format") {
+		config.profile_format = value;
+		valid = value == "csv" || value == "chrome";
+	} else if(key == "overlay") {
+		valid = parseBool(value, config.overlay);
+	} else if(key == "init") {
+		config.init = value;
+		valid = value == "uniform" || value == "voronoi" || value == "stripes" || value == "spiral" || value == "clear";
+	} else if(key == "densities") {
+		config.init_densities = value;
+		valid = true;
+	} else if(key == "init-count") {
+		valid = parseNumber(value, config.init_count);
+	} else if(key == "init-scale") {
+		valid = parseNumber(value, config.init_scale) && config.init_scale > 0;
+	} else if(key == "snapshot") {
+		config.snapshot_file = value;
+		valid = true;
+	} else if(key == "restore") {
+		// The world takes the snapshot's shape, later options may still fork it (e.g. --seed)
+		SnapshotHeader header;
+		valid = readSnapshotHeader(value.c_str(), header);
+		if(valid) {
+			config.restore_file = value;
+			config.width = header.width;
+			config.height = header.height;
+			config.seed = header.seed;
+			config.boundary = header.boundary;
+		}
+	} else if(key == "edits") {
+		config.edit_script = value;
+		valid = true;
+	} else if(key == "slabs") {
+		config.slabs = value;
+		valid = value == "devices" || value == "numa";
+	} else if(key == "ensemble") {
+		valid = parseNumber(value, config.ensemble);
+	} else if(key == "out-of-core") {
+		config.out_of_core = value;
+		valid = !value.empty();
+	} else if(key == "band-budget") {
+		valid = parseNumber(value, config.band_budget) && config.band_budget > 0;
+	} else if(key == "platform") {
+		valid = parseNumber(value, config.platform);
+	} else if(key == "device") {
+		valid = parseNumber(value, config.device);
+	} else if(key == "backend") {
+		config.backend = value;
+		valid = value == "cl" || value == "gl";
+	} else if(key == "headless") {
+		valid = parseBool(value, config.headless);
+	} else if(key == "generations") {
+		valid = parseNumber(value, config.generations);
+	} else if(key == "threads") {
+		valid = parseNumber(value, config.threads);
+	} else if(key == "temporal") {
+		valid = parseNumber(value, config.temporal) && config.temporal > 0 && config.temporal <= MAX_TEMPORAL;
+	} else if(key == "seed") {
+		valid = parseNumber(value, config.seed);
+	} else if(key == "config") {
+		valid = loadConfigFile(config, value.c_str());
+	} else {
+		cerr << "Unknown option: " << key << endl;
+		return false;
+	}
+
+	if(!valid) {
+		cerr << "Invalid value for " << key << ": " << value << endl;
+		return false;
+	}
+
+	// The windowed limit is checked once all options are in, out-of-core runs go further
+	if(config.width == 0 || config.height == 0 || config.width > MAX_OUT_OF_CORE_SIZE || config.height > MAX_OUT_OF_CORE_SIZE) {
+		cerr << "Grid size must be between 1 and " << MAX_OUT_OF_CORE_SIZE << " cells per edge" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool validGridSize(const Config &config) {
+	const unsigned int max_size = config.out_of_core.empty() ? MAX_GRID_SIZE : MAX_OUT_OF_CORE_SIZE;
+	if(config.width == 0 || config.height == 0 || config.width > max_size || config.height > max_size) {
+		cerr << "Grid size must be between 1 and " << max_size << " cells per edge" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool validConfig(const Config &config) {
+	if(config.launch.tile_width % config.launch.coarsen != 0) {
+		cerr << "Tile width must be a multiple of the coarsening factor" << endl;
+		return false;
+	}
+	return validGridSize(config);
+}
+
+static string trim(const string &str) {
+	size_t first = str.find_first_not_of(" \t\r");
+	size_t last = str.find_last_not_of(" \t\r");
+	return first == string::npos ? string() : str.substr(first, last - first + 1);
+}
+
+bool loadConfigFile(Config &config, const char *file_path) {
+	ifstream file(file_path);
+	string line;
+	unsigned int line_number = 0;
+
+	if(!file) {
+		cerr << "Unable to open config file: " << file_path << endl;
+		return false;
+	}
+
+	while(getline(file, line)) {
+		line_number++;
+		line = trim(line.substr(0, line.find('#')));
+		if(line.empty()) {
+			continue;
+		}
+
+		size_t split = line.find('=');
+		if(split == string::npos) {
+			cerr << file_path << ":" << line_number << ": expected key = value" << endl;
+			return false;
+		}
+		if(!setOption(config, trim(line.substr(0, split)), trim(line.substr(split + 1)))) {
+			cerr << file_path << ":" << line_number << ": invalid setting" << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool parseArguments(Config &config, int argc, char **argv) {
+	for(int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if(arg.compare(0, 2, "--") != 0) {
+			cerr << "Unknown argument: " << arg << endl;
+			return false;
+		}
+		arg = arg.substr(2);
+
+		// Flags without value
+		if(arg == "headless") {
+			config.headless = true;
+			continue;
+		}
+		if(arg == "turbo") {
+			config.turbo = true;
+			continue;
+		}
+		if(arg == "autotune") {
+			config.autotune = true;
+			continue;
+		}
+		if(arg == "overlay") {
+			config.overlay = true;
+			continue;
+		}
+
+		// --key=value or --key value
+		size_t split = arg.find('=');
+		string key = arg.substr(0, split), value;
+		if(split != string::npos) {
+			value = arg.substr(split + 1);
+		} else if(i + 1 < argc) {
+			value = argv[++i];
+		} else {
+			cerr << "Missing value for --" << key << endl;
+			return false;
+		}
+
+		if(!setOption(config, key, value)) {
+			return false;
+		}
+	}
+
+	return validConfig(config);
+}
+
+void printUsage(const char *program) {
+	cerr << "Usage: " << program << " [options]" << endl
+		<< "  --config FILE         read key = value settings from FILE" << endl
+		<< "  --size WxH            world size in cells, up to " << MAX_GRID_SIZE << " per edge" << endl
+		<< "  --width N, --height N set one world edge" << endl
+		<< "  --cell N              initial cell size in pixels" << endl
+		<< "  --fps N               target frame rate" << endl
+		<< "  --steps N             generations per displayed frame" << endl
+		<< "  --turbo               adapt generations per frame to hold the frame rate" << endl
+		<< "  --max-steps N         upper limit for turbo mode" << endl
+		<< "  --kernel VARIANT      float, int (CL_UNSIGNED_INT8 data), tiled (local memory)" << endl
+		<< "                        or active (tiled, skipping settled tiles)" << endl
+		<< "  --tile WxH            tile size of the tiled and active kernels in cells" << endl
+		<< "  --coarsen N           cells per work-item of the tiled and active kernels" << endl
+		<< "  --local WxH           local size of the float and int kernels" << endl
+		<< "  --autotune            benchmark launch configurations and cache the best" << endl
+		<< "  --tune-cache FILE     tuned launches, used unless the launch is given explicitly" << endl
+		<< "  --stats FILE          log population statistics of the OpenCL engine as CSV" << endl
+		<< "  --stats-every N       generations between statistics samples" << endl
+		<< "  --export FILE         stream frames to FILE, or to a command with \"|command\"" << endl
+		<< "  --export-every N      generations between exported frames" << endl
+		<< "  --export-format FMT   y4m or ppm" << endl
+		<< "  --export-fps N        frame rate written to the y4m header" << endl
+		<< "  --profile FILE        write device command and host phase timings of the OpenCL backend" << endl
+		<< "  --profile-format FMT  csv or chrome (trace events for chrome://tracing and Perfetto)" << endl
+		<< "  --overlay             show p50 / p95 / p99 phase times on screen, toggled with the p key" << endl
+		<< "  --init PATTERN        starting world built on the device: uniform, voronoi, stripes, spiral or clear" << endl
+		<< "  --densities LIST      uniform: comma separated density of every species, empty cells fill the rest" << endl
+		<< "  --init-count N        voronoi sites (default 64), stripe shift per row or spiral windings" << endl
+		<< "  --init-scale N        stripe width or distance between spiral windings in cells" << endl
+		<< "  --snapshot FILE       snapshot saved with the s and restored with the l key" << endl
+		<< "  --restore FILE        start from a snapshot instead of a random world" << endl
+		<< "  --edits FILE          paint operations applied to the starting world, one per line:" << endl
+		<< "                        point X Y S, line X0 Y0 X1 Y1 S, rect X0 Y0 X1 Y1 S," << endl
+		<< "                        circle X Y R S, spray X Y R DENSITY S" << endl
+		<< "  --boundary MODE       periodic, reflective or fixed (empty) world edges" << endl
+		<< "  --backend API         cl (OpenCL, GL interop) or gl (GL 4.3 compute shaders, no OpenCL)" << endl
+		<< "  --headless            run the CPU engine without a window" << endl
+		<< "  --slabs MODE          headless OpenCL run split over all devices of the platform" << endl
+		<< "                        (devices) or over the NUMA nodes of its CPU (numa)" << endl
+		<< "  --ensemble K          headless OpenCL run of K independent worlds of --size," << endl
+		<< "                        seeded seed .. seed + K - 1, stepped by one launch" << endl
+		<< "  --out-of-core FILE    headless OpenCL run of a world kept in FILE, streamed through the device" << endl
+		<< "                        in bands; continues the world in FILE, creates it from --size and --init" << endl
+		<< "                        if missing. Worlds up to " << MAX_OUT_OF_CORE_SIZE << " cells per edge" << endl
+		<< "  --band-budget MB      device memory of the out-of-core bands (256)" << endl
+		<< "  --platform N          OpenCL platform of the slab, ensemble and out-of-core runs" << endl
+		<< "  --device N            OpenCL device of the ensemble and out-of-core runs" << endl
+		<< "  --generations N       generations to run in headless mode" << endl
+		<< "  --threads N           worker threads for the CPU engine" << endl
+		<< "  --temporal T          CPU engine: advance cache sized tiles T generations per pass (1.." << MAX_TEMPORAL << ")" << endl
+		<< "  --seed N              64 bit seed, runs are reproducible from it" << endl;
+}
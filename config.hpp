@@ -0,0 +1,125 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+#include <string>
+
+// Largest supported world edge
+#define MAX_GRID_SIZE	16384
+
+// Largest world edge of out-of-core runs, bounded by the disk rather than memory
+#define MAX_OUT_OF_CORE_SIZE	(1 << 20)
+
+// Most generations per temporally blocked CPU pass, the halo is as wide
+#define MAX_TEMPORAL	64
+
+/*
+ * Which rps kernel runs and how it is launched
+ */
+struct LaunchConfig {
+	std::string			kernel;						// "float", "int", "tiled" or "active"
+	unsigned int		tile_width, tile_height;	// tiled, active: cells per work-group
+	unsigned int		coarsen;					// tiled, active: cells per work-item
+	unsigned int		local_width, local_height;	// float, int: local size, 0 lets the runtime pick
+};
+
+/*
+ * Startup settings, filled from defaults, config files and the command line
+ */
+struct Config {
+	unsigned int		width, height;
+	unsigned int		cell;
+	unsigned int		fps;
+
+	// Generations per displayed frame, adapted to hold fps in turbo mode
+	unsigned int		steps;
+	unsigned int		max_steps;
+	bool				turbo;
+
+	// Kernel launch and BOUNDARY_* from clrps_rules.h
+	LaunchConfig		launch;
+	int					boundary;
+
+	// Launch tuning: set when the launch was given explicitly, which disables the tune cache
+	bool				launch_set;
+	bool				autotune;
+	std::string			tune_cache;
+
+	// Population statistics CSV, sampled every stats_every generations, empty for none
+	std::string			stats_file;
+	unsigned int		stats_every;
+
+	// Frame export every export_every generations as y4m or ppm, empty for none
+	std::string			export_file;
+	unsigned int		export_every;
+	std::string			export_format;
+	unsigned int		export_fps;
+
+	// Hot path timings as "csv" or "chrome" trace events, empty for none; on-screen percentiles
+	std::string			profile_file;
+	std::string			profile_format;
+	bool				overlay;
+
+	// Starting world generated on the device: "uniform", "voronoi", "stripes", "spiral" or "clear".
+	// Uniform takes comma separated species densities (equal odds if empty), count and scale
+	// are the Voronoi sites, stripe shift per row or spiral windings and the stripe or winding width.
+	std::string			init;
+	std::string			init_densities;
+	unsigned int		init_count;
+	unsigned int		init_scale;
+
+	// Snapshot written and read by the s / l keys, and one to start from
+	std::string			snapshot_file;
+	std::string			restore_file;
+
+	// Paint operations applied to the starting world, see loadEditScript()
+	std::string			edit_script;
+
+	bool				headless;
+
+	// Simulation backend of the windowed run: "cl" (OpenCL with GL interop) or "gl" (GL 4.3 compute shaders)
+	std::string			backend;
+
+	// Headless OpenCL run split into slabs: "devices", "numa" or empty for none
+	std::string			slabs;
+
+	// Headless ensemble of this many independent worlds, 0 for none
+	unsigned int		ensemble;
+
+	// Headless run of a world kept in this file and streamed through the device in bands,
+	// with at most band_budget MiB of device memory, empty for none
+	std::string			out_of_core;
+	unsigned int		band_budget;
+
+	// OpenCL platform and device of the headless runs
+	unsigned int		platform, device;
+
+	unsigned long long	generations;
+	unsigned int		threads;
+	// CPU engine generations per pass over cache sized tiles, 1 for a pass per generation
+	unsigned int		temporal;
+	unsigned long long	seed;
+};
+
+void defaultConfig(Config &config);
+
+/*
+ * Apply one "key = value" setting, keys are the long options without the dashes
+ */
+bool setOption(Config &config, const std::string &key, const std::string &value);
+
+bool loadConfigFile(Config &config, const char *file_path);
+bool parseArguments(Config &config, int argc, char **argv);
+
+/*
+ * Check the world size against the limit of the run the config asks for
+ */
+bool validGridSize(const Config &config);
+
+/*
+ * Check the settings that depend on each other, once all options are in
+ */
+bool validConfig(const Config &config);
+
+void printUsage(const char *program);
+
+#endif //CONFIG_HPP
@@ -0,0 +1,217 @@
+#include "cpu_engine.hpp"
+#include "clrps_rules.h"
+
+#include <algorithm>
+
+// Rows per work item, small enough to keep every core busy on 1k worlds
+#define TILE_ROWS	16
+
+// Smallest temporal tile, both edges grow to 16 cells per generation of a pass
+// so the recomputed halo stays a fraction of the tile
+#define TEMPORAL_TILE_W		256u
+#define TEMPORAL_TILE_H		64u
+
+/*
+ * Update a band of rows, applying the engine's boundary condition at the edges
+ */
+static void stepRows(CpuEngine &engine, unsigned int first_row, unsigned int last_row) {
+	const int width = engine.width;
+	const int height = engine.height;
+	const unsigned char *universe = &engine.universe[0];
+	unsigned char *update = &engine.update[0];
+
+	for(int y = first_row; y < (int) last_row; y++) {
+		// Rows above, at and below the current one, NULL outside of a fixed boundary
+		const unsigned char *rows[3];
+		for(int dy = -1; dy <= 1; dy++) {
+			int ny = boundaryCoord(y + dy, height, engine.boundary);
+			rows[dy + 1] = ny < 0 ? NULL : universe + (size_t) ny * width;
+		}
+		unsigned char *out = update + (size_t) y * width;
+		RNG_UINT words[4];
+
+		for(int x = 0; x < width; x++) {
+			// One random block serves four cells
+			if((x & 3) == 0) {
+				rngBlock(engine.seed, engine.generation, x >> 2, y, words);
+			}
+			unsigned int direction = wordDirection(words[x & 3]);
+			const unsigned char *row = rows[1 + RULE_DY(direction, y)];
+			int nx = boundaryCoord(x + RULE_DX(direction, y), width, engine.boundary);
+
+			out[x] = rpsRule(rows[1][x], (row == NULL || nx < 0) ? 0 : row[nx]);
+		}
+	}
+}
+
+void initCpuEngine(CpuEngine &engine, unsigned int width, unsigned int height, unsigned int threads, unsigned long long seed, int boundary) {
+	engine.width = width;
+	engine.height = height;
+	engine.boundary = boundary;
+	engine.tile_rows = TILE_ROWS;
+	engine.temporal_steps = 1;
+	engine.seed = seed;
+	engine.generation = 0;
+
+	engine.universe.assign((size_t) width * height, 0);
+	engine.update.assign((size_t) width * height, 0);
+
+	engine.pool = createThreadPool(threads);
+}
+
+void exitCpuEngine(CpuEngine &engine) {
+	destroyThreadPool(engine.pool);
+	engine.pool = NULL;
+
+	std::vector<unsigned char>().swap(engine.universe);
+	std::vector<unsigned char>().swap(engine.update);
+}
+
+/*
+ * Fill the universe evenly with empty, rock, paper and scissors cells at full health
+ */
+void randomizeCpuEngine(CpuEngine &engine) {
+	const unsigned int tiles = (engine.height + engine.tile_rows - 1) / engine.tile_rows;
+
+	parallelFor(engine.pool, tiles, [&](size_t tile) {
+		unsigned int first_row = tile * engine.tile_rows;
+		unsigned int last_row = std::min(first_row + engine.tile_rows, engine.height);
+		for(unsigned int y = first_row; y < last_row; y++) {
+			for(unsigned int x = 0; x < engine.width; x++) {
+				engine.universe[(size_t) y * engine.width + x] = ruleInitialState(engine.seed, x, y);
+			}
+		}
+	});
+}
+
+void clearCpuEngine(CpuEngine &engine) {
+	std::fill(engine.universe.begin(), engine.universe.end(), 0);
+}
+
+/*
+ * Advance the tile [x0, x1) x [y0, y1) by steps generations in a private copy of it
+ * and a halo steps cells wide, then write its cells into the update.
+ * The halo shrinks by a cell per generation, so the tile's own cells come out exactly
+ * as with single steps; halo cells are recomputed by every tile that reads them.
+ * Periodic worlds extend the copy across the edges, the others clip it to the world
+ * and map neighbours outside through boundaryCoord(), which stay inside the copy.
+ */
+static void stepTemporalTile(CpuEngine &engine, int x0, int y0, int x1, int y1, unsigned int steps, std::vector<unsigned char> *buffers) {
+	const int width = engine.width;
+	const int height = engine.height;
+	const bool periodic = engine.boundary == BOUNDARY_PERIODIC;
+
+	// Copied region in world coordinates, beyond the edges only when periodic
+	const int rx0 = periodic ? x0 - (int) steps : std::max(x0 - (int) steps, 0);
+	const int ry0 = periodic ? y0 - (int) steps : std::max(y0 - (int) steps, 0);
+	const int rx1 = periodic ? x1 + (int) steps : std::min(x1 + (int) steps, width);
+	const int ry1 = periodic ? y1 + (int) steps : std::min(y1 + (int) steps, height);
+	const int region_width = rx1 - rx0;
+
+	buffers[0].resize((size_t) region_width * (ry1 - ry0));
+	buffers[1].resize(buffers[0].size());
+	for(int y = ry0; y < ry1; y++) {
+		const int wy = (y % height + height) % height;
+		unsigned char *row = &buffers[0][(size_t) (y - ry0) * region_width];
+		int wx = (rx0 % width + width) % width;
+		for(int x = 0; x < region_width; x++) {
+			row[x] = engine.universe[(size_t) wy * width + wx];
+			if(++wx == width) {
+				wx = 0;
+			}
+		}
+	}
+
+	for(unsigned int k = 1; k <= steps; k++) {
+		const unsigned char *src = &buffers[(k - 1) & 1][0];
+		unsigned char *dst = &buffers[k & 1][0];
+		const RNG_ULONG generation = engine.generation + k - 1;
+
+		// Valid part after k generations, clipped like the copy
+		const int margin = steps - k;
+		const int cx0 = periodic ? x0 - margin : std::max(x0 - margin, 0);
+		const int cy0 = periodic ? y0 - margin : std::max(y0 - margin, 0);
+		const int cx1 = periodic ? x1 + margin : std::min(x1 + margin, width);
+		const int cy1 = periodic ? y1 + margin : std::min(y1 + margin, height);
+		for(int y = cy0; y < cy1; y++) {
+			const int wy = (y % height + height) % height;
+			int wx = (cx0 % width + width) % width;
+			int block = -1;
+			RNG_UINT words[4];
+
+			for(int x = cx0; x < cx1; x++) {
+				// Randomness of the world cell, one block serves four cells
+				if(wx >> 2 != block) {
+					block = wx >> 2;
+					rngBlock(engine.seed, generation, block, wy, words);
+				}
+				const unsigned int direction = wordDirection(words[wx & 3]);
+
+				// Neighbours keep their offset in the copy, parity follows the world row
+				int nx = x + RULE_DX(direction, wy);
+				int ny = y + RULE_DY(direction, wy);
+				bool outside = false;
+				if(!periodic) {
+					nx = boundaryCoord(nx, width, engine.boundary);
+					ny = boundaryCoord(ny, height, engine.boundary);
+					outside = nx < 0 || ny < 0;
+				}
+				const int neighbour = outside ? 0 : src[(ny - ry0) * region_width + nx - rx0];
+				dst[(size_t) (y - ry0) * region_width + x - rx0] = rpsRule(src[(size_t) (y - ry0) * region_width + x - rx0], neighbour);
+
+				if(++wx == width) {
+					wx = 0;
+				}
+			}
+		}
+	}
+
+	const unsigned char *result = &buffers[steps & 1][0];
+	for(int y = y0; y < y1; y++) {
+		std::copy(result + (size_t) (y - ry0) * region_width + x0 - rx0, result + (size_t) (y - ry0) * region_width + x1 - rx0,
+				engine.update.begin() + (size_t) y * width + x0);
+	}
+}
+
+/*
+ * Several generations in one pass over the world, tile by tile
+ */
+static void stepTemporal(CpuEngine &engine, unsigned int steps) {
+	const unsigned int tile_width = std::max(TEMPORAL_TILE_W, 16 * steps);
+	const unsigned int tile_height = std::max(TEMPORAL_TILE_H, 16 * steps);
+	const unsigned int tiles_x = (engine.width + tile_width - 1) / tile_width;
+	const unsigned int tiles_y = (engine.height + tile_height - 1) / tile_height;
+
+	parallelFor(engine.pool, tiles_x * tiles_y, [&](size_t tile) {
+		// Per worker, reused by all its tiles
+		static thread_local std::vector<unsigned char> buffers[2];
+
+		const unsigned int x0 = tile % tiles_x * tile_width;
+		const unsigned int y0 = tile / tiles_x * tile_height;
+		stepTemporalTile(engine, x0, y0, std::min(x0 + tile_width, engine.width), std::min(y0 + tile_height, engine.height), steps, buffers);
+	});
+
+	engine.universe.swap(engine.update);
+	engine.generation += steps;
+}
+
+void stepCpuEngine(CpuEngine &engine, unsigned int generations) {
+	const unsigned int tiles = (engine.height + engine.tile_rows - 1) / engine.tile_rows;
+
+	for(unsigned int i = 0; i < generations; ) {
+		const unsigned int steps = std::min(engine.temporal_steps, generations - i);
+		i += steps;
+		if(steps > 1) {
+			stepTemporal(engine, steps);
+			continue;
+		}
+
+		parallelFor(engine.pool, tiles, [&](size_t tile) {
+			unsigned int first_row = tile * engine.tile_rows;
+			stepRows(engine, first_row, std::min(first_row + engine.tile_rows, engine.height));
+		});
+
+		engine.universe.swap(engine.update);
+		engine.generation++;
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef CPU_ENGINE_HPP
+#define CPU_ENGINE_HPP
+
+#include <vector>
+
+#include "thread_pool.hpp"
+
+/*
+ * Native rock, paper, scissors engine, one byte per cell.
+ * Cell states and rules follow the kernel, see clrps_rules.h.
+ */
+struct CpuEngine {
+	unsigned int				width, height;
+	unsigned int				tile_rows;
+	int							boundary;
+
+	// Generations per pass over cache sized tiles, 1 steps the whole world per generation
+	unsigned int				temporal_steps;
+
+	unsigned long long			seed;
+	unsigned long long			generation;
+
+	std::vector<unsigned char>	universe, update;
+
+	ThreadPool					*pool;
+};
+
+void initCpuEngine(CpuEngine &engine, unsigned int width, unsigned int height, unsigned int threads, unsigned long long seed, int boundary);
+void exitCpuEngine(CpuEngine &engine);
+
+void randomizeCpuEngine(CpuEngine &engine);
+void clearCpuEngine(CpuEngine &engine);
+
+void stepCpuEngine(CpuEngine &engine, unsigned int generations);
+
+#endif //CPU_ENGINE_HPP
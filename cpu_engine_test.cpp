@@ -0,0 +1,55 @@
+/*
+ * Temporal blocking has to match single generation steps bit for bit,
+ * on every boundary, at sizes that leave partial tiles at both edges
+ */
+#include "cpu_engine.hpp"
+#include "clrps_rules.h"
+
+#include <iostream>
+
+// Not a multiple of any of the tested pass lengths, so the last pass is shorter
+#define TEST_GENERATIONS	41
+
+static bool compare(unsigned int width, unsigned int height, int boundary, unsigned int temporal_steps) {
+	CpuEngine reference, blocked;
+	initCpuEngine(reference, width, height, 4, 12345, boundary);
+	initCpuEngine(blocked, width, height, 4, 12345, boundary);
+	blocked.temporal_steps = temporal_steps;
+	randomizeCpuEngine(reference);
+	blocked.universe = reference.universe;
+
+	stepCpuEngine(reference, TEST_GENERATIONS);
+	stepCpuEngine(blocked, TEST_GENERATIONS);
+
+	size_t differences = 0;
+	for(size_t i = 0; i < reference.universe.size(); i++) {
+		differences += reference.universe[i] != blocked.universe[i];
+	}
+	const bool passed = differences == 0 && reference.generation == blocked.generation;
+	if(!passed) {
+		std::cerr << width << "x" << height << " boundary " << boundary << " temporal " << temporal_steps
+				<< ": " << differences << " cells differ" << std::endl;
+	}
+
+	exitCpuEngine(reference);
+	exitCpuEngine(blocked);
+	return passed;
+}
+
+int main() {
+	const unsigned int sizes[][2] = {{37, 23}, {517, 301}, {3, 261}, {1, 1}};
+	const int boundaries[] = {BOUNDARY_PERIODIC, BOUNDARY_REFLECTIVE, BOUNDARY_FIXED};
+	const unsigned int temporal_steps[] = {2, 3, 8, 17};
+
+	bool passed = true;
+	for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for(size_t b = 0; b < sizeof(boundaries) / sizeof(boundaries[0]); b++) {
+			for(size_t t = 0; t < sizeof(temporal_steps) / sizeof(temporal_steps[0]); t++) {
+				passed = compare(sizes[s][0], sizes[s][1], boundaries[b], temporal_steps[t]) && passed;
+			}
+		}
+	}
+
+	std::cout << (passed ? "= Temporal blocking passed" : "= Temporal blocking FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
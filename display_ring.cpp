@@ -0,0 +1,339 @@
+#include "display_ring.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+/*
+ * Check the device for an extension
+ */
+static bool deviceExtension(cl_device_id device, const char *extension) {
+	size_t length;
+	clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, NULL, &length);
+	std::vector<char> extensions(length + 1, '\0');
+	clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, length, &extensions[0], NULL);
+	return strstr(&extensions[0], extension) != NULL;
+}
+
+/*
+ * Create one GL texture, the same formats the engine's universe has, and share it
+ */
+static bool initDisplaySlot(DisplayRing &ring, DisplaySlot &slot, bool integer_state) {
+	cl_int clError;
+
+	if(ring.buffer_layout) {
+		// One byte per cell, row major, viewed through a buffer texture
+		glGenBuffers(1, &slot.storage);
+		glBindBuffer(GL_TEXTURE_BUFFER, slot.storage);
+		glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr) ring.width * ring.height, NULL, GL_DYNAMIC_DRAW);
+
+		glGenTextures(1, &slot.texture);
+		glBindTexture(GL_TEXTURE_BUFFER, slot.texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, slot.storage);
+
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		slot.image = clCreateFromGLBuffer(ring.context, CL_MEM_WRITE_ONLY, slot.storage, &clError);
+	} else {
+		// Integer textures are shared as CL_UNSIGNED_INT8 images
+		const GLint texture_format = integer_state ? GL_R8UI : GL_R8;
+		const GLenum pixel_format = integer_state ? GL_RED_INTEGER : GL_RED;
+
+		slot.storage = 0;
+		glGenTextures(1, &slot.texture);
+		glBindTexture(GL_TEXTURE_2D, slot.texture);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, texture_format, ring.width, ring.height, 0, pixel_format, GL_UNSIGNED_BYTE, NULL);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		slot.image = clCreateFromGLTexture(ring.context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, slot.texture, &clError);
+	}
+
+	slot.drawn = 0;
+	slot.copied = NULL;
+	slot.published = 0;
+	slot.lod_built = 0;
+
+	if(clError) {
+		std::cerr << "Unable to share display texture: " << clError << std::endl;
+		return false;
+	}
+
+	// Normalized species and density, averaged levels would blend species
+	for(unsigned int level = ring.lod_first; level <= ring.lod_top; level++) {
+		GLuint &texture = slot.lod_textures[level - 1];
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, ring.lod_width[level - 1], ring.lod_height[level - 1], 0, GL_RG, GL_UNSIGNED_BYTE, NULL);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		slot.lod_images[level - 1] = clCreateFromGLTexture(ring.context, CL_MEM_READ_WRITE, GL_TEXTURE_2D, 0, texture, &clError);
+		if(clError) {
+			std::cerr << "Unable to share zoom-out texture: " << clError << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Pyramid level sizes and the range of levels that fit both APIs' image limits
+ */
+static void initDisplayLevels(DisplayRing &ring, cl_device_id device) {
+	size_t image_width, image_height;
+	GLint texture_size;
+	clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(size_t), &image_width, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(size_t), &image_height, NULL);
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &texture_size);
+
+	ring.lod_first = 0;
+	ring.lod_top = 0;
+	for(unsigned int level = 1; level <= DISPLAY_LOD_LEVELS; level++) {
+		const unsigned int block = 1u << level;
+		const unsigned int width = (ring.width + block - 1) / block;
+		const unsigned int height = (ring.height + block - 1) / block;
+		ring.lod_width[level - 1] = width;
+		ring.lod_height[level - 1] = height;
+
+		const bool fits = width <= image_width && height <= image_height &&
+				width <= (GLuint) texture_size && height <= (GLuint) texture_size;
+		if(!ring.lod_first && fits) {
+			ring.lod_first = level;
+		}
+		ring.lod_top = level;
+		if(width == 1 && height == 1) {
+			break;
+		}
+	}
+}
+
+bool initDisplayRing(DisplayRing &ring, cl_platform_id platform, const ClEngine &engine, bool integer_state) {
+	ring.context = engine.context;
+	ring.queue = engine.queue;
+	ring.width = engine.width;
+	ring.height = engine.height;
+	ring.buffer_layout = engine.buffer_layout;
+	ring.front = 0;
+	ring.pending = -1;
+	ring.published = 0;
+
+	ring.lod_wanted = 0;
+	ring.profiler = engine.profiler;
+
+	ring.create_event = NULL;
+	if(deviceExtension(engine.device, "cl_khr_gl_event")) {
+		ring.create_event = (clCreateEventFromGLsyncKHR_fn) clGetExtensionFunctionAddressForPlatform(platform, "clCreateEventFromGLsyncKHR");
+	}
+
+	ring.lod_cells_kernel = createEngineKernel(engine, "rps_lod_cells");
+	ring.lod_kernel = ring.lod_cells_kernel ? createEngineKernel(engine, "rps_lod") : NULL;
+	if(!ring.lod_kernel) {
+		return false;
+	}
+
+	initDisplayLevels(ring, engine.device);
+
+	bool shared = true;
+	for(int i = 0; i < DISPLAY_IMAGES; i++) {
+		shared = initDisplaySlot(ring, ring.slots[i], integer_state) && shared;
+	}
+
+	std::cout << "=-- Display images: " << DISPLAY_IMAGES << ", "
+			<< (ring.create_event ? "GL fences as CL events" : "host waits on GL fences")
+			<< ", zoom-out levels " << ring.lod_first << ".." << ring.lod_top << std::endl;
+	return shared;
+}
+
+void exitDisplayRing(DisplayRing &ring) {
+	clFinish(ring.queue);
+
+	for(int i = 0; i < DISPLAY_IMAGES; i++) {
+		DisplaySlot &slot = ring.slots[i];
+		if(slot.copied) {
+			clReleaseEvent(slot.copied);
+		}
+		if(slot.drawn) {
+			glDeleteSync(slot.drawn);
+		}
+		clReleaseMemObject(slot.image);
+		glDeleteTextures(1, &slot.texture);
+		if(ring.buffer_layout) {
+			glDeleteBuffers(1, &slot.storage);
+		}
+		for(unsigned int level = ring.lod_first; level <= ring.lod_top; level++) {
+			clReleaseMemObject(slot.lod_images[level - 1]);
+			glDeleteTextures(1, &slot.lod_textures[level - 1]);
+		}
+	}
+	clReleaseKernel(ring.lod_cells_kernel);
+	clReleaseKernel(ring.lod_kernel);
+}
+
+/*
+ * Make the pending image the front one once its copy completed
+ */
+static bool promotePending(DisplayRing &ring) {
+	if(ring.pending < 0) {
+		return true;
+	}
+
+	DisplaySlot &slot = ring.slots[ring.pending];
+	cl_int status;
+	clGetEventInfo(slot.copied, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL);
+	if(status > CL_COMPLETE) {
+		return false;
+	}
+	if(status < 0) {
+		std::cerr << "Display copy failed: " << status << std::endl;
+	}
+
+	clReleaseEvent(slot.copied);
+	slot.copied = NULL;
+	// The fence the copy waited for is of no use anymore
+	if(slot.drawn) {
+		glDeleteSync(slot.drawn);
+		slot.drawn = 0;
+	}
+
+	ring.front = ring.pending;
+	ring.pending = -1;
+	return true;
+}
+
+/*
+ * Reduce the engine's universe into the first stored level, then every level into the next
+ */
+static cl_int enqueueLevels(DisplayRing &ring, DisplaySlot &slot, const ClEngine &engine, unsigned int top) {
+	cl_int error;
+
+	const cl_uint block = 1u << ring.lod_first;
+	size_t global_size[] = {ring.lod_width[ring.lod_first - 1], ring.lod_height[ring.lod_first - 1]};
+	clSetKernelArg(ring.lod_cells_kernel, 0, sizeof(cl_mem), &engine.universe);
+	clSetKernelArg(ring.lod_cells_kernel, 1, sizeof(cl_mem), &slot.lod_images[ring.lod_first - 1]);
+	clSetKernelArg(ring.lod_cells_kernel, 2, sizeof(cl_uint), &block);
+	error = clEnqueueNDRangeKernel(ring.queue, ring.lod_cells_kernel, 2, NULL, global_size, NULL, 0, NULL, profileEvent(ring.profiler, PHASE_PYRAMID));
+
+	for(unsigned int level = ring.lod_first + 1; !error && level <= top; level++) {
+		global_size[0] = ring.lod_width[level - 1];
+		global_size[1] = ring.lod_height[level - 1];
+		clSetKernelArg(ring.lod_kernel, 0, sizeof(cl_mem), &slot.lod_images[level - 2]);
+		clSetKernelArg(ring.lod_kernel, 1, sizeof(cl_mem), &slot.lod_images[level - 1]);
+		error = clEnqueueNDRangeKernel(ring.queue, ring.lod_kernel, 2, NULL, global_size, NULL, 0, NULL, profileEvent(ring.profiler, PHASE_PYRAMID));
+	}
+	return error;
+}
+
+cl_int publishFrame(DisplayRing &ring, const ClEngine &engine) {
+	cl_int error;
+
+	// The display is behind by a copy, drop this frame rather than wait
+	if(!promotePending(ring)) {
+		return CL_SUCCESS;
+	}
+
+	// Least recently published image, GL had the longest time to finish with it
+	int target = -1;
+	for(int i = 0; i < DISPLAY_IMAGES; i++) {
+		if(i != ring.front && (target < 0 || ring.slots[i].published < ring.slots[target].published)) {
+			target = i;
+		}
+	}
+	DisplaySlot &slot = ring.slots[target];
+
+	// Order the copy after the last draw that sampled the image
+	cl_event drawn = NULL;
+	if(slot.drawn) {
+		if(ring.create_event) {
+			drawn = ring.create_event(ring.context, (cl_GLsync) slot.drawn, &error);
+			if(error) {
+				return error;
+			}
+		} else {
+			glClientWaitSync(slot.drawn, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(slot.drawn);
+			slot.drawn = 0;
+		}
+	}
+
+	// Levels below the first stored one are not drawn either
+	const unsigned int lod_built = ring.lod_wanted >= ring.lod_first ? std::min(ring.lod_wanted, ring.lod_top) : 0;
+	cl_mem objects[1 + DISPLAY_LOD_LEVELS];
+	cl_uint object_count = 0;
+	objects[object_count++] = slot.image;
+	for(unsigned int level = ring.lod_first; level <= lod_built; level++) {
+		objects[object_count++] = slot.lod_images[level - 1];
+	}
+
+	error = clEnqueueAcquireGLObjects(ring.queue, object_count, objects, drawn ? 1 : 0, drawn ? &drawn : NULL, profileEvent(ring.profiler, PHASE_ACQUIRE));
+	if(drawn) {
+		clReleaseEvent(drawn);
+	}
+	if(error) {
+		return error;
+	}
+
+	if(ring.buffer_layout) {
+		error = clEnqueueCopyBuffer(ring.queue, engine.universe, slot.image, 0, 0, (size_t) ring.width * ring.height, 0, NULL, profileEvent(ring.profiler, PHASE_COPY));
+	} else {
+		const size_t origin[] = {0, 0, 0};
+		const size_t region[] = {ring.width, ring.height, 1};
+		error = clEnqueueCopyImage(ring.queue, engine.universe, slot.image, origin, origin, region, 0, NULL, profileEvent(ring.profiler, PHASE_COPY));
+	}
+	if(!error && lod_built) {
+		error = enqueueLevels(ring, slot, engine, lod_built);
+	}
+
+	// Release even after a failed copy, the images must not stay acquired
+	cl_int release_error = clEnqueueReleaseGLObjects(ring.queue, object_count, objects, 0, NULL, &slot.copied);
+	if(error || release_error) {
+		return error ? error : release_error;
+	}
+	profileRetained(ring.profiler, PHASE_RELEASE, slot.copied);
+
+	slot.published = ++ring.published;
+	slot.lod_built = lod_built;
+	ring.pending = target;
+	return clFlush(ring.queue);
+}
+
+GLuint frontTexture(DisplayRing &ring) {
+	promotePending(ring);
+	return ring.slots[ring.front].texture;
+}
+
+unsigned int frontLevel(DisplayRing &ring, GLuint &texture) {
+	const DisplaySlot &slot = ring.slots[ring.front];
+	texture = slot.texture;
+	if(ring.lod_wanted < ring.lod_first || !slot.lod_built) {
+		return 0;
+	}
+
+	const unsigned int level = std::min(ring.lod_wanted, slot.lod_built);
+	texture = slot.lod_textures[level - 1];
+	return level;
+}
+
+bool frontLevelMissing(const DisplayRing &ring) {
+	const unsigned int wanted = std::min(ring.lod_wanted, ring.lod_top);
+	return wanted >= ring.lod_first && ring.slots[ring.front].lod_built < wanted;
+}
+
+void frontDrawn(DisplayRing &ring) {
+	DisplaySlot &slot = ring.slots[ring.front];
+	if(slot.drawn) {
+		glDeleteSync(slot.drawn);
+	}
+	slot.drawn = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,105 @@
+#ifndef DISPLAY_RING_HPP
+#define DISPLAY_RING_HPP
+
+#include "utils.hpp"
+#include "gl_utils.hpp"
+#include "cl_engine.hpp"
+
+#define CL_USE_DEPRECATED_OPENCL_1_1_APIS
+#include <CL/cl_gl.h>
+#include <CL/cl_gl_ext.h>
+
+// GL shared images the simulation publishes into
+#define DISPLAY_IMAGES		3
+
+// Zoom-out levels, enough to shrink 2^24 cells to one texel
+#define DISPLAY_LOD_LEVELS	24
+
+/*
+ * One shared image: GL texture (over a buffer in buffer layout) and its CL object
+ */
+struct DisplaySlot {
+	GLuint				texture, storage;
+	cl_mem				image;
+
+	// GL is done sampling it once drawn signals, CL is done writing it once copied completes
+	GLsync				drawn;
+	cl_event			copied;
+	unsigned long long	published;
+
+	// Zoom-out pyramid of the same generation, RG8 textures of the stored levels
+	GLuint				lod_textures[DISPLAY_LOD_LEVELS];
+	cl_mem				lod_images[DISPLAY_LOD_LEVELS];
+	unsigned int		lod_built;		// highest level built, 0 for none
+};
+
+/*
+ * Triple buffered hand-over from the CL engine to the display.
+ * The engine steps its own CL-only universe pair, a copy of every frame's
+ * last generation goes into a free shared image. GL draws the newest image
+ * whose copy completed while CL works ahead, fences order the hand-over in
+ * both directions, so neither side waits for the other to finish a frame.
+ */
+struct DisplayRing {
+	DisplaySlot			slots[DISPLAY_IMAGES];
+	int					front;			// drawn by GL
+	int					pending;		// being copied by CL, -1 for none
+
+	cl_context			context;
+	cl_command_queue	queue;
+	unsigned int		width, height;
+	bool				buffer_layout;
+	unsigned long long	published;		// copies enqueued so far
+
+	// cl_khr_gl_event: GL fences become CL events instead of host waits
+	clCreateEventFromGLsyncKHR_fn	create_event;
+
+	// Level k holds a texel per 2^k x 2^k cells, levels lod_first .. lod_top are stored,
+	// those below lod_first when they would exceed the image size limits
+	cl_kernel			lod_cells_kernel, lod_kernel;
+	unsigned int		lod_first, lod_top;
+	unsigned int		lod_width[DISPLAY_LOD_LEVELS], lod_height[DISPLAY_LOD_LEVELS];
+
+	// Highest level the renderer asks for, built with every published frame
+	unsigned int		lod_wanted;
+
+	// Times acquire, copy, pyramid and release when set
+	Profiler			*profiler;
+};
+
+/*
+ * Create the GL textures and share them with the engine's context.
+ * The GL context must be current.
+ */
+bool initDisplayRing(DisplayRing &ring, cl_platform_id platform, const ClEngine &engine, bool integer_state);
+void exitDisplayRing(DisplayRing &ring);
+
+/*
+ * Enqueue a copy of the engine's universe into a free image,
+ * followed by the pyramid levels up to lod_wanted.
+ * Skipped while a previous copy is still pending.
+ */
+cl_int publishFrame(DisplayRing &ring, const ClEngine &engine);
+
+/*
+ * Texture to draw: switches to the newest completed copy
+ */
+GLuint frontTexture(DisplayRing &ring);
+
+/*
+ * Level to draw for lod_wanted and its texture: the wanted one if the front image has it,
+ * the closest built one otherwise, 0 for the cells themselves
+ */
+unsigned int frontLevel(DisplayRing &ring, GLuint &texture);
+
+/*
+ * The front image lacks a wanted level, e.g. after zooming out while paused
+ */
+bool frontLevelMissing(const DisplayRing &ring);
+
+/*
+ * Fence the draw of the front texture, after the draw calls
+ */
+void frontDrawn(DisplayRing &ring);
+
+#endif //DISPLAY_RING_HPP
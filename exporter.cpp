@@ -0,0 +1,259 @@
+#include "exporter.hpp"
+#include "clrps_rules.h"
+#include "utils.hpp"
+
+#include <iostream>
+
+// Staging slot states
+#define SLOT_FREE		0
+#define SLOT_PENDING	1
+#define SLOT_READY		2
+#define SLOT_FAILED		3
+
+#if defined _WIN32
+	#define popen	_popen
+	#define pclose	_pclose
+#endif
+
+/*
+ * Same palette as fragment_shader.glsl: checkerboard background, speciesColor()
+ * for every species and cyan for anything out of range.
+ * Indexed by [checkerboard parity][cell state].
+ */
+static unsigned char palette_rgb[2][256][3];
+static unsigned char palette_yuv[2][256][3];
+
+static void initPalette() {
+	for(int parity = 0; parity < 2; parity++) {
+		for(int state = 0; state < 256; state++) {
+			const int species = state / RULE_HEALTH;
+			double r, g, b;
+			if(state == 0) {
+				r = g = b = parity * (17.0 / 255.0);
+			} else if(species >= 1 && species <= RULE_SPECIES) {
+				float rgb[3];
+				speciesColor(species, rgb);
+				r = rgb[0]; g = rgb[1]; b = rgb[2];
+			} else {
+				r = 0.0; g = 1.0; b = 1.0;
+			}
+
+			palette_rgb[parity][state][0] = (unsigned char) (r * 255.0 + 0.5);
+			palette_rgb[parity][state][1] = (unsigned char) (g * 255.0 + 0.5);
+			palette_rgb[parity][state][2] = (unsigned char) (b * 255.0 + 0.5);
+
+			// BT.601, studio range as y4m players expect
+			double y = 0.299 * r + 0.587 * g + 0.114 * b;
+			palette_yuv[parity][state][0] = (unsigned char) (16.0 + 219.0 * y + 0.5);
+			palette_yuv[parity][state][1] = (unsigned char) (128.0 + 224.0 * (b - y) / 1.772 + 0.5);
+			palette_yuv[parity][state][2] = (unsigned char) (128.0 + 224.0 * (r - y) / 1.402 + 0.5);
+		}
+	}
+}
+
+/*
+ * Convert one frame on the writer thread, top row first like the window shows it
+ */
+static void encodeFrame(FrameExporter &exporter, const ExportSlot &slot) {
+	const size_t width = exporter.width;
+	const size_t height = exporter.height;
+	const size_t pixels = width * height;
+	std::vector<unsigned char> &encoded = exporter.encoded;
+
+	encoded.resize(pixels * 3);
+	if(exporter.format == "ppm") {
+		for(size_t row = 0; row < height; row++) {
+			const unsigned char *cells = slot.host + (height - 1 - row) * width;
+			unsigned char *rgb = &encoded[row * width * 3];
+			for(size_t x = 0; x < width; x++) {
+				const unsigned char *color = palette_rgb[(x + height - 1 - row) & 1][cells[x]];
+				rgb[x * 3 + 0] = color[0];
+				rgb[x * 3 + 1] = color[1];
+				rgb[x * 3 + 2] = color[2];
+			}
+		}
+		fprintf(exporter.output, "P6\n%u %u\n255\n", exporter.width, exporter.height);
+	} else {
+		// Planar 4:4:4
+		for(size_t row = 0; row < height; row++) {
+			const unsigned char *cells = slot.host + (height - 1 - row) * width;
+			for(size_t x = 0; x < width; x++) {
+				const unsigned char *color = palette_yuv[(x + height - 1 - row) & 1][cells[x]];
+				encoded[row * width + x] = color[0];
+				encoded[pixels + row * width + x] = color[1];
+				encoded[2 * pixels + row * width + x] = color[2];
+			}
+		}
+		fputs("FRAME\n", exporter.output);
+	}
+	fwrite(&encoded[0], 1, encoded.size(), exporter.output);
+}
+
+/*
+ * Writer thread: encodes frames in order as their readbacks arrive
+ */
+static void writeFrames(FrameExporter *exporter) {
+	std::unique_lock<std::mutex> guard(exporter->lock);
+	while(true) {
+		ExportSlot &slot = exporter->slots[exporter->next];
+		exporter->changed.wait(guard, [&] {
+			return slot.state == SLOT_READY || slot.state == SLOT_FAILED || (exporter->stopping && slot.state == SLOT_FREE);
+		});
+		if(slot.state == SLOT_FREE) {
+			break;
+		}
+
+		if(slot.state == SLOT_READY) {
+			guard.unlock();
+			encodeFrame(*exporter, slot);
+			guard.lock();
+		} else {
+			std::cerr << "Export of generation " << slot.generation << " failed" << std::endl;
+		}
+
+		slot.state = SLOT_FREE;
+		exporter->next = (exporter->next + 1) % EXPORT_RING;
+		exporter->changed.notify_all();
+	}
+	fflush(exporter->output);
+}
+
+/*
+ * Readback completion, called from an OpenCL runtime thread
+ */
+static void CL_CALLBACK frameArrived(cl_event event, cl_int status, void *user_data) {
+	ExportSlot *slot = (ExportSlot *) user_data;
+	FrameExporter *exporter = slot->exporter;
+
+	std::lock_guard<std::mutex> guard(exporter->lock);
+	slot->state = status == CL_COMPLETE ? SLOT_READY : SLOT_FAILED;
+	exporter->changed.notify_all();
+}
+
+bool initExporter(FrameExporter &exporter, const ClEngine &engine, const char *output, const std::string &format, unsigned int fps) {
+	cl_int clError;
+	const size_t size = (size_t) engine.width * engine.height;
+
+	exporter.width = engine.width;
+	exporter.height = engine.height;
+	exporter.format = format;
+	exporter.fps = fps;
+	exporter.head = 0;
+	exporter.next = 0;
+	exporter.frames = 0;
+	exporter.stopping = false;
+	initPalette();
+
+	// Readbacks get their own queue, so the simulation queue only waits for the device copies
+	exporter.queue = clCreateCommandQueue(engine.context, engine.device, 0, &clError);
+	if(clError) {
+		std::cerr << "Unable to create export queue: " << clError << std::endl;
+		return false;
+	}
+
+	for(int i = 0; i < EXPORT_RING; i++) {
+		ExportSlot &slot = exporter.slots[i];
+		slot.exporter = &exporter;
+		slot.state = SLOT_FREE;
+		slot.frame = clCreateBuffer(engine.context, CL_MEM_READ_WRITE, size, NULL, &clError);
+		if(!clError) {
+			slot.pinned = clCreateBuffer(engine.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, &clError);
+		}
+		if(!clError) {
+			slot.host = (unsigned char *) clEnqueueMapBuffer(exporter.queue, slot.pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, NULL, NULL, &clError);
+		}
+		if(clError) {
+			std::cerr << "Unable to allocate export staging: " << clError << std::endl;
+			return false;
+		}
+	}
+
+	exporter.pipe = output[0] == '|';
+	exporter.output = exporter.pipe ? popen(output + 1, "w") : fopen(output, "wb");
+	if(!exporter.output) {
+		std::cerr << "Unable to open export output: " << output << std::endl;
+		return false;
+	}
+	if(format == "y4m") {
+		fprintf(exporter.output, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", exporter.width, exporter.height, fps);
+	}
+
+	exporter.writer = std::thread(writeFrames, &exporter);
+
+	std::cout << "=-- Exporting " << format << " frames to " << output << std::endl;
+	return true;
+}
+
+cl_int exportFrame(FrameExporter &exporter, const ClEngine &engine) {
+	cl_int error;
+	cl_event copied, read;
+	ExportSlot &slot = exporter.slots[exporter.head];
+	const size_t size = (size_t) engine.width * engine.height;
+
+	// Back pressure when the writer falls behind
+	{
+		std::unique_lock<std::mutex> guard(exporter.lock);
+		exporter.changed.wait(guard, [&] { return slot.state == SLOT_FREE; });
+	}
+
+	// Device side copy on the simulation queue, it is cheap next to the readback
+	if(engine.buffer_layout) {
+		error = clEnqueueCopyBuffer(engine.queue, engine.universe, slot.frame, 0, 0, size, 0, NULL, &copied);
+	} else {
+		const size_t origin[] = {0, 0, 0};
+		const size_t region[] = {engine.width, engine.height, 1};
+		error = clEnqueueCopyImageToBuffer(engine.queue, engine.universe, slot.frame, origin, region, 0, 0, NULL, &copied);
+	}
+	if(error) {
+		return error;
+	}
+	clFlush(engine.queue);
+
+	{
+		std::lock_guard<std::mutex> guard(exporter.lock);
+		slot.generation = engine.generation;
+		slot.state = SLOT_PENDING;
+	}
+	error = clEnqueueReadBuffer(exporter.queue, slot.frame, CL_FALSE, 0, size, slot.host, 1, &copied, &read);
+	clReleaseEvent(copied);
+	if(!error) {
+		error = clSetEventCallback(read, CL_COMPLETE, frameArrived, &slot);
+		clReleaseEvent(read);
+	}
+	if(error) {
+		std::lock_guard<std::mutex> guard(exporter.lock);
+		slot.state = SLOT_FREE;
+		return error;
+	}
+	clFlush(exporter.queue);
+
+	exporter.head = (exporter.head + 1) % EXPORT_RING;
+	exporter.frames++;
+	return CL_SUCCESS;
+}
+
+void exitExporter(FrameExporter &exporter) {
+	clFinish(exporter.queue);
+	{
+		std::lock_guard<std::mutex> guard(exporter.lock);
+		exporter.stopping = true;
+		exporter.changed.notify_all();
+	}
+	exporter.writer.join();
+
+	if(exporter.pipe) {
+		pclose(exporter.output);
+	} else {
+		fclose(exporter.output);
+	}
+
+	for(int i = 0; i < EXPORT_RING; i++) {
+		clEnqueueUnmapMemObject(exporter.queue, exporter.slots[i].pinned, exporter.slots[i].host, 0, NULL, NULL);
+		clReleaseMemObject(exporter.slots[i].pinned);
+		clReleaseMemObject(exporter.slots[i].frame);
+	}
+	clFinish(exporter.queue);
+	clReleaseCommandQueue(exporter.queue);
+
+	std::cout << "=-- Exported " << exporter.frames << " frames" << std::endl;
+}
@@ -0,0 +1,74 @@
+#ifndef EXPORTER_HPP
+#define EXPORTER_HPP
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cl_engine.hpp"
+
+// Frames in flight between the device and the writer thread
+#define EXPORT_RING		4
+
+struct FrameExporter;
+
+/*
+ * One staging frame: a device copy of the universe and the pinned host memory it is read into
+ */
+struct ExportSlot {
+	FrameExporter		*exporter;
+	cl_mem				frame, pinned;
+	unsigned char		*host;
+	cl_ulong			generation;
+	int					state;
+};
+
+/*
+ * Streams the universe as y4m or raw PPM frames, one pixel per cell in the display palette.
+ * The universe is copied on the device, read back on a separate queue into pinned
+ * memory and encoded by a writer thread, so simulation, readback and encoding overlap.
+ */
+struct FrameExporter {
+	cl_command_queue	queue;
+
+	unsigned int		width, height;
+	std::string			format;
+	unsigned int		fps;
+
+	FILE				*output;
+	bool				pipe;
+
+	ExportSlot			slots[EXPORT_RING];
+	unsigned int		head, next;
+	unsigned long long	frames;
+
+	std::thread			writer;
+	std::mutex			lock;
+	std::condition_variable	changed;
+	bool				stopping;
+
+	// Writer thread scratch, a whole encoded frame
+	std::vector<unsigned char>	encoded;
+};
+
+/*
+ * Open the output ("|command" pipes into a command) and start the writer thread.
+ * Format is "y4m" or "ppm".
+ */
+bool initExporter(FrameExporter &exporter, const ClEngine &engine, const char *output, const std::string &format, unsigned int fps);
+
+/*
+ * Write the remaining frames and close the output
+ */
+void exitExporter(FrameExporter &exporter);
+
+/*
+ * Enqueue a copy of the current universe behind the queued generations.
+ * Blocks only while all staging frames are in flight.
+ */
+cl_int exportFrame(FrameExporter &exporter, const ClEngine &engine);
+
+#endif //EXPORTER_HPP
@@ -4,21 +4,50 @@ in vec2 uv;
 
 out vec3 color;
 
-uniform sampler2D background;
+#if defined BUFFER_LAYOUT
+uniform usamplerBuffer universe;
+#elif defined INTEGER_STATE
+uniform usampler2D universe;
+#else
 uniform sampler2D universe;
+#endif
+
+uniform ivec2 size;
+
+// Zoom-out pyramid level drawn instead of the cells when above 0, see rps_lod
+uniform sampler2D lod;
+uniform ivec2 lod_size;
+uniform int level;
 
 uniform float frame;
 
+// Generated by the host from the rule set, see ruleShaderDefines()
+const vec3 palette[RULE_SPECIES] = vec3[](SPECIES_PALETTE);
+
 void main() {
+	ivec2 cell = min(ivec2(uv * vec2(size)), size - 1);
+	if(level > 0) {
+		// Dominant species of the block over the mean background, by the density of living cells
+		vec2 block = texelFetch(lod, min(cell >> level, lod_size - 1), 0).rg;
+		int dominant = int(255.0 * block.r + 0.5);
+		vec3 block_bg = vec3(8.5 / 255.0);
+		color = dominant >= 1 && dominant <= RULE_SPECIES ? mix(block_bg, palette[dominant - 1], block.g) : block_bg;
+		return;
+	}
+#if defined BUFFER_LAYOUT
+	int cell_value = int(texelFetch(universe, cell.y * size.x + cell.x).r);
+#elif defined INTEGER_STATE
+	int cell_value = int(texelFetch(universe, cell, 0).r);
+#else
 	float cell_life = texture(universe, uv).r;
-	float cell_bg 	= texture(background, uv).r;
-	
 	int cell_value = int(255 * cell_life);
+#endif
+	// Checkerboard background
+	float cell_bg 	= float((cell.x + cell.y) % 2) * (17.0 / 255.0);
 	
+	int species = cell_value / RULE_HEALTH;
 	if(cell_value == 0) { color = vec3(cell_bg); }
-	else if(cell_value < 20) { color = vec3(1.0, 0.0, 0.0); }
-	else if(cell_value < 30) { color = vec3(0.0, 1.0, 0.0); }
-	else if(cell_value < 40) { color = vec3(0.0, 0.0, 1.0); }
+	else if(species >= 1 && species <= RULE_SPECIES) { color = palette[species - 1]; }
 	else { color = vec3(0.0, 1.0, 1.0); }
 	//color = vec3(cell_life);
 }
\ No newline at end of file
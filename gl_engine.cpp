@@ -0,0 +1,202 @@
+#include "gl_engine.hpp"
+#include "clrps_rules.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+// Invocations per work-group edge, the local size of rps_compute.glsl
+#define COMPUTE_LOCAL_SIZE		16
+
+/*
+ * GL_R8UI texture of the whole world, sampled with texelFetch and bound as an image
+ */
+static GLuint createUniverseTexture(unsigned int width, unsigned int height) {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8UI, width, height);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+bool initGlEngine(GlEngine &engine, unsigned int width, unsigned int height, int boundary, unsigned long long seed) {
+	engine.width = width;
+	engine.height = height;
+	engine.boundary = boundary;
+	engine.seed = seed;
+	engine.generation = 0;
+	engine.timer_pending = false;
+
+	if(!GLEW_VERSION_4_3) {
+		std::cerr << "GL backend needs OpenGL 4.3 compute shaders, the context has " << glGetString(GL_VERSION) << std::endl;
+		return false;
+	}
+
+	GLint texture_size;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &texture_size);
+	if(width > (GLuint) texture_size || height > (GLuint) texture_size) {
+		std::cerr << "World of " << width << "x" << height << " cells exceeds the max texture size " << texture_size << std::endl;
+		return false;
+	}
+
+	std::stringstream defines;
+	defines << "#define WIDTH " << width << "\n"
+			<< "#define HEIGHT " << height << "\n"
+			<< "#define BOUNDARY " << boundary << "\n"
+			<< ruleShaderDefines();
+	engine.program = loadComputeShader("rps_compute.glsl", defines.str().c_str());
+	if(!engine.program) {
+		return false;
+	}
+	engine.seed_location = glGetUniformLocation(engine.program, "seed");
+	engine.generation_location = glGetUniformLocation(engine.program, "generation");
+
+	engine.universe = createUniverseTexture(width, height);
+	engine.update = createUniverseTexture(width, height);
+	glGenQueries(1, &engine.timer);
+
+	std::cout << "=-- GL compute backend: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+	return glGetError() == GL_NO_ERROR;
+}
+
+void exitGlEngine(GlEngine &engine) {
+	glDeleteQueries(1, &engine.timer);
+	glDeleteTextures(1, &engine.universe);
+	glDeleteTextures(1, &engine.update);
+	glDeleteProgram(engine.program);
+}
+
+void writeGlEngineCells(GlEngine &engine, unsigned int x, unsigned int y, unsigned int width, unsigned int height, const unsigned char *cells) {
+	// Compute shader writes to the universe have to land first
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	glBindTexture(GL_TEXTURE_2D, engine.universe);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RED_INTEGER, GL_UNSIGNED_BYTE, cells);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/*
+ * Run of cells x0 .. x1 of a row, clipped to the world
+ */
+static void writeRun(GlEngine &engine, int x0, int x1, int y, unsigned char state, std::vector<unsigned char> &run) {
+	x0 = std::max(x0, 0);
+	x1 = std::min(x1, (int) engine.width - 1);
+	if(y < 0 || y >= (int) engine.height || x0 > x1) {
+		return;
+	}
+	run.assign(x1 - x0 + 1, state);
+	writeGlEngineCells(engine, x0, y, x1 - x0 + 1, 1, &run[0]);
+}
+
+// a / b rounded to nearest, b > 0, as in rps_edit
+static int roundDiv(int a, int b) {
+	return a >= 0 ? (2 * a + b) / (2 * b) : -((-2 * a + b) / (2 * b));
+}
+
+void applyGlEdits(GlEngine &engine, const std::vector<EditOp> &ops) {
+	std::vector<unsigned char> run;
+
+	for(size_t i = 0; i < ops.size(); i++) {
+		const EditOp &op = ops[i];
+		const unsigned char state = op.state;
+
+		if(op.type == EDIT_POINT) {
+			writeRun(engine, op.x0, op.x0, op.y0, state, run);
+		} else if(op.type == EDIT_LINE) {
+			const int dx = op.x1 - op.x0;
+			const int dy = op.y1 - op.y0;
+			const int steps = std::max(std::abs(dx), std::abs(dy));
+			for(int s = 0; s <= steps; s++) {
+				int x = op.x0 + (steps ? roundDiv(s * dx, steps) : 0);
+				writeRun(engine, x, x, op.y0 + (steps ? roundDiv(s * dy, steps) : 0), state, run);
+			}
+		} else if(op.type == EDIT_RECT) {
+			for(int y = std::min(op.y0, op.y1); y <= std::max(op.y0, op.y1); y++) {
+				writeRun(engine, std::min(op.x0, op.x1), std::max(op.x0, op.x1), y, state, run);
+			}
+		} else if(op.type == EDIT_CIRCLE || op.type == EDIT_SPRAY) {
+			const int radius = op.x1;
+			for(int ry = -radius; ry <= radius; ry++) {
+				// Widest rx with rx * rx + ry * ry <= radius * radius
+				int half = 0;
+				while((half + 1) * (half + 1) + ry * ry <= radius * radius) {
+					half++;
+				}
+				if(op.type == EDIT_CIRCLE) {
+					writeRun(engine, op.x0 - half, op.x0 + half, op.y0 + ry, state, run);
+					continue;
+				}
+				const int y = op.y0 + ry;
+				for(int x = op.x0 - half; x <= op.x0 + half; x++) {
+					if(x >= 0 && y >= 0 && rngCell(engine.seed, EDIT_SPRAY_GENERATION(op.serial), x, y) < op.density) {
+						writeRun(engine, x, x, y, state, run);
+					}
+				}
+			}
+		}
+	}
+}
+
+void stepGlEngine(GlEngine &engine, unsigned int steps) {
+	// Time this batch unless the previous one is still being measured
+	const bool timed = !engine.timer_pending;
+	if(timed) {
+		glBeginQuery(GL_TIME_ELAPSED, engine.timer);
+	}
+
+	glUseProgram(engine.program);
+	glUniform2ui(engine.seed_location, (GLuint) engine.seed, (GLuint) (engine.seed >> 32));
+
+	const GLuint groups_x = (engine.width + COMPUTE_LOCAL_SIZE - 1) / COMPUTE_LOCAL_SIZE;
+	const GLuint groups_y = (engine.height + COMPUTE_LOCAL_SIZE - 1) / COMPUTE_LOCAL_SIZE;
+	for(unsigned int i = 0; i < steps; i++) {
+		glUniform2ui(engine.generation_location, (GLuint) engine.generation, (GLuint) (engine.generation >> 32));
+		glBindImageTexture(0, engine.universe, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R8UI);
+		glBindImageTexture(1, engine.update, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8UI);
+
+		glDispatchCompute(groups_x, groups_y, 1);
+		// The next generation reads what this one wrote
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		GLuint temp_texture = engine.universe;
+		engine.universe = engine.update;
+		engine.update = temp_texture;
+		engine.generation++;
+	}
+	glUseProgram(0);
+
+	// Sampled by the renderer and overwritten by uploads next
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	if(timed) {
+		glEndQuery(GL_TIME_ELAPSED);
+		engine.timer_pending = true;
+		engine.timed_steps = steps;
+	}
+}
+
+double glEngineTime(GlEngine &engine, unsigned int &steps) {
+	if(!engine.timer_pending) {
+		return -1.0;
+	}
+
+	GLint available;
+	glGetQueryObjectiv(engine.timer, GL_QUERY_RESULT_AVAILABLE, &available);
+	if(!available) {
+		return -1.0;
+	}
+
+	GLuint64 elapsed;
+	glGetQueryObjectui64v(engine.timer, GL_QUERY_RESULT, &elapsed);
+	engine.timer_pending = false;
+	steps = engine.timed_steps;
+	return elapsed * 1e-9;
+}
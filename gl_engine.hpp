@@ -0,0 +1,59 @@
+#ifndef GL_ENGINE_HPP
+#define GL_ENGINE_HPP
+
+#include <vector>
+
+#include "utils.hpp"
+#include "gl_utils.hpp"
+#include "clrps_edit.h"
+
+/*
+ * GL 4.3 compute shader rps engine: rps_compute.glsl steps a pair of GL_R8UI
+ * textures that the renderer samples directly, so simulation and display share
+ * one API and one command stream, without interop, acquire / release or fences.
+ * The GL context must be current for every call.
+ */
+struct GlEngine {
+	unsigned int		width, height;
+	int					boundary;
+
+	GLuint				program;
+	GLint				seed_location, generation_location;
+	GLuint				universe, update;
+
+	// One GL_TIME_ELAPSED query in flight, over the generations of a frame
+	GLuint				timer;
+	bool				timer_pending;
+	unsigned int		timed_steps;
+
+	unsigned long long	seed;
+	unsigned long long	generation;
+};
+
+/*
+ * Check for compute shader support, compile the program and allocate the universe pair
+ */
+bool initGlEngine(GlEngine &engine, unsigned int width, unsigned int height, int boundary, unsigned long long seed);
+void exitGlEngine(GlEngine &engine);
+
+/*
+ * Upload a rectangle of cells into the universe
+ */
+void writeGlEngineCells(GlEngine &engine, unsigned int x, unsigned int y, unsigned int width, unsigned int height, const unsigned char *cells);
+
+/*
+ * Apply queued paint operations on the host, the same cells rps_edit writes
+ */
+void applyGlEdits(GlEngine &engine, const std::vector<EditOp> &ops);
+
+/*
+ * Dispatch generations back to back, swapping universe and update after each
+ */
+void stepGlEngine(GlEngine &engine, unsigned int steps);
+
+/*
+ * GPU time of the last timed batch once its query is available, negative before
+ */
+double glEngineTime(GlEngine &engine, unsigned int &steps);
+
+#endif //GL_ENGINE_HPP
@@ -0,0 +1,125 @@
+#include "gl_utils.hpp"
+#include "utils.hpp"
+
+#include <iostream>
+#include <string>
+
+/*
+ * Insert defines right after the #version line of a shader
+ */
+static std::string addDefines(const std::string &source, const char *defines) {
+	size_t line_end = source.find('\n');
+	if(line_end == std::string::npos || source.compare(0, 8, "#version") != 0) {
+		return defines + source;
+	}
+	return source.substr(0, line_end + 1) + defines + source.substr(line_end + 1);
+}
+
+GLuint loadShader(const char *vertex_file_path, const char *fragment_file_path, const char *defines) {
+	GLint error;
+
+	std::string vertex_shader_source 		= addDefines(readFile(vertex_file_path), defines);
+	std::string fragment_shader_source 	= addDefines(readFile(fragment_file_path), defines);
+
+	const char *vertex_shader_source_ptr = vertex_shader_source.c_str();
+
+	GLuint vertex_shader 	= glCreateShader(GL_VERTEX_SHADER);
+	GLuint fragment_shader 	= glCreateShader(GL_FRAGMENT_SHADER);
+
+	glShaderSource(vertex_shader, 1, &vertex_shader_source_ptr , NULL);
+	glCompileShader(vertex_shader);
+
+	glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &error);
+	if(!error) {
+		std::cerr << "Unable to compile vertex shader: " << std::endl;
+		GLint log_length;
+		glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &log_length);
+		char *info_log = new char[log_length];
+		glGetShaderInfoLog(vertex_shader, log_length, NULL, info_log);
+		std::cerr << info_log;
+		delete info_log;
+		return 0;
+	}
+
+	const char *fragment_shader_source_ptr = fragment_shader_source.c_str();
+
+	glShaderSource(fragment_shader, 1, &fragment_shader_source_ptr , NULL);
+	glCompileShader(fragment_shader);
+
+	glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &error);
+	if(!error) {
+		std::cerr << "Unable to compile fragment shader: " << std::endl;
+		GLint log_length;
+		glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &log_length);
+		char *info_log = new char[log_length];
+		glGetShaderInfoLog(fragment_shader, log_length, NULL, info_log);
+		std::cerr << info_log;
+		delete info_log;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, fragment_shader);
+	glLinkProgram(program);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &error);
+	if(!error) {
+		std::cerr << "Unable to link shader program: " << std::endl;
+		GLint log_length;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
+		char *info_log = new char[log_length];
+		glGetProgramInfoLog(program, log_length, NULL, info_log);
+		std::cerr << info_log;
+		delete info_log;
+		return 0;
+	}
+
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
+	return program;
+}
+
+GLuint loadComputeShader(const char *compute_file_path, const char *defines) {
+	GLint error;
+
+	std::string compute_shader_source = addDefines(readFile(compute_file_path), defines);
+	const char *compute_shader_source_ptr = compute_shader_source.c_str();
+
+	GLuint compute_shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute_shader, 1, &compute_shader_source_ptr, NULL);
+	glCompileShader(compute_shader);
+
+	glGetShaderiv(compute_shader, GL_COMPILE_STATUS, &error);
+	if(!error) {
+		std::cerr << "Unable to compile compute shader: " << std::endl;
+		GLint log_length;
+		glGetShaderiv(compute_shader, GL_INFO_LOG_LENGTH, &log_length);
+		char *info_log = new char[log_length];
+		glGetShaderInfoLog(compute_shader, log_length, NULL, info_log);
+		std::cerr << info_log;
+		delete info_log;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, compute_shader);
+	glLinkProgram(program);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &error);
+	if(!error) {
+		std::cerr << "Unable to link compute program: " << std::endl;
+		GLint log_length;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
+		char *info_log = new char[log_length];
+		glGetProgramInfoLog(program, log_length, NULL, info_log);
+		std::cerr << info_log;
+		delete info_log;
+		return 0;
+	}
+
+	glDeleteShader(compute_shader);
+
+	return program;
+}
@@ -0,0 +1,19 @@
+#ifndef GL_UTILS_HPP
+#define GL_UTILS_HPP
+
+#include <GL/glew.h>
+
+#define GLFW_INCLUDE_GL3
+#include "GL/glfw.h"
+
+/*
+ * Viewer side helpers, the simulation core in utils.hpp does not depend on GL
+ */
+GLuint loadShader(const char *vertexFile, const char *fragmentFile, const char *defines = "");
+
+/*
+ * GL 4.3 compute program from a single shader file
+ */
+GLuint loadComputeShader(const char *computeFile, const char *defines = "");
+
+#endif //GL_UTILS_HPP
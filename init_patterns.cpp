@@ -0,0 +1,105 @@
+#include "init_patterns.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+/*
+ * Word thresholds of the uniform pattern: empty cells take the low end of the
+ * random words, every species a range as wide as its density after them.
+ * Without densities the odds are equal and the world is the one ruleInitialState() gives.
+ */
+static bool uniformThresholds(InitParams &params, const std::string &densities) {
+	const RNG_ULONG range = (RNG_ULONG) 1 << 32;
+	if(densities.empty()) {
+		// The first word rngChoice() maps to species s + 1 of RULE_SPECIES + 1 choices
+		for(int s = 0; s < RULE_SPECIES; s++) {
+			params.first[s] = ((RNG_ULONG) (s + 1) * range + RULE_SPECIES) / (RULE_SPECIES + 1);
+		}
+		return true;
+	}
+
+	std::vector<double> values;
+	std::stringstream stream(densities);
+	std::string value;
+	while(std::getline(stream, value, ',')) {
+		char *end;
+		values.push_back(strtod(value.c_str(), &end));
+		if(value.empty() || *end != '\0' || values.back() < 0.0) {
+			std::cerr << "Invalid density: " << value << std::endl;
+			return false;
+		}
+	}
+	if(values.size() != RULE_SPECIES) {
+		std::cerr << "Expected " << RULE_SPECIES << " densities, got " << values.size() << std::endl;
+		return false;
+	}
+
+	double total = 0.0;
+	for(int s = 0; s < RULE_SPECIES; s++) {
+		total += values[s];
+	}
+	if(total > 1.0 + 1e-9) {
+		std::cerr << "Densities add up to more than 1" << std::endl;
+		return false;
+	}
+
+	// Species ranges end at 2^32, so each starts below the densities of those above it
+	double above = 0.0;
+	for(int s = RULE_SPECIES - 1; s >= 0; s--) {
+		above = std::min(above + values[s], 1.0);
+		params.first[s] = (RNG_ULONG) ((1.0 - above) * range + 0.5);
+	}
+	return true;
+}
+
+bool initPatternParams(InitParams &params, const Config &config) {
+	memset(&params, 0, sizeof(params));
+	params.width = config.width;
+	params.height = config.height;
+	params.count = config.init_count;
+	params.scale = config.init_scale;
+
+	if(config.init == "clear") {
+		params.pattern = INIT_CLEAR;
+	} else if(config.init == "uniform") {
+		params.pattern = INIT_UNIFORM;
+		return uniformThresholds(params, config.init_densities);
+	} else if(config.init == "voronoi") {
+		params.pattern = INIT_VORONOI;
+		if(!params.count) {
+			params.count = 64;
+		}
+		if(params.count > INIT_MAX_SITES) {
+			std::cerr << "Voronoi patterns take up to " << INIT_MAX_SITES << " sites" << std::endl;
+			return false;
+		}
+	} else if(config.init == "stripes") {
+		params.pattern = INIT_STRIPES;
+	} else {
+		params.pattern = INIT_SPIRAL;
+		if(!params.count) {
+			params.count = 1;
+		}
+	}
+	return true;
+}
+
+void clearPatternParams(InitParams &params, unsigned int width, unsigned int height) {
+	memset(&params, 0, sizeof(params));
+	params.pattern = INIT_CLEAR;
+	params.width = width;
+	params.height = height;
+	params.scale = 1;
+}
+
+void fillInitPattern(const InitParams &params, unsigned long long seed, unsigned char *cells) {
+	for(unsigned int y = 0; y < params.height; y++) {
+		for(unsigned int x = 0; x < params.width; x++) {
+			cells[(size_t) y * params.width + x] = initCell(&params, seed, x, y);
+		}
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef INIT_PATTERNS_HPP
+#define INIT_PATTERNS_HPP
+
+#include "config.hpp"
+#include "clrps_init.h"
+
+/*
+ * Parameter block of the config's starting pattern, false if its settings are invalid
+ */
+bool initPatternParams(InitParams &params, const Config &config);
+
+/*
+ * Parameter block of an empty world
+ */
+void clearPatternParams(InitParams &params, unsigned int width, unsigned int height);
+
+/*
+ * The cells rps_init writes, generated on the host for backends without the kernel
+ */
+void fillInitPattern(const InitParams &params, unsigned long long seed, unsigned char *cells);
+
+#endif //INIT_PATTERNS_HPP
@@ -6,10 +6,15 @@
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 #include <ctime>
 #include <cmath>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 // OpenGL libraries
 #include <GL/glew.h>
 
@@ -34,25 +39,44 @@
 
 // Utility library
 #include "utils.hpp"
+#include "gl_utils.hpp"
+
+// Rule set and counter based random numbers
+#include "clrps_rules.h"
+
+// Native simulation backend
+#include "cpu_engine.hpp"
+
+// Startup settings
+#include "config.hpp"
+
+// OpenCL simulation backend and launch tuning
+#include "cl_engine.hpp"
+#include "autotune.hpp"
+#include "cl_stats.hpp"
+#include "snapshot.hpp"
+#include "exporter.hpp"
+#include "cl_edits.hpp"
+#include "cl_slabs.hpp"
+#include "cl_bands.hpp"
+#include "cl_ensemble.hpp"
 
-// Define base values
-#define WIDTH 		1024
-#define HEIGHT 		WIDTH
+// GL shared images the simulation hands its frames over in
+#include "display_ring.hpp"
 
-#define CELL		8
+// GL compute shader simulation backend
+#include "gl_engine.hpp"
 
-#define FPS			120
+// Hot path timings
+#include "profiler.hpp"
+#include "profile_overlay.hpp"
+
+// Starting world generators
+#include "init_patterns.hpp"
 
 namespace clrps {
 
 // Static data
-static const GLfloat g_vertex_buffer_data[] = {
-    0.0f,			0.0f, 			0.0f, 1.0f,
-    0.0f,  			HEIGHT * CELL, 	0.0f, 1.0f,
-    WIDTH * CELL, 	0.0f, 			0.0f, 1.0f,
-    WIDTH * CELL, 	HEIGHT * CELL, 	0.0f, 1.0f
-};
-
 static const GLfloat g_uv_buffer_data[] = {
 	0.0f, 0.0f,
 	0.0f, 1.0f,
@@ -66,6 +90,8 @@ static const GLuint g_index_buffer_data[] = {
 };
 
 // Program globals
+Config				config;
+
 unsigned int 		running = 1;
 unsigned int 		pause = 0;
 unsigned int		speed = 10;
@@ -74,18 +100,18 @@ size_t				row = 0, col = 0;
 float				x_translate = 0.0f, y_translate = 0.0f;
 int					mouse_x = 0, mouse_y = 0;
 int					window_width = 512, window_height = 512;
-unsigned int		cell_size = CELL;
+// Screen pixels per cell, fractions of one zoom out through the display pyramid
+float				cell_size;
 
 GLubyte				current_tool = 0x00;
 
 // OpenGL globals
 GLuint				program;
-GLuint				universe_texture_location, background_texture_location;
+GLuint				universe_texture_location, size_location;
 GLuint				view_location, perspective_location, translate_location, scale_location, frame_location;
+GLuint				lod_location, lod_size_location, level_location;
 
-GLuint				vao;
-
-GLuint				universe_texture, update_texture, background_texture;
+GLuint				vao, vbo, uvbo;
 
 glm::mat4			view, perspective, translate, scale;
 
@@ -94,66 +120,164 @@ cl_platform_id		platform;
 cl_context			context;
 cl_device_id 		device;
 cl_command_queue 	queue;
-cl_kernel			kernel;
 
-cl_mem 				universe_buffer, update_buffer, random_buffer;
+// The engine steps a CL only universe pair and publishes frames into the display ring
+ClEngine			cl_engine;
+DisplayRing			display_ring;
+
+// Frames the simulation may run ahead of the display
+#define FRAMES_AHEAD		2
+
+/*
+ * End of one frame's simulation work on the queue, stamped by a callback when reached
+ */
+struct FrameMarker {
+	cl_event			event;
+	unsigned int		steps;
+	double				enqueued;
+	std::atomic<double>	completed;
+};
+
+FrameMarker			frame_markers[FRAMES_AHEAD];
+unsigned int		frame_marker = 0;
+double				marker_completed = 0.0;
+
+// GL compute backend instead of OpenCL, the only engine then
+GlEngine			gl_engine;
+bool				gl_backend = false;
+
+// Population statistics, sampled on the device when a stats file is given
+ClStats				cl_stats;
+bool				stats_enabled = false;
 
-cl_mem				buffers[] = {universe_buffer, update_buffer};
+// Frame export, overlapped with the simulation
+FrameExporter		frame_exporter;
+bool				export_enabled = false;
 
-cl_sampler			sampler;
+// Paint operations, applied in one batch per frame
+ClEdits				cl_edits;
+
+// Starting world, rebuilt with the r key
+InitParams			init_params;
+
+// Phase timings when a profile file or the overlay is asked for, drawn with the p key
+Profiler			profiler;
+bool				profile_enabled = false;
+ProfileOverlay		profile_overlay;
+bool				overlay_visible = false;
+
+// Worlds larger than the max image size live in plain buffers
+bool				buffer_layout = false;
+
+// Cells stored as unsigned integers instead of normalized bytes
+bool				integer_state = false;
 
 }
 
 using namespace clrps;
 
 /*
- * Generate initial random seed for OpenCL
+ * Write a rectangle of cells to the universe, whichever layout it has
  */
-void randomize() {
-	GLfloat *seed = new GLfloat[WIDTH * HEIGHT];
+void writeCells(size_t x, size_t y, size_t width, size_t height, const GLubyte *cells) {
+	if(gl_backend) {
+		writeGlEngineCells(gl_engine, x, y, width, height, cells);
+		return;
+	}
+	markClEngineChanged(cl_engine);
+	if(buffer_layout) {
+		const size_t buffer_origin[] = {x, y, 0};
+		const size_t host_origin[] = {0, 0, 0};
+		const size_t region[] = {width, height, 1};
+		clEnqueueWriteBufferRect(queue, cl_engine.universe, CL_FALSE, buffer_origin, host_origin, region, config.width, 0, width, 0, cells, 0, NULL, NULL);
+	} else {
+		const size_t origin[] = {x, y, 0};
+		const size_t region[] = {width, height, 1};
+		clEnqueueWriteImage(queue, cl_engine.universe, CL_FALSE, origin, region, 0, 0, cells, 0, NULL, NULL);
+	}
+}
 
-	srand(time(NULL));
+/*
+ * Put the universe on display right away, after it was written from the host
+ */
+void showUniverse() {
+	// The GL backend draws its universe directly
+	if(gl_backend) {
+		return;
+	}
+	// A copy still in flight would make the ring drop this one
+	clFinish(queue);
+	if(publishFrame(display_ring, cl_engine)) {std::cerr << "Display runtime error!" << std::endl;}
+	clFinish(queue);
+}
 
-	for(unsigned int i = 0; i < WIDTH * HEIGHT; i++) {
-		seed[i] = rand() / (float) RAND_MAX;
+/*
+ * Build a world from a pattern's parameters, on the device unless the GL backend runs
+ */
+void generateWorld(const InitParams &params) {
+	if(gl_backend) {
+		std::vector<GLubyte> cells((size_t) config.width * config.height);
+		fillInitPattern(params, config.seed, &cells[0]);
+		writeCells(0, 0, config.width, config.height, &cells[0]);
+		return;
 	}
 
-	clEnqueueAcquireGLObjects(queue, 2, buffers, 0, NULL, NULL);
-	clEnqueueWriteBuffer(queue, random_buffer, CL_TRUE, 0, sizeof(GLfloat) * WIDTH * HEIGHT, seed, 0, NULL, NULL);
-	clEnqueueReleaseGLObjects(queue, 2, buffers, 0, NULL, NULL);
-	clFinish(queue);
+	if(enqueueInitPattern(cl_engine, params)) {std::cerr << "Init runtime error!" << std::endl;}
+	showUniverse();
+}
 
-	delete seed;
+/*
+ * Fill the universe with the starting pattern generated from the seed
+ */
+void randomize() {
+	generateWorld(init_params);
 }
 
 /*
  * Wipe all data from the universe :_D
  */
 void clear() {
-	const size_t origin[] = {0, 0, 0};
-	const size_t region[] = {WIDTH, HEIGHT, 1};
+	InitParams params;
+	clearPatternParams(params, config.width, config.height);
+	generateWorld(params);
+}
 
-	GLubyte *seed = new GLubyte[WIDTH * HEIGHT];
+/*
+ * Save the universe with its generation and seed
+ */
+void save() {
+	if(gl_backend) {
+		std::cerr << "Snapshots need the OpenCL backend" << std::endl;
+		return;
+	}
+	saveSnapshot(config.snapshot_file.c_str(), cl_engine);
+}
 
-	clEnqueueAcquireGLObjects(queue, 2, buffers, 0, NULL, NULL);
-	clEnqueueWriteImage(queue, universe_buffer, CL_FALSE, origin, region, 0, 0, seed, 0, NULL, NULL);
-	clEnqueueReleaseGLObjects(queue, 2, buffers, 0, NULL, NULL);
-	clFinish(queue);
+/*
+ * Continue from a saved universe
+ */
+bool restore(const char *file_path) {
+	if(gl_backend) {
+		std::cerr << "Snapshots need the OpenCL backend" << std::endl;
+		return false;
+	}
+	bool restored = loadSnapshot(file_path, cl_engine);
+	if(restored) {
+		showUniverse();
+	}
 
-	delete seed;
+	return restored;
 }
 
 /*
- * Place values to the universe
+ * Place values to the universe, applied with the next frame's edits
  */
 void touch() {
-    const size_t origin[] = {col, row, 0};
-    const size_t region[] = {1, 1, 1};
+	if(col >= config.width || row >= config.height) {
+		return;
+	}
 
-	clEnqueueAcquireGLObjects(queue, 2, buffers, 0, NULL, NULL);
-    clEnqueueWriteImage(queue, universe_buffer, CL_FALSE, origin, region, 0, 0, &current_tool, 0, NULL, NULL);
-	clEnqueueReleaseGLObjects(queue, 2, buffers, 0, NULL, NULL);
-	clFinish(queue);
+	editPoint(cl_edits, col, row, current_tool);
 }
 
 /*
@@ -204,18 +328,27 @@ void GLFWCALL char_handler(int character, int action) {
 		case 48:
 			current_tool = 0;
 			break;
-		case 49:
-			current_tool = 19;
-			break;
-		case 50:
-			current_tool = 29;
-			break;
-		case 51:
-			current_tool = 39;
+		case 49: case 50: case 51: case 52: case 53: case 54: case 55: case 56: case 57:
+			// Species 1..9 at full health
+			if(character - 48 <= RULE_SPECIES) {
+				current_tool = (character - 48) * RULE_HEALTH + RULE_HEALTH - 1;
+			}
 			break;
 		case 99:
 			clear();
 			break;
+		case 108:
+			restore(config.snapshot_file.c_str());
+			break;
+		case 112:
+			overlay_visible = profile_enabled && !overlay_visible;
+			break;
+		case 114:
+			randomize();
+			break;
+		case 115:
+			save();
+			break;
 		}
 	}
 }
@@ -235,19 +368,20 @@ void GLFWCALL pos_handler(int x, int y) {
 	y = (window_height - 1) - y;
 
 	// calculate actual row, column value
-	size_t new_row = y / (float) cell_size - (float) y_translate / CELL;
-	size_t new_col = x / (float) cell_size - (float) x_translate / CELL;
+	size_t new_row = y / (float) cell_size - (float) y_translate / config.cell;
+	size_t new_col = x / (float) cell_size - (float) x_translate / config.cell;
 	if(new_row != row || new_col != col) {
-		row = new_row;
-		col = new_col;
+		// Drags paint a line, so fast moves leave no gaps
 		if(glfwGetMouseButton(GLFW_MOUSE_BUTTON_1) == GLFW_PRESS) {
-			touch();
+			editLine(cl_edits, (int) col, (int) row, (int) new_col, (int) new_row, current_tool);
 		}
+		row = new_row;
+		col = new_col;
 	}
 	if(mouse_x != x || mouse_y != y) {
 		if(glfwGetMouseButton(GLFW_MOUSE_BUTTON_2) == GLFW_PRESS || glfwGetMouseButton(GLFW_MOUSE_BUTTON_3) == GLFW_PRESS) {
-			x_translate += ((x - mouse_x) / (float) cell_size) * CELL;
-			y_translate += ((y - mouse_y) / (float) cell_size) * CELL;
+			x_translate += ((x - mouse_x) / (float) cell_size) * config.cell;
+			y_translate += ((y - mouse_y) / (float) cell_size) * config.cell;
 			translate = glm::translate(glm::mat4(1.0f), glm::vec3(x_translate, y_translate, 0.0f));
 
 			glUseProgram(program);
@@ -260,10 +394,12 @@ void GLFWCALL pos_handler(int x, int y) {
 }
 
 void GLFWCALL wheel_handler(int pos) {
-	if(pos == 1) { cell_size += 1; }
-	else if(pos == -1) { cell_size -= cell_size > 1 ? 1 : 0; }
+	// Whole pixels per cell down to one, then halved per pyramid level
+	const float min_cell_size = 1.0f / (1u << display_ring.lod_top);
+	if(pos == 1) { cell_size = cell_size < 1.0f ? cell_size * 2.0f : cell_size + 1.0f; }
+	else if(pos == -1) { cell_size = cell_size > 1.0f ? cell_size - 1.0f : std::max(cell_size / 2.0f, min_cell_size); }
 
-	scale = glm::scale(glm::mat4(1.0f), glm::vec3((float) cell_size / CELL, (float) cell_size / CELL, 1.0f));
+	scale = glm::scale(glm::mat4(1.0f), glm::vec3(cell_size / config.cell, cell_size / config.cell, 1.0f));
 	glUseProgram(program);
 	glUniformMatrix4fv(scale_location, 1, GL_FALSE, &scale[0][0]);
 	glUseProgram(0);
@@ -292,7 +428,8 @@ void printDeviceInfo(cl_device_id device) {
 void initDisplay(unsigned int width, unsigned int height) {
 	glfwInit();
 
-	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
+	// Compute shaders came with 4.3
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, gl_backend ? 4 : 3);
 	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 3);
 	glfwOpenWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwOpenWindowHint(GLFW_FSAA_SAMPLES, 4);
@@ -300,6 +437,8 @@ void initDisplay(unsigned int width, unsigned int height) {
 		std::cerr << "GLFW: unable to open window" << std::endl;
 		running = 0;
 	} else {
+		// Core profile entry points are only loaded in experimental mode
+		glewExperimental = GL_TRUE;
 		if (glewInit() != GLEW_OK) {
 			std::cerr << "GLEW: failed to initialize" << std::endl;
 			running = 0;
@@ -331,31 +470,50 @@ void initGL() {
 	glClearColor(0.1, 0.1, 0.4, 0.0);
 
 	// Load shader program
-	program = loadShader("vertex_shader.glsl", "fragment_shader.glsl");
+	std::string defines;
+	if(buffer_layout) {
+		defines += "#define BUFFER_LAYOUT\n";
+	}
+	if(integer_state) {
+		defines += "#define INTEGER_STATE\n";
+	}
+	defines += ruleShaderDefines();
+	program = loadShader("vertex_shader.glsl", "fragment_shader.glsl", defines.c_str());
 
 	// Get texture uniform location
 	universe_texture_location  		= glGetUniformLocation(program, "universe");
-	background_texture_location  	= glGetUniformLocation(program, "background");
+	size_location  					= glGetUniformLocation(program, "size");
 	view_location  					= glGetUniformLocation(program, "view");
 	scale_location  				= glGetUniformLocation(program, "scale");
 	perspective_location  			= glGetUniformLocation(program, "perspective");
 	translate_location				= glGetUniformLocation(program, "translate");
 	frame_location					= glGetUniformLocation(program, "frame");
+	lod_location					= glGetUniformLocation(program, "lod");
+	lod_size_location				= glGetUniformLocation(program, "lod_size");
+	level_location					= glGetUniformLocation(program, "level");
+
+	// World sized quad
+	const GLfloat world_width = (GLfloat) config.width * config.cell;
+	const GLfloat world_height = (GLfloat) config.height * config.cell;
+	const GLfloat g_vertex_buffer_data[] = {
+		0.0f,			0.0f, 			0.0f, 1.0f,
+		0.0f,  			world_height, 	0.0f, 1.0f,
+		world_width, 	0.0f, 			0.0f, 1.0f,
+		world_width, 	world_height, 	0.0f, 1.0f
+	};
 
 	// Create vao for fullscreen quad
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 
-	GLuint vbo;
 	glGenBuffers(1, &vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_DYNAMIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	GLuint uvbo;
 	glGenBuffers(1, &uvbo);
 	glBindBuffer(GL_ARRAY_BUFFER, uvbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(g_uv_buffer_data), g_uv_buffer_data, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(g_uv_buffer_data), g_uv_buffer_data, GL_DYNAMIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	GLuint ibo;
@@ -387,44 +545,6 @@ void initGL() {
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
 	glBindVertexArray(0);
 
-	// Generate textures
-	glGenTextures(1, &universe_texture);
-	glBindTexture(GL_TEXTURE_2D, universe_texture);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, WIDTH, HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	glGenTextures(1, &update_texture);
-	glBindTexture(GL_TEXTURE_2D, update_texture);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, WIDTH, HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	GLubyte *bg = new GLubyte[WIDTH * HEIGHT];
-	for(int i = 0; i < WIDTH; i++) {
-		for(int j = 0; j < HEIGHT; j++) {
-			bg[i * WIDTH + j] = (i + j) % 2 * 0x11;
-		}
-	}
-
-	glGenTextures(1, &background_texture);
-	glBindTexture(GL_TEXTURE_2D, background_texture);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, WIDTH, HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, bg);
-	delete bg;
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	glBindTexture(GL_TEXTURE_2D, 0);
-
 	view = glm::lookAt(glm::vec3(0, 0, 1), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
 	perspective = glm::ortho(0.0f, 512.0f, 0.0f, 512.0f);
 	translate = glm::translate(glm::mat4(1.0f), glm::vec3(x_translate, y_translate, 0.0f));
@@ -437,7 +557,9 @@ void initGL() {
 	glUniformMatrix4fv(scale_location, 1, GL_FALSE, &scale[0][0]);
 
 	glUniform1i(universe_texture_location, 0);
-	glUniform1i(background_texture_location, 1);
+	glUniform1i(lod_location, 1);
+	glUniform1i(level_location, 0);
+	glUniform2i(size_location, config.width, config.height);
 	glUseProgram(0);
 }
 
@@ -445,12 +567,61 @@ void exitGL() {
 	std::cout << "= GL cleanup" << std::endl;
 
 	glDeleteVertexArrays(1, &vao);
-	glDeleteTextures(1, &universe_texture);
-	glDeleteTextures(1, &update_texture);
-	glDeleteTextures(1, &background_texture);
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &uvbo);
 	glDeleteProgram(program);
 }
 
+/*
+ * Shrink the quad to the part of the world inside the window, so no fragments
+ * are shaded off screen however large the world is
+ */
+void clipQuad() {
+	const GLfloat world_width = (GLfloat) config.width * config.cell;
+	const GLfloat world_height = (GLfloat) config.height * config.cell;
+
+	// Window corners in world units, the inverse of scale * translate
+	const GLfloat units = config.cell / cell_size;
+	GLfloat left = std::max(0.0f, -x_translate);
+	GLfloat bottom = std::max(0.0f, -y_translate);
+	GLfloat right = std::min(world_width, window_width * units - x_translate);
+	GLfloat top = std::min(world_height, window_height * units - y_translate);
+	if(right < left || top < bottom) {
+		right = left;
+		top = bottom;
+	}
+
+	const GLfloat vertex_data[] = {
+		left,	bottom,	0.0f, 1.0f,
+		left,	top,	0.0f, 1.0f,
+		right,	bottom,	0.0f, 1.0f,
+		right,	top,	0.0f, 1.0f
+	};
+	const GLfloat uv_data[] = {
+		left / world_width,		bottom / world_height,
+		left / world_width,		top / world_height,
+		right / world_width,	bottom / world_height,
+		right / world_width,	top / world_height
+	};
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertex_data), vertex_data);
+	glBindBuffer(GL_ARRAY_BUFFER, uvbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(uv_data), uv_data);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*
+ * Pyramid level with about one texel per screen pixel, 0 for the cells themselves
+ */
+unsigned int displayLevel() {
+	unsigned int level = 0;
+	while(level < display_ring.lod_top && cell_size * (2u << level) <= 1.0f) {
+		level++;
+	}
+	return level;
+}
+
 /*
  * Initialize OpenCL
  */
@@ -491,62 +662,560 @@ void initCL() {
 	context = clCreateContext(properties, 1, &device, NULL, NULL, &clError);
 
 	// Create command queue for device
-	queue = clCreateCommandQueue(context, device, 0, NULL);
+	queue = clCreateCommandQueue(context, device, profile_enabled ? CL_QUEUE_PROFILING_ENABLE : 0, NULL);
+
+	// Fall back to buffers if either API can not hold the world in one image
+	size_t image_width, image_height;
+	GLint texture_size;
+	clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(size_t), &image_width, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(size_t), &image_height, NULL);
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &texture_size);
+
+	buffer_layout = config.width > image_width || config.height > image_height ||
+			config.width > (GLuint) texture_size || config.height > (GLuint) texture_size;
+
+	if(buffer_layout) {
+		cl_ulong alloc_size;
+		GLint texture_buffer_size;
+		clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &alloc_size, NULL);
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texture_buffer_size);
+
+		const size_t cells = (size_t) config.width * config.height;
+		std::cout << "=-- World exceeds max image size, using buffer layout" << std::endl;
+		if(cells > alloc_size || cells > (GLuint) texture_buffer_size) {
+			std::cerr << "World of " << config.width << "x" << config.height << " cells does not fit the device" << std::endl;
+			running = 0;
+		}
+	}
+
+	cl_engine.context = context;
+	cl_engine.device = device;
+	cl_engine.queue = queue;
+	cl_engine.width = config.width;
+	cl_engine.height = config.height;
+	cl_engine.boundary = config.boundary;
+	cl_engine.buffer_layout = buffer_layout;
+	cl_engine.launch = config.launch;
+	cl_engine.seed = config.seed;
+	cl_engine.generation = 0;
+
+	// Use the tuned launch for this device and size unless one was given
+	const std::string tune_key = tuneKey(device, config.width, config.height);
+	if(config.autotune) {
+		if(autotuneLaunch(cl_engine, true, cl_engine.launch)) {
+			storeTunedLaunch(config.tune_cache.c_str(), tune_key, cl_engine.launch);
+		}
+	} else if(!config.launch_set && loadTunedLaunch(config.tune_cache.c_str(), tune_key, cl_engine.launch)) {
+		std::cout << "=-- Tuned launch: " << describeLaunch(cl_engine.launch) << std::endl;
+	}
 
-	std::stringstream build_options;
-	build_options << "-D WIDTH=" << WIDTH << " -D HEIGHT=" << HEIGHT;
-	kernel = loadKernel(context, device, "clrps_kernel.cl", build_options.str().data(), "rps");
+	integer_state = integerState(cl_engine.launch, buffer_layout);
+}
 
-	// Create image buffers from GL textures
-	universe_buffer = clCreateFromGLTexture(context, CL_MEM_READ_WRITE, GL_TEXTURE_2D, 0, universe_texture, 	&clError);
-	update_buffer 	= clCreateFromGLTexture(context, CL_MEM_READ_WRITE, GL_TEXTURE_2D, 0, update_texture, 	&clError);
+/*
+ * Build the kernel, allocate the universe and share the display images with CL
+ */
+void initCLMemory() {
+	// Set after tuning, the display ring takes it over from the engine
+	cl_engine.profiler = profile_enabled ? &profiler : NULL;
+	if(!initClEngine(cl_engine)) {
+		running = 0;
+	}
 
-	random_buffer	= clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(GLfloat) * WIDTH * HEIGHT, NULL, &clError);
+	// Nothing GL touches is written by the kernel, so stepping needs no acquire
+	if(!createClEngineMemory(cl_engine) || !initDisplayRing(display_ring, platform, cl_engine, integer_state)) {
+		running = 0;
+	}
 
-	// Sampler for kernel
-	sampler = clCreateSampler(context, CL_TRUE, CL_ADDRESS_REPEAT, CL_FILTER_NEAREST, &clError);
+	if(!config.stats_file.empty()) {
+		stats_enabled = initClStats(cl_stats, cl_engine, config.stats_file.c_str());
+	}
+	if(!config.export_file.empty()) {
+		export_enabled = initExporter(frame_exporter, cl_engine, config.export_file.c_str(), config.export_format, config.export_fps);
+	}
+	if(!initClEdits(cl_edits, cl_engine)) {
+		running = 0;
+	}
 }
 
 void exitCL() {
 	std::cout << "= CL cleanup" << std::endl;
-	clReleaseMemObject(universe_buffer);
-	clReleaseMemObject(update_buffer);
-	clReleaseMemObject(random_buffer);
-	clReleaseSampler(sampler);
-	clReleaseKernel(kernel);
+	if(stats_enabled) {
+		exitClStats(cl_stats);
+	}
+	if(export_enabled) {
+		exitExporter(frame_exporter);
+	}
+	exitClEdits(cl_edits);
+	for(int i = 0; i < FRAMES_AHEAD; i++) {
+		if(frame_markers[i].event) {
+			clReleaseEvent(frame_markers[i].event);
+		}
+	}
+	exitDisplayRing(display_ring);
+	releaseClEngineMemory(cl_engine);
+	exitClEngine(cl_engine);
 	clReleaseCommandQueue(queue);
 	clReleaseContext(context);
 }
 
-int main() {
+/*
+ * GL backend step: paint on the host, generations as compute dispatches in the render stream
+ */
+void simulateGl(unsigned int steps) {
+	if(!cl_edits.ops.empty()) {
+		applyGlEdits(gl_engine, cl_edits.ops);
+		cl_edits.applied += cl_edits.ops.size();
+		cl_edits.ops.clear();
+	}
+	if(steps) {
+		stepGlEngine(gl_engine, steps);
+	}
+}
+
+/*
+ * Set up the GL compute engine, no OpenCL is touched
+ */
+void initGlBackend() {
+	std::cout << "= GL compute initialization" << std::endl;
+
+	// Unsigned integer textures the shaders read and write directly
+	integer_state = true;
+	buffer_layout = false;
+	if(!initGlEngine(gl_engine, config.width, config.height, config.boundary, config.seed)) {
+		running = 0;
+	}
+	if(!config.stats_file.empty() || !config.export_file.empty()) {
+		std::cerr << "Statistics and frame export need the OpenCL backend, ignored" << std::endl;
+	}
+
+	initGL();
+}
+
+/*
+ * Enqueue several generations and the hand-over of the last one to the display, without a sync
+ */
+void simulate(unsigned int steps) {
+	if(gl_backend) {
+		simulateGl(steps);
+		return;
+	}
+
+	if(enqueueEdits(cl_edits, cl_engine)) {std::cerr << "Edit runtime error!" << std::endl;}
+
+	// Stop at every sampled or exported generation on the way
+	unsigned int remaining = steps;
+	while(remaining) {
+		cl_ulong batch = remaining;
+		if(stats_enabled) {
+			batch = std::min<cl_ulong>(batch, config.stats_every - cl_engine.generation % config.stats_every);
+		}
+		if(export_enabled) {
+			batch = std::min<cl_ulong>(batch, config.export_every - cl_engine.generation % config.export_every);
+		}
+
+		if(enqueueGenerations(cl_engine, batch)) {std::cerr << "Kernel runtime error!" << std::endl;}
+		if(stats_enabled && cl_engine.generation % config.stats_every == 0 && sampleClStats(cl_stats, cl_engine)) {
+			std::cerr << "Stats runtime error!" << std::endl;
+		}
+		if(export_enabled && cl_engine.generation % config.export_every == 0 && exportFrame(frame_exporter, cl_engine)) {
+			std::cerr << "Export runtime error!" << std::endl;
+		}
+		remaining -= batch;
+	}
+
+	if(publishFrame(display_ring, cl_engine)) {std::cerr << "Display runtime error!" << std::endl;}
+	clFlush(queue);
+
+	if(stats_enabled) {
+		pollClStats(cl_stats, false);
+	}
+}
+
+/*
+ * Stamp the time a frame marker was reached, called by the CL runtime
+ */
+void CL_CALLBACK markerReached(cl_event event, cl_int status, void *user_data) {
+	((FrameMarker *) user_data)->completed = profileClock();
+}
+
+/*
+ * Close the frame's simulation work with a marker
+ */
+void markFrame(unsigned int steps) {
+	FrameMarker &marker = frame_markers[frame_marker];
+	marker.steps = steps;
+	marker.enqueued = profileClock();
+	marker.completed = -1.0;
+
+	if(clEnqueueMarkerWithWaitList(queue, 0, NULL, &marker.event)) {
+		std::cerr << "Marker runtime error!" << std::endl;
+		marker.event = NULL;
+		return;
+	}
+	if(clSetEventCallback(marker.event, CL_COMPLETE, markerReached, &marker)) {
+		std::cerr << "Marker runtime error!" << std::endl;
+		clReleaseEvent(marker.event);
+		marker.event = NULL;
+		return;
+	}
+	clFlush(queue);
+	frame_marker = (frame_marker + 1) % FRAMES_AHEAD;
+}
+
+/*
+ * Wait until the oldest marked frame is done, so the queue holds FRAMES_AHEAD frames at most.
+ * Returns the device time of that frame and its generations, a negative time if there was none.
+ */
+double waitFrameMarker(unsigned int &steps) {
+	FrameMarker &marker = frame_markers[frame_marker];
+	if(!marker.event) {
+		return -1.0;
+	}
+
+	clWaitForEvents(1, &marker.event);
+	clReleaseEvent(marker.event);
+	marker.event = NULL;
+	// The callback may still be on its way
+	while(marker.completed < 0.0) {
+		std::this_thread::yield();
+	}
+
+	// The device got to the frame once it was enqueued and the one before was done
+	const double device_time = marker.completed - std::max(marker.enqueued, marker_completed);
+	marker_completed = marker.completed;
+	steps = marker.steps;
+	return device_time;
+}
+
+/*
+ * Close a host phase that started at since, returns its end as the next start
+ */
+double phaseMark(int phase, double since) {
+	const double now = profileClock();
+	if(profile_enabled) {
+		profileHost(profiler, phase, since, now);
+	}
+	return now;
+}
+
+/*
+ * Pick the generations per frame that fill the frame budget left after rendering
+ */
+unsigned int adaptSteps(unsigned int steps, double simulation_time, double render_time, double loop_time) {
+	double budget = loop_time - render_time;
+	if(simulation_time <= 0.0 || budget <= 0.0) {
+		return steps > 1 ? steps / 2 : 1;
+	}
+
+	// Move halfway towards the estimate to damp jitter
+	double target = steps * budget / simulation_time;
+	double next = (steps + target) / 2.0;
+
+	if(next < 1.0) {
+		return 1;
+	}
+	if(next > config.max_steps) {
+		return config.max_steps;
+	}
+	return (unsigned int) next;
+}
+
+/*
+ * Run the native engine without touching GLFW / GLEW
+ */
+int runHeadless() {
+	CpuEngine engine;
+	const unsigned long long generations = config.generations;
+
+	std::cout << "= Headless CPU simulation " << config.width << "x" << config.height << std::endl;
+	initCpuEngine(engine, config.width, config.height, config.threads, config.seed, config.boundary);
+	engine.temporal_steps = config.temporal;
+	std::cout << "=-- Worker threads: " << threadCount(engine.pool) << ", generations per pass: " << engine.temporal_steps << std::endl;
+
+	randomizeCpuEngine(engine);
+
+	std::cout << std::endl << "= Running." << std::endl;
+	const unsigned int report = 100;
+	timespec last, now;
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	const timespec first = last;
+	now = last;
+	while(running && engine.generation < generations) {
+		unsigned int batch = std::min<unsigned long long>(report, generations - engine.generation);
+		stepCpuEngine(engine, batch);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double elapsed = (now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec) * 1e-9;
+		last = now;
+		std::cout << "=-- Generation " << engine.generation << "\t" << batch / elapsed << " gen/s" << std::endl;
+	}
+
+	double total = (now.tv_sec - first.tv_sec) + (now.tv_nsec - first.tv_nsec) * 1e-9;
+	std::cout << "= Done: " << engine.generation << " generations in " << total << " s, "
+			<< engine.generation * (double) config.width * config.height / total << " cell updates/s" << std::endl;
+
+	exitCpuEngine(engine);
+
+	return 0;
+}
+
+/*
+ * Run the OpenCL kernel without a window, the world split into slabs over several devices
+ */
+int runSlabs() {
+	ClSlabs slabs;
+	const unsigned long long generations = config.generations;
+
+	std::cout << "= Headless slab simulation " << config.width << "x" << config.height << std::endl;
+	if(!initClSlabs(slabs, config.platform, config.slabs, config.width, config.height, config.boundary, config.seed)) {
+		exitClSlabs(slabs);
+		return 1;
+	}
+
+	std::vector<GLubyte> cells((size_t) config.width * config.height);
+	for(size_t y = 0; y < config.height; y++) {
+		for(size_t x = 0; x < config.width; x++) {
+			cells[y * config.width + x] = ruleInitialState(config.seed, x, y);
+		}
+	}
+	writeClSlabs(slabs, &cells[0]);
+
+	std::cout << std::endl << "= Running." << std::endl;
+	const unsigned int report = 100;
+	timespec last, now;
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	const timespec first = last;
+	now = last;
+	while(running && slabs.generation < generations) {
+		unsigned int batch = std::min<unsigned long long>(report, generations - slabs.generation);
+		if(stepClSlabs(slabs, batch)) {
+			std::cerr << "Kernel runtime error!" << std::endl;
+			break;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double elapsed = (now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec) * 1e-9;
+		last = now;
+		std::cout << "=-- Generation " << slabs.generation << "\t" << batch / elapsed << " gen/s" << std::endl;
+	}
+
+	double total = (now.tv_sec - first.tv_sec) + (now.tv_nsec - first.tv_nsec) * 1e-9;
+	std::cout << "= Done: " << slabs.generation << " generations in " << total << " s, "
+			<< slabs.generation * (double) config.width * config.height / total << " cell updates/s" << std::endl;
+
+	exitClSlabs(slabs);
+
+	return 0;
+}
+
+/*
+ * Run a world kept in a file without a window, streamed through the device in bands
+ */
+int runOutOfCore() {
+	ClBands bands;
+
+	std::cout << "= Headless out-of-core simulation" << std::endl;
+	if(!initClBands(bands, config.platform, config.device, config.out_of_core.c_str(), (size_t) config.band_budget << 20,
+			config.width, config.height, config.boundary, config.seed, init_params)) {
+		exitClBands(bands);
+		return 1;
+	}
+
+	// Continues an existing file, the generations count from where it stopped
+	const unsigned long long generations = bands.generation + config.generations;
+	const double cells = (double) bands.width * bands.height;
+
+	std::cout << std::endl << "= Running." << std::endl;
+	const unsigned int report = 10;
+	const unsigned long long start = bands.generation;
+	timespec last, now;
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	const timespec first = last;
+	now = last;
+	while(running && bands.generation < generations) {
+		unsigned int batch = std::min<unsigned long long>(report, generations - bands.generation);
+		if(stepClBands(bands, batch)) {
+			std::cerr << "Kernel runtime error!" << std::endl;
+			break;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double elapsed = (now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec) * 1e-9;
+		last = now;
+		std::cout << "=-- Generation " << bands.generation << "\t" << batch / elapsed << " gen/s\t"
+				<< 2 * batch * cells / elapsed / (1 << 20) << " MiB/s through the file" << std::endl;
+	}
+
+	double total = (now.tv_sec - first.tv_sec) + (now.tv_nsec - first.tv_nsec) * 1e-9;
+	std::cout << "= Done: " << bands.generation - start << " generations in " << total << " s, "
+			<< (bands.generation - start) * cells / total << " cell updates/s, world at generation " << bands.generation << std::endl;
+
+	exitClBands(bands);
+
+	return 0;
+}
+
+/*
+ * Run an ensemble of independent worlds without a window, all stepped by one launch
+ */
+int runEnsemble() {
+	ClEnsemble ensemble;
+	const unsigned long long generations = config.generations;
+	const bool stats = !config.stats_file.empty();
+
+	std::cout << "= Headless ensemble simulation " << config.ensemble << " x " << config.width << "x" << config.height << std::endl;
+	if(!initClEnsemble(ensemble, config.platform, config.device, config.width, config.height, config.ensemble, config.boundary, config.seed)) {
+		return 1;
+	}
+	if(!randomizeClEnsemble(ensemble) || (stats && !openClEnsembleStats(ensemble, config.stats_file.c_str()))) {
+		exitClEnsemble(ensemble);
+		return 1;
+	}
+
+	std::cout << std::endl << "= Running." << std::endl;
+	const double cells = (double) config.width * config.height * config.ensemble;
+	const unsigned int report = 100;
+	unsigned long long reported = 0;
+	timespec last, now;
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	const timespec first = last;
+	now = last;
+	while(running && ensemble.generation < generations) {
+		// Batches end on statistics samples
+		unsigned int batch = std::min<unsigned long long>(report - ensemble.generation % report, generations - ensemble.generation);
+		if(stats) {
+			batch = std::min<unsigned int>(batch, config.stats_every - ensemble.generation % config.stats_every);
+			if(ensemble.generation % config.stats_every == 0 && sampleClEnsembleStats(ensemble)) {
+				std::cerr << "Stats runtime error!" << std::endl;
+				break;
+			}
+		}
+		if(stepClEnsemble(ensemble, batch)) {
+			std::cerr << "Kernel runtime error!" << std::endl;
+			break;
+		}
+
+		if(ensemble.generation % report == 0 || ensemble.generation == generations) {
+			clFinish(ensemble.queue);
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			double elapsed = (now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec) * 1e-9;
+			unsigned long long steps = ensemble.generation - reported;
+			last = now;
+			reported = ensemble.generation;
+			std::cout << "=-- Generation " << ensemble.generation << "\t" << steps / elapsed << " gen/s\t"
+					<< steps * cells / elapsed << " cell updates/s" << std::endl;
+		}
+	}
+	if(stats && running && ensemble.generation % config.stats_every == 0) {
+		sampleClEnsembleStats(ensemble);
+	}
+	clFinish(ensemble.queue);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	double total = (now.tv_sec - first.tv_sec) + (now.tv_nsec - first.tv_nsec) * 1e-9;
+	std::cout << "= Done: " << ensemble.generation << " generations of " << config.ensemble << " worlds in " << total << " s, "
+			<< ensemble.generation * cells / total << " cell updates/s" << std::endl;
+
+	exitClEnsemble(ensemble);
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
 	signal(SIGINT, exit_handler);
 
+	defaultConfig(config);
+	if(!parseArguments(config, argc, argv)) {
+		printUsage(argv[0]);
+		return 1;
+	}
+	cell_size = config.cell;
+	if(!initPatternParams(init_params, config)) {
+		return 1;
+	}
+
+	std::cout << "= Seed: " << config.seed << std::endl;
+
+	if(!config.out_of_core.empty()) {
+		return runOutOfCore();
+	}
+	if(!config.slabs.empty()) {
+		return runSlabs();
+	}
+	if(config.ensemble) {
+		return runEnsemble();
+	}
+	if(config.headless) {
+		return runHeadless();
+	}
+
+	gl_backend = config.backend == "gl";
+	profile_enabled = !config.profile_file.empty() || config.overlay;
 	initDisplay(window_width, window_height);
 
-	initGL();
-	initCL();
+	if(gl_backend) {
+		initGlBackend();
+	} else {
+		initCL();
+		initGL();
+		initCLMemory();
+	}
 
-	randomize();
+	// The GL backend has host phases only
+	if(profile_enabled) {
+		if(!initProfiler(profiler, gl_backend ? NULL : queue, config.profile_file.c_str(), config.profile_format) ||
+				!initProfileOverlay(profile_overlay)) {
+			running = 0;
+		}
+		overlay_visible = config.overlay;
+	}
+
+	if(config.restore_file.empty() || !restore(config.restore_file.c_str())) {
+		randomize();
+	}
+	if(!config.edit_script.empty() && !loadEditScript(cl_edits, config.edit_script.c_str(), config.width, config.height)) {
+		running = 0;
+	}
 
 	std::cout << std::endl << "= Running." << std::endl;
 	unsigned int frame = 0;
-	const double loop_time = 1.0 / FPS;
+	unsigned int steps = config.steps;
+	// Frame times on the profiler's clock, the phases are measured against them
+	double rate_time = profileClock();
+	unsigned long long rate_generations = 0;
+	const double loop_time = 1.0 / config.fps;
     while(running) {
-    	double start_time = glfwGetTime();
+    	double start_time = profileClock();
     	// Render
     	glClear(GL_COLOR_BUFFER_BIT);
 
+    	clipQuad();
+
     	glUseProgram(program);
     	glBindVertexArray(vao);
 
     	glActiveTexture(GL_TEXTURE0);
-    	glBindTexture(GL_TEXTURE_2D, universe_texture);
+    	unsigned int level = 0;
+    	if(gl_backend) {
+    		glBindTexture(GL_TEXTURE_2D, gl_engine.universe);
+    	} else {
+    		glBindTexture(buffer_layout ? GL_TEXTURE_BUFFER : GL_TEXTURE_2D, frontTexture(display_ring));
+
+    		// Zoomed out below a pixel per cell the pyramid level stands in for the cells
+    		display_ring.lod_wanted = displayLevel();
+    		GLuint lod_texture;
+    		level = frontLevel(display_ring, lod_texture);
+    		if(level) {
+    			glActiveTexture(GL_TEXTURE1);
+    			glBindTexture(GL_TEXTURE_2D, lod_texture);
+    			glUniform2i(lod_size_location, display_ring.lod_width[level - 1], display_ring.lod_height[level - 1]);
+    		}
+    	}
+    	glUniform1i(level_location, level);
 
     	glUniform1f(frame_location, (float) frame);
 
-    	glActiveTexture(GL_TEXTURE1);
-    	glBindTexture(GL_TEXTURE_2D, background_texture);
-
     	glDrawElements(
     			GL_TRIANGLES,
     			6,
@@ -556,42 +1225,78 @@ int main() {
     	glBindVertexArray(0);
     	glUseProgram(0);
 
+    	if(overlay_visible) {
+    		drawProfileOverlay(profile_overlay, profiler, window_width, window_height, loop_time);
+    	}
+
+    	// The image is free for the next copy once this signals
+    	if(!gl_backend) {
+    		frontDrawn(display_ring);
+    	}
+    	double mark = phaseMark(PHASE_DRAW, start_time);
+
     	glfwSwapBuffers();
+    	mark = phaseMark(PHASE_SWAP, mark);
 
     	frame++;
 
     	// Update
     	if(!clrps::pause) {
-    		clEnqueueAcquireGLObjects(queue, 2, buffers, 0, NULL, NULL);
-
-    		clSetKernelArg(kernel, 0, sizeof(cl_mem), &universe_buffer);
-    		clSetKernelArg(kernel, 1, sizeof(cl_mem), &update_buffer);
-    		clSetKernelArg(kernel, 2, sizeof(cl_mem), &random_buffer);
-    		clSetKernelArg(kernel, 3, sizeof(cl_sampler), &sampler);
-
-    		const size_t work_size[] = {WIDTH, HEIGHT};
-    		if(clEnqueueNDRangeKernel(queue, kernel, 2, NULL, work_size, NULL, 0, NULL, NULL)) {std::cerr << "Kernel runtime error!" << std::endl;}
-
-    		cl_mem temp_mem = universe_buffer;
-    		universe_buffer = update_buffer;
-    		update_buffer = temp_mem;
-
-    		GLuint temp_texture;
-    		temp_texture = universe_texture;
-    		universe_texture = update_texture;
-    		update_texture = temp_texture;
+    		double render_time = mark - start_time;
+
+    		// CL computes while GL draws, bounded to FRAMES_AHEAD frames in flight.
+    		// The GL backend shares the render stream, the swap throttles it.
+    		unsigned int marked_steps;
+    		double device_time = gl_backend ? glEngineTime(gl_engine, marked_steps) : waitFrameMarker(marked_steps);
+    		mark = phaseMark(PHASE_WAIT, mark);
+
+    		simulate(steps);
+    		if(!gl_backend) {
+    			markFrame(steps);
+    		}
+    		mark = phaseMark(PHASE_ENQUEUE, mark);
+    		rate_generations += steps;
+
+    		if(config.turbo && device_time >= 0.0) {
+    			steps = adaptSteps(steps, device_time * steps / marked_steps, render_time, loop_time);
+    		}
+    	} else if(!cl_edits.ops.empty() || (!gl_backend && frontLevelMissing(display_ring))) {
+    		// Paint or zoom out while paused
+    		simulate(0);
+    		mark = phaseMark(PHASE_ENQUEUE, mark);
+    	}
 
-    		clEnqueueReleaseGLObjects(queue, 2, buffers, 0, NULL, NULL);
-    		clFinish(queue);
+    	// Report simulation rate once a second
+    	if(start_time - rate_time >= 1.0) {
+    		std::stringstream title;
+    		title << "CL rock, paper, scissors - " << (unsigned long) (rate_generations / (start_time - rate_time)) << " gen/s, " << steps << " per frame";
+    		glfwSetWindowTitle(title.str().c_str());
+    		rate_time = start_time;
+    		rate_generations = 0;
     	}
 
     	// Frame rate control
-    	double work_time = glfwGetTime() - start_time;
+    	double work_time = profileClock() - start_time;
     	double sleep_time = loop_time - work_time;
 		glfwSleep(sleep_time);
+
+		if(profile_enabled) {
+			phaseMark(PHASE_SLEEP, start_time + work_time);
+			endProfileFrame(profiler, start_time, profileClock());
+			collectProfile(profiler);
+		}
     }
 
-	exitCL();
+	if(profile_enabled) {
+		exitProfiler(profiler);
+		exitProfileOverlay(profile_overlay);
+	}
+
+	if(gl_backend) {
+		exitGlEngine(gl_engine);
+	} else {
+		exitCL();
+	}
 	exitGL();
 	exitDisplay();
 
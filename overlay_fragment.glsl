@@ -0,0 +1,9 @@
+#version 330
+
+in vec4 bar_color;
+
+out vec4 color;
+
+void main() {
+	color = bar_color;
+}
@@ -0,0 +1,14 @@
+#version 330
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec4 color;
+
+// Window size in pixels, positions are in pixels from the bottom left
+uniform vec2 viewport;
+
+out vec4 bar_color;
+
+void main() {
+    gl_Position = vec4(position / viewport * 2.0 - 1.0, 0.0, 1.0);
+    bar_color = color;
+}
@@ -0,0 +1,93 @@
+#include "profile_overlay.hpp"
+#include "gl_utils.hpp"
+
+#include <algorithm>
+
+// Overlay bar colors, device phases in warm and host phases in cool tones
+static const GLfloat phase_colors[PROFILE_PHASES][3] = {
+	{1.0f, 0.3f, 0.2f}, {1.0f, 0.6f, 0.2f}, {1.0f, 0.8f, 0.3f}, {0.9f, 0.5f, 0.6f}, {0.8f, 0.4f, 0.1f},
+	{0.3f, 0.7f, 1.0f}, {0.4f, 0.5f, 1.0f}, {0.6f, 0.4f, 1.0f}, {0.3f, 0.9f, 0.8f}, {0.5f, 0.5f, 0.5f},
+	{0.8f, 0.8f, 0.8f}, {1.0f, 1.0f, 1.0f}
+};
+
+bool initProfileOverlay(ProfileOverlay &overlay) {
+	overlay.program = loadShader("overlay_vertex.glsl", "overlay_fragment.glsl");
+	if(!overlay.program) {
+		return false;
+	}
+	overlay.viewport_location = glGetUniformLocation(overlay.program, "viewport");
+
+	glGenVertexArrays(1, &overlay.vao);
+	glBindVertexArray(overlay.vao);
+	glGenBuffers(1, &overlay.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, overlay.vbo);
+
+	// Pixel position and RGBA color per vertex
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+	return true;
+}
+
+void exitProfileOverlay(ProfileOverlay &overlay) {
+	glDeleteBuffers(1, &overlay.vbo);
+	glDeleteVertexArrays(1, &overlay.vao);
+	glDeleteProgram(overlay.program);
+}
+
+/*
+ * Two triangles of a rectangle, y up
+ */
+static void addRect(std::vector<GLfloat> &vertices, float left, float bottom, float right, float top, const GLfloat *rgb, float alpha) {
+	const float corners[6][2] = {{left, bottom}, {right, bottom}, {left, top}, {left, top}, {right, bottom}, {right, top}};
+	for(int i = 0; i < 6; i++) {
+		const GLfloat vertex[] = {corners[i][0], corners[i][1], rgb[0], rgb[1], rgb[2], alpha};
+		vertices.insert(vertices.end(), vertex, vertex + 6);
+	}
+}
+
+void drawProfileOverlay(ProfileOverlay &overlay, const Profiler &profiler, int width, int height, double budget) {
+	const float margin = 8.0f, row = 6.0f, spacing = 2.0f;
+	const float area = std::min(300.0f, width - 2.0f * margin);
+	static const GLfloat black[] = {0.0f, 0.0f, 0.0f};
+	static const GLfloat white[] = {1.0f, 1.0f, 1.0f};
+
+	overlay.vertices.clear();
+	const float top = height - margin;
+	addRect(overlay.vertices, margin - spacing, top - PROFILE_PHASES * (row + spacing) - spacing, margin + area + spacing, top + spacing, black, 0.6f);
+
+	for(int phase = 0; phase < PROFILE_PHASES; phase++) {
+		double percentiles[3];
+		if(!phasePercentiles(profiler, phase, percentiles)) {
+			continue;
+		}
+		const float row_top = top - phase * (row + spacing);
+		const float alphas[] = {1.0f, 0.6f, 0.3f};
+		// Widest first, so p50 ends up on top
+		for(int i = 2; i >= 0; i--) {
+			const float length = (float) std::min(1.0, percentiles[i] / budget) * area;
+			addRect(overlay.vertices, margin, row_top - row, margin + length, row_top, phase_colors[phase], alphas[i]);
+		}
+	}
+	// Frame budget
+	addRect(overlay.vertices, margin + area - 1.0f, top - PROFILE_PHASES * (row + spacing), margin + area, top, white, 0.8f);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glUseProgram(overlay.program);
+	glUniform2f(overlay.viewport_location, (GLfloat) width, (GLfloat) height);
+	glBindVertexArray(overlay.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, overlay.vbo);
+	glBufferData(GL_ARRAY_BUFFER, overlay.vertices.size() * sizeof(GLfloat), &overlay.vertices[0], GL_STREAM_DRAW);
+	glDrawArrays(GL_TRIANGLES, 0, overlay.vertices.size() / 6);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	glDisable(GL_BLEND);
+}
@@ -0,0 +1,24 @@
+#ifndef PROFILE_OVERLAY_HPP
+#define PROFILE_OVERLAY_HPP
+
+#include <vector>
+
+#include "gl_utils.hpp"
+#include "profiler.hpp"
+
+/*
+ * On-screen bars of the phase percentiles: a row per phase, p50 solid,
+ * p95 and p99 fading, scaled so the frame budget spans the bar area
+ */
+struct ProfileOverlay {
+	GLuint				program;
+	GLuint				viewport_location;
+	GLuint				vao, vbo;
+	std::vector<GLfloat>	vertices;
+};
+
+bool initProfileOverlay(ProfileOverlay &overlay);
+void exitProfileOverlay(ProfileOverlay &overlay);
+void drawProfileOverlay(ProfileOverlay &overlay, const Profiler &profiler, int width, int height, double budget);
+
+#endif //PROFILE_OVERLAY_HPP
@@ -0,0 +1,204 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+static const char *phase_names[PROFILE_PHASES] = {
+	"kernel", "acquire", "copy", "pyramid", "release",
+	"draw", "swap", "wait", "enqueue", "sleep", "gap", "frame"
+};
+
+const char *phaseName(int phase) {
+	return phase_names[phase];
+}
+
+double profileClock() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void addSample(Profiler &profiler, int phase, double seconds) {
+	profiler.samples[phase][profiler.sample_head[phase]] = seconds;
+	profiler.sample_head[phase] = (profiler.sample_head[phase] + 1) % PROFILE_WINDOW;
+	if(profiler.sample_count[phase] < PROFILE_WINDOW) {
+		profiler.sample_count[phase]++;
+	}
+}
+
+/*
+ * One interval of the trace, times in seconds on the host clock
+ */
+static void writeRecord(Profiler &profiler, int phase, unsigned long long frame, double start, double duration) {
+	if(!profiler.trace.is_open()) {
+		return;
+	}
+
+	const char *track = PHASE_DEVICE(phase) ? "device" : "host";
+	if(profiler.chrome) {
+		profiler.trace << ",\n{\"name\":\"" << phaseName(phase) << "\",\"cat\":\"" << track << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+				<< (PHASE_DEVICE(phase) ? 2 : 1) << ",\"ts\":" << start * 1e6 << ",\"dur\":" << duration * 1e6
+				<< ",\"args\":{\"frame\":" << frame << "}}";
+	} else {
+		profiler.trace << frame << "," << phaseName(phase) << "," << track << "," << start * 1e3 << "," << duration * 1e3 << "\n";
+	}
+}
+
+bool initProfiler(Profiler &profiler, cl_command_queue queue, const char *trace_file, const std::string &format) {
+	memset(profiler.sample_count, 0, sizeof(profiler.sample_count));
+	memset(profiler.sample_head, 0, sizeof(profiler.sample_head));
+	profiler.frame = 0;
+	profiler.frame_host = 0.0;
+	profiler.chrome = format == "chrome";
+
+	// Device clock offset: the host time a marker was seen complete, less its end.
+	// Without profiling info for markers the first collected command sets it.
+	profiler.calibrated = false;
+	profiler.device_offset = 0.0;
+	cl_event marker;
+	if(queue && !clEnqueueMarkerWithWaitList(queue, 0, NULL, &marker)) {
+		clWaitForEvents(1, &marker);
+		const double host = profileClock();
+		cl_ulong end;
+		if(!clGetEventProfilingInfo(marker, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL)) {
+			profiler.device_offset = host - end * 1e-9;
+			profiler.calibrated = true;
+		}
+		clReleaseEvent(marker);
+	}
+
+	if(!*trace_file) {
+		return true;
+	}
+	profiler.trace.open(trace_file);
+	if(!profiler.trace) {
+		std::cerr << "Unable to open profile trace: " << trace_file << std::endl;
+		return false;
+	}
+	profiler.trace << std::fixed << std::setprecision(3);
+	if(profiler.chrome) {
+		// Track names first, every record is appended with a leading comma
+		profiler.trace << "{\"traceEvents\":[\n"
+				<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"host\"}},\n"
+				<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"device\"}}";
+	} else {
+		profiler.trace << "frame,phase,track,start_ms,duration_ms\n";
+	}
+
+	std::cout << "=-- Profile trace: " << trace_file << " (" << (profiler.chrome ? "chrome" : "csv") << ")" << std::endl;
+	return true;
+}
+
+cl_event *profileEvent(Profiler *profiler, int phase) {
+	if(!profiler) {
+		return NULL;
+	}
+	ProfileEvent pending = {NULL, phase, profiler->frame};
+	profiler->pending.push_back(pending);
+	return &profiler->pending.back().event;
+}
+
+void profileRetained(Profiler *profiler, int phase, cl_event event) {
+	if(profiler) {
+		clRetainEvent(event);
+		*profileEvent(profiler, phase) = event;
+	}
+}
+
+void profileHost(Profiler &profiler, int phase, double start, double end) {
+	addSample(profiler, phase, end - start);
+	profiler.frame_host += end - start;
+	writeRecord(profiler, phase, profiler.frame, start, end - start);
+}
+
+/*
+ * Sample and trace a finished command
+ */
+static void takeEvent(Profiler &profiler, const ProfileEvent &pending) {
+	cl_ulong start, end;
+	if(clGetEventProfilingInfo(pending.event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL) ||
+			clGetEventProfilingInfo(pending.event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL)) {
+		return;
+	}
+	if(!profiler.calibrated) {
+		profiler.device_offset = profileClock() - end * 1e-9;
+		profiler.calibrated = true;
+	}
+
+	addSample(profiler, pending.phase, (end - start) * 1e-9);
+	writeRecord(profiler, pending.phase, pending.frame, start * 1e-9 + profiler.device_offset, (end - start) * 1e-9);
+}
+
+void collectProfile(Profiler &profiler) {
+	size_t kept = 0;
+	for(size_t i = 0; i < profiler.pending.size(); i++) {
+		const ProfileEvent pending = profiler.pending[i];
+		// The enqueue failed
+		if(!pending.event) {
+			continue;
+		}
+
+		cl_int status;
+		clGetEventInfo(pending.event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL);
+		if(status > CL_COMPLETE) {
+			profiler.pending[kept++] = pending;
+			continue;
+		}
+		if(status == CL_COMPLETE) {
+			takeEvent(profiler, pending);
+		}
+		clReleaseEvent(pending.event);
+	}
+	profiler.pending.resize(kept);
+}
+
+void endProfileFrame(Profiler &profiler, double frame_start, double frame_end) {
+	addSample(profiler, PHASE_GAP, std::max(0.0, frame_end - frame_start - profiler.frame_host));
+	addSample(profiler, PHASE_FRAME, frame_end - frame_start);
+	writeRecord(profiler, PHASE_FRAME, profiler.frame, frame_start, frame_end - frame_start);
+
+	profiler.frame_host = 0.0;
+	profiler.frame++;
+}
+
+bool phasePercentiles(const Profiler &profiler, int phase, double percentiles[3]) {
+	const unsigned int count = profiler.sample_count[phase];
+	if(!count) {
+		return false;
+	}
+
+	std::vector<double> window(profiler.samples[phase], profiler.samples[phase] + count);
+	const double levels[] = {0.50, 0.95, 0.99};
+	for(int i = 0; i < 3; i++) {
+		std::vector<double>::iterator nth = window.begin() + (size_t) (levels[i] * (count - 1));
+		std::nth_element(window.begin(), nth, window.end());
+		percentiles[i] = *nth;
+	}
+	return true;
+}
+
+void exitProfiler(Profiler &profiler) {
+	for(size_t i = 0; i < profiler.pending.size(); i++) {
+		if(profiler.pending[i].event) {
+			clWaitForEvents(1, &profiler.pending[i].event);
+		}
+	}
+	collectProfile(profiler);
+
+	std::cout << "= Profile, last " << PROFILE_WINDOW << " samples (p50 / p95 / p99 ms):" << std::endl;
+	for(int phase = 0; phase < PROFILE_PHASES; phase++) {
+		double percentiles[3];
+		if(phasePercentiles(profiler, phase, percentiles)) {
+			std::cout << "=-- " << std::left << std::setw(8) << phaseName(phase) << std::right << std::fixed << std::setprecision(3)
+					<< "\t" << percentiles[0] * 1e3 << "\t" << percentiles[1] * 1e3 << "\t" << percentiles[2] * 1e3 << std::endl;
+		}
+	}
+
+	if(profiler.trace.is_open()) {
+		if(profiler.chrome) {
+			profiler.trace << "\n],\"displayTimeUnit\":\"ms\"}\n";
+		}
+		profiler.trace.close();
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "utils.hpp"
+
+// Device phases, timed with CL profiling events, one sample per command
+#define PHASE_KERNEL		0	// rps kernel, one generation
+#define PHASE_ACQUIRE		1	// display image acquire
+#define PHASE_COPY			2	// universe copy into the display image
+#define PHASE_PYRAMID		3	// zoom-out pyramid reduction
+#define PHASE_RELEASE		4	// display image release
+// Host phases, one sample per frame
+#define PHASE_DRAW			5	// render calls up to the swap
+#define PHASE_SWAP			6	// glfwSwapBuffers
+#define PHASE_WAIT			7	// waiting for the frame marker FRAMES_AHEAD frames back
+#define PHASE_ENQUEUE		8	// enqueueing the frame's edits, generations and display copy
+#define PHASE_SLEEP			9	// frame rate sleep
+#define PHASE_GAP			10	// rest of the frame outside the phases above
+#define PHASE_FRAME			11	// whole frame
+#define PROFILE_PHASES		12
+
+#define PHASE_DEVICE(phase)	((phase) <= PHASE_RELEASE)
+
+// Samples per phase the percentiles are taken over
+#define PROFILE_WINDOW		512
+
+/*
+ * Device command waiting for its profiling info
+ */
+struct ProfileEvent {
+	cl_event			event;
+	int					phase;
+	unsigned long long	frame;
+};
+
+/*
+ * Hot path timing: rolling windows of phase durations for percentiles,
+ * optionally streamed to a CSV or Chrome trace-event file.
+ * Host times are profileClock() seconds, device times are moved onto
+ * that clock by an offset measured once with a marker.
+ */
+struct Profiler {
+	double				samples[PROFILE_PHASES][PROFILE_WINDOW];
+	unsigned int		sample_count[PROFILE_PHASES], sample_head[PROFILE_PHASES];
+
+	std::vector<ProfileEvent>	pending;
+	unsigned long long	frame;
+	double				frame_host;		// host phase time of the frame so far
+
+	double				device_offset;
+	bool				calibrated;
+
+	std::ofstream		trace;
+	bool				chrome;
+};
+
+/*
+ * Open the trace (none if empty) as "csv" or "chrome".
+ * The queue has to be created with CL_QUEUE_PROFILING_ENABLE.
+ */
+bool initProfiler(Profiler &profiler, cl_command_queue queue, const char *trace_file, const std::string &format);
+
+/*
+ * Wait for the pending commands, print the percentiles and close the trace
+ */
+void exitProfiler(Profiler &profiler);
+
+/*
+ * Event slot for a command of a device phase, NULL without a profiler,
+ * so it can be passed straight to the enqueue call
+ */
+cl_event *profileEvent(Profiler *profiler, int phase);
+
+/*
+ * Time an event the caller keeps, the profiler takes a reference of its own
+ */
+void profileRetained(Profiler *profiler, int phase, cl_event event);
+
+/*
+ * Record a host phase of the current frame
+ */
+void profileHost(Profiler &profiler, int phase, double start, double end);
+
+/*
+ * Take the timings of completed commands, close the frame with its gap and whole time
+ */
+void collectProfile(Profiler &profiler);
+void endProfileFrame(Profiler &profiler, double frame_start, double frame_end);
+
+/*
+ * p50, p95 and p99 of a phase in seconds, false before its first sample
+ */
+bool phasePercentiles(const Profiler &profiler, int phase, double percentiles[3]);
+
+const char *phaseName(int phase);
+
+/*
+ * Monotonic host clock of the profiler in seconds
+ */
+double profileClock();
+
+#endif //PROFILER_HPP
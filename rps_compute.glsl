@@ -0,0 +1,124 @@
+#version 430
+
+/*
+ * Rock, paper, scissors generation as a GL compute shader, the GL backend's
+ * counterpart of rps_int. GLSL has no includes and no 64 bit integers, so
+ * this is a port of clrps_rng.h and clrps_rules.h with seed and generation
+ * as (low, high) word pairs. It must stay bit-identical with them.
+ * WIDTH, HEIGHT, BOUNDARY and the RULE_* values are defined by the host.
+ */
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(binding = 0, r8ui) uniform readonly uimage2D universe;
+layout(binding = 1, r8ui) uniform writeonly uimage2D update;
+
+uniform uvec2 seed;
+uniform uvec2 generation;
+
+#define BOUNDARY_PERIODIC		0
+#define BOUNDARY_REFLECTIVE		1
+#define BOUNDARY_FIXED			2
+
+#define NEIGHBOURHOOD_MOORE			0
+#define NEIGHBOURHOOD_VON_NEUMANN	1
+#define NEIGHBOURHOOD_HEX			2
+
+#define FILL_DECAY				0
+#define FILL_CLONE				1
+
+/*
+ * Philox4x32-10, see clrps_rng.h
+ */
+#define PHILOX_M0	0xD2511F53u
+#define PHILOX_M1	0xCD9E8D57u
+#define PHILOX_W0	0x9E3779B9u
+#define PHILOX_W1	0xBB67AE85u
+
+uint rngCell(uint x, uint y) {
+	uvec4 c = uvec4(x >> 2, y, generation.x, generation.y);
+	uvec2 k = seed;
+
+	for(int i = 0; i < 10; i++) {
+		uint hi0, lo0, hi1, lo1;
+		umulExtended(PHILOX_M0, c.x, hi0, lo0);
+		umulExtended(PHILOX_M1, c.z, hi1, lo1);
+
+		c = uvec4(hi1 ^ c.y ^ k.x, lo1, hi0 ^ c.w ^ k.y, lo0);
+		k += uvec2(PHILOX_W0, PHILOX_W1);
+	}
+	return c[x & 3u];
+}
+
+uint rngChoice(uint word, uint count) {
+	uint hi, lo;
+	umulExtended(word, count, hi, lo);
+	return hi;
+}
+
+/*
+ * Neighbourhood offsets, [row parity * RULE_DIRECTIONS + direction]
+ */
+#if RULE_NEIGHBOURHOOD == NEIGHBOURHOOD_MOORE
+	#define RULE_DIRECTIONS		8
+	const int rule_dx[16] = int[](1,  0, -1,  1, -1,  1,  0, -1,	 1,  0, -1,  1, -1,  1,  0, -1);
+	const int rule_dy[16] = int[](-1, -1, -1,  0,  0,  1,  1,  1,	-1, -1, -1,  0,  0,  1,  1,  1);
+#elif RULE_NEIGHBOURHOOD == NEIGHBOURHOOD_VON_NEUMANN
+	#define RULE_DIRECTIONS		4
+	const int rule_dx[8] = int[]( 0, -1,  1,  0,	 0, -1,  1,  0);
+	const int rule_dy[8] = int[](-1,  0,  0,  1,	-1,  0,  0,  1);
+#else
+	#define RULE_DIRECTIONS		6
+	const int rule_dx[12] = int[](1, -1, -1,  0, -1,  0,	1, -1,  0,  1,  0,  1);
+	const int rule_dy[12] = int[](0,  0, -1, -1,  1,  1,	0,  0, -1, -1,  1,  1);
+#endif
+
+int boundaryCoord(int coord, int size) {
+	if(coord >= 0 && coord < size) {
+		return coord;
+	}
+#if BOUNDARY == BOUNDARY_PERIODIC
+	return coord < 0 ? coord + size : coord - size;
+#elif BOUNDARY == BOUNDARY_REFLECTIVE
+	return coord < 0 ? -coord - 1 : 2 * size - coord - 1;
+#else
+	return -1;
+#endif
+}
+
+int rpsRule(int current, int neighbour) {
+	int species = current / RULE_HEALTH;
+	int other = neighbour / RULE_HEALTH;
+
+	if(species == 0) {
+#if RULE_FILL == FILL_DECAY
+		return neighbour % RULE_HEALTH != 0 ? neighbour - 1 : 0;
+#else
+		return neighbour;
+#endif
+	}
+
+	int ahead = (other - species + RULE_SPECIES) % RULE_SPECIES;
+	if(other == 0 || ahead == 0 || ahead > RULE_PREDATORS) {
+		return current;
+	}
+	return current % RULE_HEALTH != 0 ? current - 1 : other * RULE_HEALTH + RULE_HEALTH - 1;
+}
+
+void main() {
+	int x = int(gl_GlobalInvocationID.x);
+	int y = int(gl_GlobalInvocationID.y);
+
+	// Invocations past the edge of the rounded up dispatch
+	if(x >= WIDTH || y >= HEIGHT) {
+		return;
+	}
+
+	int direction = (y & 1) * RULE_DIRECTIONS + int(rngChoice(rngCell(uint(x), uint(y)), uint(RULE_DIRECTIONS)));
+	int nx = boundaryCoord(x + rule_dx[direction], WIDTH);
+	int ny = boundaryCoord(y + rule_dy[direction], HEIGHT);
+
+	int neighbour = (nx < 0 || ny < 0) ? 0 : int(imageLoad(universe, ivec2(nx, ny)).r);
+	int current = int(imageLoad(universe, ivec2(x, y)).r);
+
+	imageStore(update, ivec2(x, y), uvec4(uint(rpsRule(current, neighbour)), 0u, 0u, 0u));
+}
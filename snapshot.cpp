@@ -0,0 +1,191 @@
+#include "snapshot.hpp"
+#include "clrps_rules.h"
+#include "utils.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string.h>
+
+static_assert(sizeof(SnapshotHeader) == 72, "snapshot header layout changed");
+
+size_t packedSize(unsigned int width, unsigned int height) {
+	return ((size_t) width * height + 3) / 4 * 3;
+}
+
+static size_t encodedSize(cl_uint encoding, unsigned int width, unsigned int height) {
+	return encoding == SNAPSHOT_RAW8 ? (size_t) width * height : packedSize(width, height);
+}
+
+void initSnapshotHeader(SnapshotHeader &header, cl_uint encoding, unsigned int width, unsigned int height,
+		cl_ulong generation, cl_ulong seed, int boundary) {
+	header = SnapshotHeader();
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.encoding = encoding;
+	header.width = width;
+	header.height = height;
+	header.generation = generation;
+	header.seed = seed;
+	header.boundary = boundary;
+	header.species = RULE_SPECIES;
+	header.health = RULE_HEALTH;
+	header.predators = RULE_PREDATORS;
+	header.neighbourhood = RULE_NEIGHBOURHOOD;
+	header.fill = RULE_FILL;
+	header.data_size = encodedSize(encoding, width, height);
+}
+
+bool validSnapshotHeader(const SnapshotHeader &header, const char *file_path, cl_uint encoding) {
+	if(memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION) {
+		std::cerr << "Not a snapshot: " << file_path << std::endl;
+		return false;
+	}
+	if(header.encoding != encoding || header.data_size != encodedSize(encoding, header.width, header.height)) {
+		std::cerr << "Unsupported snapshot encoding: " << file_path << std::endl;
+		return false;
+	}
+	if(header.species != RULE_SPECIES || header.health != RULE_HEALTH || header.predators != RULE_PREDATORS ||
+			header.neighbourhood != RULE_NEIGHBOURHOOD || header.fill != RULE_FILL) {
+		std::cerr << "Snapshot rules differ: " << header.species << " species, " << header.health << " health levels, "
+				<< header.predators << " predators, neighbourhood " << header.neighbourhood << ", fill " << header.fill << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool readSnapshotHeader(const char *file_path, SnapshotHeader &header) {
+	std::ifstream file(file_path, std::ios::binary);
+	if(!file.read((char *) &header, sizeof(header))) {
+		std::cerr << "Unable to read snapshot: " << file_path << std::endl;
+		return false;
+	}
+	return validSnapshotHeader(header, file_path, SNAPSHOT_PACKED6);
+}
+
+bool saveSnapshot(const char *file_path, ClEngine &engine) {
+	cl_int clError;
+	const size_t data_size = packedSize(engine.width, engine.height);
+	const size_t groups = ((size_t) engine.width * engine.height + 3) / 4;
+
+	if(RULE_STATES > 64) {
+		std::cerr << "Snapshots pack cells in 6 bits, the rule set has " << RULE_STATES << " states" << std::endl;
+		return false;
+	}
+
+	cl_kernel kernel = createEngineKernel(engine, "rps_pack");
+	if(!kernel) {
+		return false;
+	}
+	cl_mem packed = clCreateBuffer(engine.context, CL_MEM_WRITE_ONLY, data_size, NULL, &clError);
+	if(clError) {
+		std::cerr << "Unable to allocate snapshot buffer: " << clError << std::endl;
+		clReleaseKernel(kernel);
+		return false;
+	}
+
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &engine.universe);
+	clSetKernelArg(kernel, 1, sizeof(cl_mem), &packed);
+	clError = clEnqueueNDRangeKernel(engine.queue, kernel, 1, NULL, &groups, NULL, 0, NULL, NULL);
+
+	MappedFile file;
+	bool saved = false;
+	if(clError) {
+		std::cerr << "Unable to pack snapshot: " << clError << std::endl;
+	} else if(!createMappedFile(file, file_path, sizeof(SnapshotHeader) + data_size)) {
+		std::cerr << "Unable to create snapshot: " << file_path << std::endl;
+	} else {
+		SnapshotHeader header;
+		initSnapshotHeader(header, SNAPSHOT_PACKED6, engine.width, engine.height, engine.generation, engine.seed, engine.boundary);
+		memcpy(file.data, &header, sizeof(header));
+
+		// Straight from the device into the page cache
+		clError = clEnqueueReadBuffer(engine.queue, packed, CL_TRUE, 0, data_size, file.data + sizeof(header), 0, NULL, NULL);
+		unmapFile(file);
+		saved = clError == CL_SUCCESS;
+		if(!saved) {
+			std::cerr << "Unable to read snapshot: " << clError << std::endl;
+		}
+	}
+
+	clReleaseMemObject(packed);
+	clReleaseKernel(kernel);
+
+	if(saved) {
+		std::cout << "=-- Snapshot saved: " << file_path << ", generation " << engine.generation << std::endl;
+	}
+	return saved;
+}
+
+bool loadSnapshot(const char *file_path, ClEngine &engine) {
+	cl_int clError;
+
+	MappedFile file;
+	if(!mapFile(file, file_path)) {
+		std::cerr << "Unable to open snapshot: " << file_path << std::endl;
+		return false;
+	}
+
+	SnapshotHeader header;
+	if(file.size < sizeof(header)) {
+		std::cerr << "Not a snapshot: " << file_path << std::endl;
+		unmapFile(file);
+		return false;
+	}
+	memcpy(&header, file.data, sizeof(header));
+	if(!validSnapshotHeader(header, file_path, SNAPSHOT_PACKED6)) {
+		unmapFile(file);
+		return false;
+	}
+	if(file.size < sizeof(header) + header.data_size) {
+		std::cerr << "Truncated snapshot: " << file_path << std::endl;
+		unmapFile(file);
+		return false;
+	}
+	if(header.width != engine.width || header.height != engine.height || (int) header.boundary != engine.boundary) {
+		std::cerr << "Snapshot of a " << header.width << "x" << header.height << " world with boundary " << header.boundary
+				<< " does not match the running one" << std::endl;
+		unmapFile(file);
+		return false;
+	}
+
+	cl_kernel kernel = createEngineKernel(engine, "rps_unpack");
+	if(!kernel) {
+		unmapFile(file);
+		return false;
+	}
+
+	// Straight from the mapping to the device, the cells are unpacked there
+	const size_t groups = ((size_t) engine.width * engine.height + 3) / 4;
+	cl_mem packed = clCreateBuffer(engine.context, CL_MEM_READ_ONLY, header.data_size, NULL, &clError);
+	if(!clError) {
+		clError = clEnqueueWriteBuffer(engine.queue, packed, CL_TRUE, 0, header.data_size, file.data + sizeof(header), 0, NULL, NULL);
+	}
+	if(!clError) {
+		markClEngineChanged(engine);
+		clSetKernelArg(kernel, 0, sizeof(cl_mem), &packed);
+		clSetKernelArg(kernel, 1, sizeof(cl_mem), &engine.universe);
+		clError = clEnqueueNDRangeKernel(engine.queue, kernel, 1, NULL, &groups, NULL, 0, NULL, NULL);
+	}
+	if(!clError) {
+		clError = clFinish(engine.queue);
+	}
+
+	if(packed) {
+		clReleaseMemObject(packed);
+	}
+	clReleaseKernel(kernel);
+	unmapFile(file);
+
+	if(clError) {
+		std::cerr << "Unable to restore snapshot: " << clError << std::endl;
+		return false;
+	}
+
+	// Continue the run exactly where it was saved
+	engine.generation = header.generation;
+	engine.seed = header.seed;
+	clSetKernelArg(engine.kernel, 3, sizeof(cl_ulong), &engine.seed);
+
+	std::cout << "=-- Snapshot restored: " << file_path << ", generation " << engine.generation << std::endl;
+	return true;
+}
@@ -0,0 +1,65 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "cl_engine.hpp"
+
+// File identification and layout version
+#define SNAPSHOT_MAGIC		"CLRPSNAP"
+#define SNAPSHOT_VERSION	2
+
+// Cell encodings
+#define SNAPSHOT_PACKED6	0
+#define SNAPSHOT_RAW8		1	// a byte per cell, rows width bytes apart: out-of-core world files
+
+/*
+ * Snapshot file header, followed by the cell data.
+ * Fixed 72 bytes, stored in host byte order (little endian everywhere we run).
+ */
+struct SnapshotHeader {
+	char				magic[8];
+	cl_uint				version;
+	cl_uint				encoding;
+	cl_uint				width, height;
+	cl_ulong			generation;
+	cl_ulong			seed;
+	cl_uint				boundary;
+	cl_uint				species, health;		// RULE_SPECIES, RULE_HEALTH
+	cl_uint				predators;				// RULE_PREDATORS
+	cl_uint				neighbourhood, fill;	// RULE_NEIGHBOURHOOD, RULE_FILL
+	cl_ulong			data_size;				// bytes of cell data after the header
+};
+
+/*
+ * Bytes of 6 bit packed cells: every four cells make three bytes
+ */
+size_t packedSize(unsigned int width, unsigned int height);
+
+/*
+ * Header of a world under the current rules, data_size set for the encoding
+ */
+void initSnapshotHeader(SnapshotHeader &header, cl_uint encoding, unsigned int width, unsigned int height,
+		cl_ulong generation, cl_ulong seed, int boundary);
+
+/*
+ * Check magic, version, rules and the data size of the expected encoding
+ */
+bool validSnapshotHeader(const SnapshotHeader &header, const char *file_path, cl_uint encoding);
+
+/*
+ * Read and check the header only, to size the world before it is created
+ */
+bool readSnapshotHeader(const char *file_path, SnapshotHeader &header);
+
+/*
+ * Pack the universe on the device and read it straight into a mapped file.
+ * The universe must be acquired if it is GL shared.
+ */
+bool saveSnapshot(const char *file_path, ClEngine &engine);
+
+/*
+ * Upload the mapped cell data and unpack it into the universe on the device.
+ * Size, boundary and rules must match the engine, generation and seed are taken over.
+ */
+bool loadSnapshot(const char *file_path, ClEngine &engine);
+
+#endif //SNAPSHOT_HPP
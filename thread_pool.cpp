@@ -0,0 +1,184 @@
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Task of a job, tagged with the job it belongs to
+ */
+struct QueuedTask {
+	unsigned long			job;
+	size_t					index;
+};
+
+/*
+ * Per worker task queue, the owner pops from the front,
+ * thieves take from the back so they do not fight over the same rows
+ */
+struct WorkQueue {
+	std::mutex				lock;
+	std::deque<QueuedTask>	tasks;
+};
+
+struct ThreadPool {
+	std::vector<std::thread>	workers;
+	std::vector<WorkQueue>		queues;
+
+	std::mutex					lock;
+	std::condition_variable		job_ready, job_done;
+
+	const std::function<void (size_t)> *task;
+	unsigned long				job;
+	std::atomic<size_t>			remaining;
+	unsigned int				busy;
+	bool						running;
+
+	explicit ThreadPool(unsigned int count) : queues(count) {}
+};
+
+/*
+ * Only tasks of the given job are taken: a worker that wakes late for a finished
+ * job must leave the next job's tasks alone, its function is not the one it saw
+ */
+static bool popTask(WorkQueue &queue, unsigned long job, size_t &task) {
+	std::lock_guard<std::mutex> guard(queue.lock);
+	if(queue.tasks.empty() || queue.tasks.front().job != job) {
+		return false;
+	}
+	task = queue.tasks.front().index;
+	queue.tasks.pop_front();
+	return true;
+}
+
+static bool stealTask(WorkQueue &queue, unsigned long job, size_t &task) {
+	std::lock_guard<std::mutex> guard(queue.lock);
+	if(queue.tasks.empty() || queue.tasks.back().job != job) {
+		return false;
+	}
+	task = queue.tasks.back().index;
+	queue.tasks.pop_back();
+	return true;
+}
+
+/*
+ * Drain own queue, then steal until no queue holds a task of the job
+ */
+static void runTasks(ThreadPool *pool, unsigned int index, unsigned long job, const std::function<void (size_t)> &function) {
+	const unsigned int count = pool->queues.size();
+	size_t task;
+
+	for(;;) {
+		bool found = popTask(pool->queues[index], job, task);
+		for(unsigned int i = 1; !found && i < count; i++) {
+			found = stealTask(pool->queues[(index + i) % count], job, task);
+		}
+		if(!found) {
+			return;
+		}
+		function(task);
+		pool->remaining--;
+	}
+}
+
+static void workerLoop(ThreadPool *pool, unsigned int index) {
+	unsigned long seen_job = 0;
+	const std::function<void (size_t)> *task;
+
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> guard(pool->lock);
+			pool->job_ready.wait(guard, [&] { return !pool->running || pool->job != seen_job; });
+			if(!pool->running) {
+				return;
+			}
+			// Job and function are published together with the tasks, so while
+			// a task of seen_job is queued its function is still alive
+			seen_job = pool->job;
+			task = pool->task;
+			pool->busy++;
+		}
+
+		if(task) {
+			runTasks(pool, index, seen_job, *task);
+		}
+
+		std::lock_guard<std::mutex> guard(pool->lock);
+		pool->busy--;
+		if(pool->busy == 0 && pool->remaining == 0) {
+			pool->job_done.notify_all();
+		}
+	}
+}
+
+ThreadPool *createThreadPool(unsigned int threads) {
+	if(threads == 0) {
+		threads = std::thread::hardware_concurrency();
+	}
+	if(threads == 0) {
+		threads = 1;
+	}
+
+	// The calling thread works as the last queue owner
+	ThreadPool *pool = new ThreadPool(threads);
+	pool->task = NULL;
+	pool->job = 0;
+	pool->remaining = 0;
+	pool->busy = 0;
+	pool->running = true;
+
+	for(unsigned int i = 0; i + 1 < threads; i++) {
+		pool->workers.push_back(std::thread(workerLoop, pool, i));
+	}
+
+	return pool;
+}
+
+void destroyThreadPool(ThreadPool *pool) {
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+		pool->running = false;
+	}
+	pool->job_ready.notify_all();
+
+	for(size_t i = 0; i < pool->workers.size(); i++) {
+		pool->workers[i].join();
+	}
+
+	delete pool;
+}
+
+unsigned int threadCount(const ThreadPool *pool) {
+	return pool->queues.size();
+}
+
+void parallelFor(ThreadPool *pool, size_t tasks, const std::function<void (size_t)> &task) {
+	const unsigned int count = pool->queues.size();
+	unsigned long job;
+
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+		job = ++pool->job;
+		pool->task = &task;
+		pool->remaining = tasks;
+
+		// Deal out contiguous ranges so neighbouring rows stay on one core
+		for(unsigned int i = 0; i < count; i++) {
+			std::lock_guard<std::mutex> queue_guard(pool->queues[i].lock);
+			for(size_t t = tasks * i / count; t < tasks * (i + 1) / count; t++) {
+				QueuedTask queued = {job, t};
+				pool->queues[i].tasks.push_back(queued);
+			}
+		}
+	}
+	pool->job_ready.notify_all();
+
+	runTasks(pool, count - 1, job, task);
+
+	std::unique_lock<std::mutex> guard(pool->lock);
+	pool->job_done.wait(guard, [&] { return pool->remaining == 0 && pool->busy == 0; });
+	pool->task = NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <cstddef>
+#include <functional>
+
+struct ThreadPool;
+
+/*
+ * Create a pool with the given number of workers (0 means one per hardware thread)
+ */
+ThreadPool *createThreadPool(unsigned int threads);
+void destroyThreadPool(ThreadPool *pool);
+
+unsigned int threadCount(const ThreadPool *pool);
+
+/*
+ * Run task(0) .. task(tasks - 1) on the pool and wait for all of them.
+ * Tasks are dealt out in contiguous ranges, idle workers steal from the others.
+ */
+void parallelFor(ThreadPool *pool, size_t tasks, const std::function<void (size_t)> &task);
+
+#endif //THREAD_POOL_HPP
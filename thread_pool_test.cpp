@@ -0,0 +1,51 @@
+/*
+ * Stress test of the thread pool: many short jobs back to back, so workers
+ * woken for one job regularly run into the next one
+ */
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+static bool stress(unsigned int threads, size_t tasks, unsigned int jobs) {
+	ThreadPool *pool = createThreadPool(threads);
+	std::vector<std::atomic<unsigned int> > runs(tasks);
+	bool passed = true;
+
+	for(unsigned int job = 0; job < jobs && passed; job++) {
+		for(size_t i = 0; i < tasks; i++) {
+			runs[i] = 0;
+		}
+
+		// A fresh function per job, a stale call of the previous one would hit a dead frame
+		const unsigned int expected = job;
+		std::vector<unsigned int> seen(tasks, ~0u);
+		parallelFor(pool, tasks, [&, expected](size_t i) {
+			seen[i] = expected;
+			runs[i]++;
+		});
+
+		for(size_t i = 0; i < tasks; i++) {
+			if(runs[i] != 1 || seen[i] != expected) {
+				std::cerr << threads << " threads, " << tasks << " tasks: task " << i << " of job " << job
+						<< " ran " << runs[i] << " times" << std::endl;
+				passed = false;
+				break;
+			}
+		}
+	}
+
+	destroyThreadPool(pool);
+	return passed;
+}
+
+int main() {
+	bool passed = stress(4, 64, 200000);
+	passed = stress(32, 2, 50000) && passed;
+	passed = stress(8, 1000, 2000) && passed;
+	passed = stress(3, 0, 1000) && passed;
+
+	std::cout << (passed ? "= Thread pool passed" : "= Thread pool FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
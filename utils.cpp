@@ -1,13 +1,30 @@
 #include "utils.hpp"
+#include "clrps_rules.h"
 #include <iostream>
 #include <fstream>
 #include <ostream>
+#include <sstream>
+#include <vector>
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#if defined _WIN32
+	#include <direct.h>
+#else
+	#include <sys/stat.h>
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+// Default directory of cached program binaries, CLRPS_CACHE_DIR overrides it
+#define PROGRAM_CACHE_DIR	".clrps_cache"
 
 using namespace std;
 
 std::string readFile(const char *file_path) {
-	ifstream file_stream(file_path);
+	ifstream file_stream(file_path, ios::binary);
 
 	string str((istreambuf_iterator<char>(file_stream)), istreambuf_iterator<char>());
 	file_stream.close();
@@ -15,80 +32,372 @@ std::string readFile(const char *file_path) {
 	return str;
 }
 
-GLuint loadShader(const char *vertex_file_path, const char *fragment_file_path) {
-	GLint error;
+bool makeDirectory(const char *path) {
+#if defined _WIN32
+	return _mkdir(path) == 0 || errno == EEXIST;
+#else
+	return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+#if defined _WIN32
+static bool mapView(MappedFile &mapped, DWORD protect, DWORD access) {
+	mapped.mapping = CreateFileMapping(mapped.file, NULL, protect, (DWORD) ((unsigned long long) mapped.size >> 32), (DWORD) mapped.size, NULL);
+	mapped.data = mapped.mapping ? (unsigned char *) MapViewOfFile(mapped.mapping, access, 0, 0, mapped.size) : NULL;
+	if(!mapped.data) {
+		if(mapped.mapping) {
+			CloseHandle(mapped.mapping);
+		}
+		CloseHandle(mapped.file);
+		return false;
+	}
+	return true;
+}
+
+bool mapFile(MappedFile &mapped, const char *file_path, bool writable) {
+	LARGE_INTEGER size;
+	mapped.file = CreateFileA(file_path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, writable ? 0 : FILE_SHARE_READ,
+			NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(mapped.file == INVALID_HANDLE_VALUE || !GetFileSizeEx(mapped.file, &size) || size.QuadPart == 0) {
+		if(mapped.file != INVALID_HANDLE_VALUE) {
+			CloseHandle(mapped.file);
+		}
+		return false;
+	}
+	mapped.size = size.QuadPart;
+	return writable ? mapView(mapped, PAGE_READWRITE, FILE_MAP_WRITE) : mapView(mapped, PAGE_READONLY, FILE_MAP_READ);
+}
+
+bool createMappedFile(MappedFile &mapped, const char *file_path, size_t size) {
+	mapped.file = CreateFileA(file_path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(mapped.file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	mapped.size = size;
+	return mapView(mapped, PAGE_READWRITE, FILE_MAP_WRITE);
+}
+
+void unmapFile(MappedFile &mapped) {
+	UnmapViewOfFile(mapped.data);
+	CloseHandle(mapped.mapping);
+	CloseHandle(mapped.file);
+}
+
+void releaseMappedRange(MappedFile &mapped, size_t offset, size_t size) {
+	// The working set trims itself, only the write back is started early
+	FlushViewOfFile(mapped.data + offset, size);
+}
+#else
+bool mapFile(MappedFile &mapped, const char *file_path, bool writable) {
+	struct stat status;
+	mapped.fd = open(file_path, writable ? O_RDWR : O_RDONLY);
+	if(mapped.fd < 0) {
+		return false;
+	}
+	if(fstat(mapped.fd, &status) || status.st_size == 0) {
+		close(mapped.fd);
+		return false;
+	}
+
+	mapped.size = status.st_size;
+	void *data = mmap(NULL, mapped.size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, mapped.fd, 0);
+	if(data == MAP_FAILED) {
+		close(mapped.fd);
+		return false;
+	}
+	mapped.data = (unsigned char *) data;
+
+	// Restores and out-of-core generations stream through the file
+	madvise(data, mapped.size, MADV_SEQUENTIAL);
+	return true;
+}
+
+bool createMappedFile(MappedFile &mapped, const char *file_path, size_t size) {
+	mapped.fd = open(file_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(mapped.fd < 0) {
+		return false;
+	}
+	if(ftruncate(mapped.fd, size)) {
+		close(mapped.fd);
+		return false;
+	}
+
+	mapped.size = size;
+	void *data = mmap(NULL, mapped.size, PROT_READ | PROT_WRITE, MAP_SHARED, mapped.fd, 0);
+	if(data == MAP_FAILED) {
+		close(mapped.fd);
+		return false;
+	}
+	mapped.data = (unsigned char *) data;
+	return true;
+}
 
-	std::string vertex_shader_source 		= readFile(vertex_file_path);
-	std::string fragment_shader_source 	= readFile(fragment_file_path);
+void unmapFile(MappedFile &mapped) {
+	munmap(mapped.data, mapped.size);
+	close(mapped.fd);
+}
 
-	const char *vertex_shader_source_ptr = vertex_shader_source.c_str();
+void releaseMappedRange(MappedFile &mapped, size_t offset, size_t size) {
+	// Whole pages inside the range only, the ones at its ends may still be in use
+	const size_t page = sysconf(_SC_PAGESIZE);
+	const size_t first = (offset + page - 1) / page * page;
+	const size_t last = (offset + size) / page * page;
+	if(first < last) {
+		// Dirty pages of a shared mapping stay in the page cache until written back
+		msync(mapped.data + first, last - first, MS_ASYNC);
+		madvise(mapped.data + first, last - first, MADV_DONTNEED);
+	}
+}
+#endif
 
-	GLuint vertex_shader 	= glCreateShader(GL_VERTEX_SHADER);
-	GLuint fragment_shader 	= glCreateShader(GL_FRAGMENT_SHADER);
+std::string ruleBuildOptions() {
+	std::stringstream options;
+	options << " -D RULE_SPECIES=" << RULE_SPECIES << " -D RULE_HEALTH=" << RULE_HEALTH
+			<< " -D RULE_PREDATORS=" << RULE_PREDATORS << " -D RULE_NEIGHBOURHOOD=" << RULE_NEIGHBOURHOOD
+			<< " -D RULE_FILL=" << RULE_FILL;
+	return options.str();
+}
 
-	glShaderSource(vertex_shader, 1, &vertex_shader_source_ptr , NULL);
-	glCompileShader(vertex_shader);
+std::string ruleShaderDefines() {
+	std::stringstream defines;
+	defines << "#define RULE_SPECIES " << RULE_SPECIES << "\n"
+			<< "#define RULE_HEALTH " << RULE_HEALTH << "\n"
+			<< "#define RULE_PREDATORS " << RULE_PREDATORS << "\n"
+			<< "#define RULE_NEIGHBOURHOOD " << RULE_NEIGHBOURHOOD << "\n"
+			<< "#define RULE_FILL " << RULE_FILL << "\n"
+			<< "#define SPECIES_PALETTE ";
+	for(int species = 1; species <= RULE_SPECIES; species++) {
+		float rgb[3];
+		speciesColor(species, rgb);
+		defines << (species > 1 ? ", " : "") << "vec3(" << rgb[0] << ", " << rgb[1] << ", " << rgb[2] << ")";
+	}
+	defines << "\n";
+	return defines.str();
+}
 
-	glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &error);
-	if(!error) {
-		std::cerr << "Unable to compile vertex shader: " << std::endl;
-		GLint log_length;
-		glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &log_length);
-		char *info_log = new char[log_length];
-		glGetShaderInfoLog(vertex_shader, log_length, NULL, info_log);
-		std::cerr << info_log;
-		delete info_log;
-		return 0;
+void speciesColor(int species, float rgb[3]) {
+	// Fully saturated HSV, hue sector and position in it
+	const double hue = 6.0 * (species - 1) / RULE_SPECIES;
+	const int sector = (int) hue;
+	const float rise = (float) (hue - sector);
+	const float fall = 1.0f - rise;
+	switch(sector) {
+	case 0:  rgb[0] = 1.0f; rgb[1] = rise; rgb[2] = 0.0f; break;
+	case 1:  rgb[0] = fall; rgb[1] = 1.0f; rgb[2] = 0.0f; break;
+	case 2:  rgb[0] = 0.0f; rgb[1] = 1.0f; rgb[2] = rise; break;
+	case 3:  rgb[0] = 0.0f; rgb[1] = fall; rgb[2] = 1.0f; break;
+	case 4:  rgb[0] = rise; rgb[1] = 0.0f; rgb[2] = 1.0f; break;
+	default: rgb[0] = 1.0f; rgb[1] = 0.0f; rgb[2] = fall; break;
 	}
+}
+
+/*
+ * Kernel source with the local headers it includes appended, so edits to them change the cache key
+ */
+static std::string readKernelSources(const char *kernel_file) {
+	std::string source = readFile(kernel_file);
+	std::string sources = source;
 
-	const char *fragment_shader_source_ptr = fragment_shader_source.c_str();
+	size_t position = 0;
+	while((position = source.find("#include \"", position)) != std::string::npos) {
+		position += 10;
+		size_t end = source.find('"', position);
+		if(end == std::string::npos) {
+			break;
+		}
+		sources += readFile(source.substr(position, end - position).c_str());
+	}
 
-	glShaderSource(fragment_shader, 1, &fragment_shader_source_ptr , NULL);
-	glCompileShader(fragment_shader);
+	return sources;
+}
 
-	glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &error);
-	if(!error) {
-		std::cerr << "Unable to compile fragment shader: " << std::endl;
-		GLint log_length;
-		glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &log_length);
-		char *info_log = new char[log_length];
-		glGetShaderInfoLog(fragment_shader, log_length, NULL, info_log);
-		std::cerr << info_log;
-		delete info_log;
-		return 0;
+/*
+ * 64 bit FNV-1a
+ */
+static unsigned long long hashString(const std::string &str) {
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	for(size_t i = 0; i < str.size(); i++) {
+		hash = (hash ^ (unsigned char) str[i]) * 0x100000001b3ULL;
 	}
+	return hash;
+}
+
+static std::string deviceInfoString(const cl_device_id device, cl_device_info info) {
+	size_t length;
+	clGetDeviceInfo(device, info, 0, NULL, &length);
+	std::vector<char> value(length + 1, '\0');
+	clGetDeviceInfo(device, info, length, &value[0], NULL);
+	return std::string(&value[0]);
+}
 
-	GLuint program = glCreateProgram();
-	glAttachShader(program, vertex_shader);
-	glAttachShader(program, fragment_shader);
-	glLinkProgram(program);
+std::string deviceName(cl_device_id device) {
+	return deviceInfoString(device, CL_DEVICE_NAME);
+}
+
+bool platformDevices(unsigned int platform, cl_device_type type, std::vector<cl_device_id> &devices) {
+	cl_uint platform_count = 0;
+	clGetPlatformIDs(0, NULL, &platform_count);
+	if(platform >= platform_count) {
+		std::cerr << "No OpenCL platform " << platform << std::endl;
+		return false;
+	}
+	std::vector<cl_platform_id> platforms(platform_count);
+	clGetPlatformIDs(platform_count, &platforms[0], NULL);
 
-	glGetProgramiv(program, GL_LINK_STATUS, &error);
-	if(!error) {
-		std::cerr << "Unable to link shader program: " << std::endl;
-		GLint log_length;
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
-		char *info_log = new char[log_length];
-		glGetProgramInfoLog(program, log_length, NULL, info_log);
-		std::cerr << info_log;
-		delete info_log;
-		return 0;
+	cl_uint device_count = 0;
+	clGetDeviceIDs(platforms[platform], type, 0, NULL, &device_count);
+	if(device_count == 0) {
+		std::cerr << "No suitable OpenCL device on platform " << platform << std::endl;
+		return false;
 	}
+	devices.resize(device_count);
+	clGetDeviceIDs(platforms[platform], type, device_count, &devices[0], NULL);
+	return true;
+}
+
+bool openContext(cl_device_id device, cl_context &context, cl_command_queue *queues, unsigned int queue_count) {
+	cl_int clError;
 
-	glDeleteShader(vertex_shader);
-	glDeleteShader(fragment_shader);
+	cl_platform_id platform;
+	clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, NULL);
+	cl_context_properties properties[] = {
+			CL_CONTEXT_PLATFORM,	(cl_context_properties) platform,
+			0
+	};
+
+	context = clCreateContext(properties, 1, &device, NULL, NULL, &clError);
+	if(clError) {
+		std::cerr << "Unable to create context: " << clError << std::endl;
+		context = NULL;
+		return false;
+	}
+
+	for(unsigned int i = 0; i < queue_count; i++) {
+		queues[i] = clError ? NULL : clCreateCommandQueue(context, device, 0, &clError);
+	}
+	if(clError) {
+		std::cerr << "Unable to create command queue: " << clError << std::endl;
+		for(unsigned int i = 0; i < queue_count; i++) {
+			if(queues[i]) {
+				clReleaseCommandQueue(queues[i]);
+				queues[i] = NULL;
+			}
+		}
+		clReleaseContext(context);
+		context = NULL;
+		return false;
+	}
+	return true;
+}
+
+bool openDevice(unsigned int platform, unsigned int device, cl_device_id &device_id, cl_context &context, cl_command_queue *queues, unsigned int queue_count) {
+	std::vector<cl_device_id> devices;
+	if(!platformDevices(platform, CL_DEVICE_TYPE_ALL, devices)) {
+		return false;
+	}
+	if(device >= devices.size()) {
+		std::cerr << "No OpenCL device " << device << " on platform " << platform << std::endl;
+		return false;
+	}
+
+	device_id = devices[device];
+	return openContext(device_id, context, queues, queue_count);
+}
+
+/*
+ * Cache file of a program: device, driver, source hash and build options make the key
+ */
+static std::string programCachePath(const cl_device_id device, const std::string &source, const char *build_options) {
+	const char *cache_dir = getenv("CLRPS_CACHE_DIR");
+	std::string dir = cache_dir ? cache_dir : PROGRAM_CACHE_DIR;
+	makeDirectory(dir.c_str());
+
+	std::stringstream key;
+	key << deviceInfoString(device, CL_DEVICE_NAME) << "\n" << deviceInfoString(device, CL_DRIVER_VERSION) << "\n"
+			<< std::hex << hashString(source) << "\n" << build_options;
+
+	std::stringstream path;
+	path << dir << "/" << std::hex << hashString(key.str()) << ".bin";
+	return path.str();
+}
+
+static void printBuildLog(cl_program program, const cl_device_id device) {
+	char *build_log;
+	size_t log_length;
+	clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_length);
+	build_log = new char[log_length];
+	clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_length, build_log, NULL);
+	std::cerr << build_log;
+	delete[] build_log;
+}
+
+/*
+ * Build from a cached binary, NULL if there is none or the device rejects it
+ */
+static cl_program loadCachedProgram(const cl_context context, const cl_device_id device, const std::string &cache_path, const char *build_options) {
+	std::string binary = readFile(cache_path.c_str());
+	if(binary.empty()) {
+		return NULL;
+	}
+
+	cl_int error, binary_status;
+	const unsigned char *binary_ptr = (const unsigned char *) binary.data();
+	const size_t length = binary.size();
+
+	cl_program program = clCreateProgramWithBinary(context, 1, &device, &length, &binary_ptr, &binary_status, &error);
+	if(!error && !binary_status) {
+		error = clBuildProgram(program, 1, &device, build_options, NULL, NULL);
+	}
+	if(error || binary_status) {
+		std::cout << "=-- Cached program rejected, rebuilding: " << cache_path << std::endl;
+		if(program) {
+			clReleaseProgram(program);
+		}
+		return NULL;
+	}
 
 	return program;
 }
 
-cl_kernel loadKernel(const cl_context context, const cl_device_id device, const char *kernel_file, const char* build_options, const char* kernel_name) {
+static void storeCachedProgram(cl_program program, const std::string &cache_path) {
+	size_t length;
+	if(clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &length, NULL) || length == 0) {
+		return;
+	}
+
+	std::vector<unsigned char> binary(length);
+	unsigned char *binary_ptr = &binary[0];
+	if(clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char *), &binary_ptr, NULL)) {
+		return;
+	}
+
+	ofstream file(cache_path.c_str(), ios::binary);
+	file.write((const char *) binary_ptr, length);
+	if(!file) {
+		std::cerr << "Unable to write program cache: " << cache_path << std::endl;
+	}
+}
+
+cl_program loadProgram(const cl_context context, const cl_device_id device, const char *kernel_file, const char* build_options) {
 	cl_int error;
 	std::string source = readFile(kernel_file);
 
+	// Every kernel is specialized for the rule set the host was built with
+	const std::string options = build_options + ruleBuildOptions();
+	build_options = options.c_str();
+	std::string cache_path = programCachePath(device, readKernelSources(kernel_file), build_options);
+
+	cl_program program = loadCachedProgram(context, device, cache_path, build_options);
+	if(program) {
+		std::cout << "=-- Program cache hit: " << kernel_file << std::endl;
+		return program;
+	}
+	std::cout << "=-- Program cache miss: " << kernel_file << std::endl;
+
 	const char *source_ptr = source.data();
 	const size_t length = source.size();
 
-	cl_program program = clCreateProgramWithSource(context, 1, (const char**) &source_ptr, &length, &error);
+	program = clCreateProgramWithSource(context, 1, (const char**) &source_ptr, &length, &error);
 	if(error) {
 		std::cerr << "Unable to create program: " << error << std::endl;
 		return NULL;
@@ -96,26 +405,33 @@ cl_kernel loadKernel(const cl_context context, const cl_device_id device, const
 
 	error = clBuildProgram(program, 1, &device, build_options, NULL, NULL);
 	if(error) {
-		char *build_log;
-		size_t log_length;
 		std::cerr << "Error building program: " << error << std::endl;
-		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_length);
-		build_log = new char[log_length];
-		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_length, build_log, NULL);
-		std::cerr << build_log;
-		delete build_log;
+		printBuildLog(program, device);
 
 		clReleaseProgram(program);
 
 		return NULL;
 	}
 
+	storeCachedProgram(program, cache_path);
+
+	return program;
+}
+
+cl_kernel loadKernel(const cl_context context, const cl_device_id device, const char *kernel_file, const char* build_options, const char* kernel_name) {
+	cl_int error;
+
+	cl_program program = loadProgram(context, device, kernel_file, build_options);
+	if(!program) {
+		return NULL;
+	}
+
 	cl_kernel kernel = clCreateKernel(program, kernel_name, &error);
+	clReleaseProgram(program);
 	if(error) {
 		std::cerr << "Unable to create kernel: " << error << std::endl;
 		return NULL;
 	}
-	clReleaseProgram(program);
 
 	return kernel;
 }
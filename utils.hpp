@@ -1,19 +1,78 @@
 #define __NO_STD_VECTOR // Use cl::vector instead of STL version
 #include <CL/cl.h>
 
-#include <GL/glew.h>
-
-#define GLFW_INCLUDE_GL3
-#include "GL/glfw.h"
 #include <string>
 #include <vector>
 
+#if defined _WIN32
+	#include <windows.h>
+#endif
+
 #ifndef UTILS_HPP
 #define UTILS_HPP
 
 std::string readFile(const char *file_path);
+bool makeDirectory(const char *path);
+
+/*
+ * Whole file memory mapping: an existing file, read only unless writable is set,
+ * or a new one created writable with a given size
+ */
+struct MappedFile {
+	unsigned char	*data;
+	size_t			size;
+#if defined _WIN32
+	HANDLE			file, mapping;
+#else
+	int				fd;
+#endif
+};
+
+bool mapFile(MappedFile &mapped, const char *file_path, bool writable = false);
+bool createMappedFile(MappedFile &mapped, const char *file_path, size_t size);
+void unmapFile(MappedFile &mapped);
+
+/*
+ * Start writing back a range of a writable mapping and drop its pages from the process,
+ * so streaming through a file larger than memory keeps only the recent ranges resident
+ */
+void releaseMappedRange(MappedFile &mapped, size_t offset, size_t size);
+
+/*
+ * The rule set of clrps_rules.h as kernel build options and as shader defines
+ * with the generated species palette
+ */
+std::string ruleBuildOptions();
+std::string ruleShaderDefines();
+
+/*
+ * Display color of species 1..RULE_SPECIES: evenly spaced hues starting at red,
+ * so rock, paper, scissors are red, green and blue
+ */
+void speciesColor(int species, float rgb[3]);
+
+/*
+ * Devices of the given type on the selected platform, fails when there are none
+ */
+bool platformDevices(unsigned int platform, cl_device_type type, std::vector<cl_device_id> &devices);
+
+/*
+ * Windowless context on a device with queue_count in-order queues.
+ * Nothing is left allocated when it fails.
+ */
+bool openContext(cl_device_id device, cl_context &context, cl_command_queue *queues, unsigned int queue_count);
+
+/*
+ * openContext() on the selected platform and device index, e.g. pocl on a CPU
+ */
+bool openDevice(unsigned int platform, unsigned int device, cl_device_id &device_id, cl_context &context, cl_command_queue *queues, unsigned int queue_count);
+
+std::string deviceName(cl_device_id device);
 
-GLuint loadShader(const char *vertexFile, const char *fragmentFile);
+/*
+ * Build a program, going through the binary cache when the device accepts it
+ */
+cl_program loadProgram(const cl_context context, const cl_device_id device, const char *kernel_file, const char* build_options);
 cl_kernel loadKernel(const cl_context context, const cl_device_id device, const char *kernel_file, const char* build_options, const char* kernel_name);
 
 #endif //UTILS_HPP